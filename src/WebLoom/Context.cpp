@@ -3,14 +3,20 @@
 //  Released under LGPL 3.0 license (see LICENSE)
 #include <stdexcept>
 #include "core/Platform.h"
+#include "core/EpollServer.h"
 #include "core/HttpServer.h"
+#include "core/PreforkServer.h"
+#include "core/ReusePortServer.h"
+#include "core/TlsContext.h"
+#include "core/UringServer.h"
 #include "Context.h"
 #include "Templater.h"
 
 namespace webloom {
 
 Context::Context(std::string contextName, WebLoomSettings *settings)
-       : context_name_(contextName), logger_(nullptr), fileserver_(nullptr) {
+       : context_name_(contextName), logger_(nullptr), fileserver_(nullptr),
+         tls_context_(nullptr), memory_budget_(nullptr) {
     auto staticDir = settings->StaticWebsiteDir();
     if (staticDir.empty() || staticDir.back() != '/') {
         // Append '/' at the end of the path as one doesn't exist.
@@ -29,15 +35,133 @@ Context::Context(std::string contextName, WebLoomSettings *settings)
 }
 
 core::IServer *Context::CreateServer(const core::LoggerSettings& logSettings) {
-    logger_ = new core::Logger(logSettings);
+    bool prefork = false;
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    prefork = settings_->WorkerProcesses() > 0;
+#endif
 
+    // The supervisor of worker processes logs synchronously, a logging
+    // thread would not survive it forking its workers.
+    logger_ = new core::Logger(logSettings, prefork);
+
+    fileserver_ = CreateFileServer();
+
+    // Every server of the process is charged to the one budget, a worker
+    // process gets a copy of its own when it is forked.
+    memory_budget_ = new core::MemoryBudget(settings_->MemoryBudget());
+
+    // One context serves every listener and worker process, so that any of
+    // them resumes the sessions of the others.
+    if (!settings_->TlsCertificateFile().empty()) {
+        bool offerHttp2 = settings_->Http2Enabled() &&
+                          settings_->Engine() != ServerEngine::Threaded;
+        tls_context_ = new core::TlsContext(logger_, settings_, offerHttp2);
+    }
+
+    Templater::Instance().Initialise(logger_, settings_, fileserver_);
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (prefork) {
+        // The workers accept from one set of listening sockets, bound by
+        // the supervisor.
+        if (settings_->ListenerCount() > 1) {
+            logger_->LogWarn("Worker processes share one listener, ignoring "
+                             "the listener count");
+            settings_->ListenerCount(1);
+        }
+
+        return new core::PreforkServer(logger_, settings_, logSettings,
+                                       CreateEngine(fileserver_));
+    }
+#else
+    if (settings_->WorkerProcesses() > 0) {
+        logger_->LogWarn("Worker processes are only available on Linux, "
+                         "serving from this process instead");
+    }
+#endif
+
+    if (settings_->ListenerCount() > 1) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+        // Every listener gets its own file server so that nothing is shared
+        // between them on the request path.
+        return new core::ReusePortServer(
+            logger_,
+            settings_->ListenerCount(),
+            [this, slot = 0u]() mutable {
+                core::ServerBase *engine = CreateEngine(CreateFileServer());
+                engine->AssignCpuSlot(slot++);
+                return engine;
+            });
+#else
+        logger_->LogWarn("Multiple listeners are only available on Linux, "
+                         "using a single listener instead");
+#endif
+    }
+
+    return CreateEngine(fileserver_);
+}
+
+core::FileServer *Context::CreateFileServer() {
     std::string libmagicDB = settings_->LibmagicDB();
     const char* dbPath = (libmagicDB.empty()) ? nullptr : libmagicDB.c_str();
-    fileserver_ = new core::FileServer(logger_, dbPath);
+    return new core::FileServer(logger_, dbPath);
+}
 
-    Templater::Instance().Initialise(logger_, settings_, fileserver_);
+core::ServerBase *Context::CreateEngine(core::FileServer *fileServer) {
+    ServerEngine engine = settings_->Engine();
+    core::ServerBase *server = nullptr;
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (engine == ServerEngine::IoUring && tls_context_) {
+        logger_->LogWarn("TLS is not supported by the io_uring server "
+                         "engine, using the epoll server engine instead");
+        engine = ServerEngine::Epoll;
+    }
+
+    if (engine == ServerEngine::IoUring) {
+        if (core::UringServer::IsSupported()) {
+            server = new core::UringServer(logger_, settings_, fileServer);
+        } else {
+            logger_->LogWarn("io_uring is not supported by this kernel, "
+                             "using the epoll server engine instead");
+            engine = ServerEngine::Epoll;
+        }
+    }
+
+    if (engine == ServerEngine::Epoll) {
+        server = new core::EpollServer(logger_, settings_, fileServer);
+    }
+#else
+    if (engine != ServerEngine::Threaded) {
+        logger_->LogWarn("The epoll and io_uring server engines are only "
+                         "available on Linux, using the threaded engine "
+                         "instead");
+    }
+#endif
+
+    if (!server) {
+        server = new core::HttpServer(logger_, settings_, fileServer);
+    }
+
+    if (tls_context_) {
+        server->EnableTls(tls_context_);
+    }
+
+    server->TrackMemory(memory_budget_);
+
+    return server;
+}
+
+/**
+ * @brief Reports the memory held by the servers of this process, all zero
+ *        until the server has been created.
+ */
+core::MemoryBudget::Usage Context::MemoryUsage() const {
+    if (!memory_budget_) {
+        return {};
+    }
 
-    return new core::HttpServer(logger_, settings_, fileserver_);
+    return memory_budget_->Snapshot();
 }
 
 }   // namespace webloom
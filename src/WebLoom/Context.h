@@ -7,6 +7,9 @@
 #include <string>
 #include "core/Logger.h"
 #include "core/IServer.h"
+#include "core/MemoryBudget.h"
+#include "core/ServerBase.h"
+#include "core/TlsContext.h"
 #include "WebLoomSettings.h"
 #include "core/FileServer.h"
 
@@ -22,11 +25,19 @@ class Context {
      core::IServer *CreateServer(
          const core::LoggerSettings &logSettings = DefaultLoggerSettings);
 
+     core::MemoryBudget::Usage MemoryUsage() const;
+
  private:
+     core::FileServer *CreateFileServer();
+
+     core::ServerBase *CreateEngine(core::FileServer *fileServer);
+
      std::string context_name_;
      core::Logger *logger_;
      WebLoomSettings *settings_;
      core::FileServer *fileserver_;
+     core::TlsContext *tls_context_;
+     core::MemoryBudget *memory_budget_;
 };
 
 #endif  // CONTEXT_H_
@@ -0,0 +1,89 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "EventStream.h"
+
+namespace webloom {
+
+EventBroadcaster::EventBroadcaster()
+    : next_listener_id_(0), subscribers_(0) {
+}
+
+/**
+ * @brief Sends an event to every subscriber.
+ *
+ * Each line of the data becomes a "data:" field, which the client joins
+ * back together with newlines. Lines may end with CRLF, CR or LF, as the
+ * client splits them on any of these.
+ *
+ * @param data The event's data.
+ * @param event The event's type, "message" when left empty.
+ * @param id The event's identifier, which the client sends back as
+ *           Last-Event-ID when it reconnects. None when left empty.
+ * @throws std::invalid_argument if the type or identifier contains a line
+ *         break, which would let it add fields of its own to the event.
+ */
+void EventBroadcaster::Publish(std::string_view data,
+                               std::string_view event,
+                               std::string_view id) {
+    if (event.find_first_of("\r\n") != std::string_view::npos ||
+        id.find_first_of("\r\n") != std::string_view::npos) {
+        throw std::invalid_argument("Event type and id can not contain line "
+                                    "breaks");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (listeners_.empty()) {
+        return;
+    }
+
+    auto serialised = std::make_shared<std::string>();
+    serialised->reserve(data.size() + event.size() + id.size() + 32);
+
+    if (!id.empty()) {
+        serialised->append("id: ").append(id).append("\n");
+    }
+
+    if (!event.empty()) {
+        serialised->append("event: ").append(event).append("\n");
+    }
+
+    size_t start = 0;
+    while (true) {
+        size_t end = data.find_first_of("\r\n", start);
+        serialised->append("data: ")
+                   .append(data.substr(start, end - start))
+                   .append("\n");
+
+        if (end == std::string_view::npos) {
+            break;
+        }
+        start = end + (data.compare(end, 2, "\r\n") == 0 ? 2 : 1);
+    }
+
+    serialised->append("\n");
+
+    std::shared_ptr<const std::string> shared = std::move(serialised);
+    for (auto &entry : listeners_) {
+        entry.second(shared);
+    }
+}
+
+uint64_t EventBroadcaster::AddListener(Listener listener) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t id = next_listener_id_++;
+    listeners_.emplace(id, std::move(listener));
+    return id;
+}
+
+void EventBroadcaster::RemoveListener(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    listeners_.erase(id);
+}
+
+}   // namespace webloom
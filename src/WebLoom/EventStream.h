@@ -0,0 +1,69 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef EVENTSTREAM_H_
+#define EVENTSTREAM_H_
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>                // NOLINT(build/c++11)
+#include <string>
+#include <string_view>
+#include "Request.h"
+
+namespace webloom {
+
+namespace core {
+class AsyncServerBase;
+}   // namespace core
+
+/**
+ * @brief Sends server-sent events to every client subscribed to it.
+ *
+ * Each event is serialised once and the one copy is queued on every
+ * subscriber's connection by the server loop that owns it, so no worker
+ * thread is held per subscriber and no event is copied per subscriber.
+ * Events are only sent to clients subscribed when they are published.
+ *
+ * A broadcaster must outlive the servers whose clients subscribe to it.
+ */
+class EventBroadcaster {
+ public:
+    EventBroadcaster();
+
+    EventBroadcaster(const EventBroadcaster &) = delete;
+    EventBroadcaster &operator=(const EventBroadcaster &) = delete;
+
+    void Publish(std::string_view data,
+                 std::string_view event = "",
+                 std::string_view id = "");
+
+    size_t Subscribers() const { return subscribers_.load(); }
+
+ private:
+    friend class core::AsyncServerBase;
+
+    // Called with every event published, from the publishing thread.
+    using Listener =
+        std::function<void(std::shared_ptr<const std::string> event)>;
+
+    std::mutex mutex_;
+    uint64_t next_listener_id_;
+    std::map<uint64_t, Listener> listeners_;
+
+    std::atomic<size_t> subscribers_;
+
+    uint64_t AddListener(Listener listener);
+
+    void RemoveListener(uint64_t id);
+};
+
+// Called with the request opening an event stream, returning the broadcaster
+// to subscribe the client to or nullptr to refuse it with 403 Forbidden.
+using EventStreamFunction = std::function<EventBroadcaster *(Request *)>;
+
+}   // namespace webloom
+
+#endif  // EVENTSTREAM_H_
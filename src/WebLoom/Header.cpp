@@ -17,7 +17,7 @@ void Header::Add(std::string key, std::string value) {
     header_values_[key] = { key, value };
 }
 
-const std::string *Header::Get(std::string key) {
+const std::string *Header::Get(std::string key) const {
     auto it = header_values_.find(key);
 
     if (it != header_values_.end()) {
@@ -27,7 +27,7 @@ const std::string *Header::Get(std::string key) {
     return nullptr;
 }
 
-std::vector<std::string> Header::AllKeys() {
+std::vector<std::string> Header::AllKeys() const {
     std::vector<std::string> keys;
 
     // Iterate through the map and collect keys
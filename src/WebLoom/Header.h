@@ -10,6 +10,8 @@
 
 namespace webloom {
 
+const char HEADER_KEY_CONTENT_TYPE[] = "Content-Type";
+
 struct HeaderKeyValuePair {
     std::string key;
     std::string value;
@@ -21,9 +23,9 @@ class Header{
 
     void Add(std::string key, std::string value);
 
-    const std::string *Get(std::string key);
+    const std::string *Get(std::string key) const;
 
-    std::vector<std::string> AllKeys();
+    std::vector<std::string> AllKeys() const;
 
  private:
     std::map<std::string, HeaderKeyValuePair> header_values_;
@@ -14,6 +14,7 @@ const std::unordered_map<std::string, HttpContentType> contentTypeMap = {
     {"text/javascript", HttpContentType::TextJavaScript},
     {"text/xml", HttpContentType::TextXML},
     {"text/csv", HttpContentType::TextCSV},
+    {"text/event-stream", HttpContentType::TextEventStream},
 
     {"application/json", HttpContentType::ApplicationJSON},
     {"application/xml", HttpContentType::ApplicationXML},
@@ -77,6 +78,7 @@ std::string HttpContentTypeString(HttpContentType type) {
     case HttpContentType::TextJavaScript: return "text/javascript";
     case HttpContentType::TextXML: return "text/xml";
     case HttpContentType::TextCSV: return "text/csv";
+    case HttpContentType::TextEventStream: return "text/event-stream";
 
     case HttpContentType::ApplicationJSON: return "application/json";
     case HttpContentType::ApplicationXML: return "application/xml";
@@ -15,6 +15,7 @@ enum class HttpContentType {
     TextJavaScript,
     TextXML,
     TextCSV,
+    TextEventStream,
 
     // Application types
     ApplicationJSON,
@@ -10,6 +10,9 @@ Request::Request(RequestMethod method, HttpVersion httpVersion,
                  std::string path) : http_version_(httpVersion),
                  path_(std::move(path)), request_method_(method),
                  client_platform_(UserAgentClientPlatform::Unknown) {
+    // HTTP/1.1 connections are persistent unless the client asks otherwise,
+    // HTTP/1.0 clients have to opt in.
+    keep_alive_ = (httpVersion != HttpVersion::HTTP_1_0);
 }
 
 }   // namespace webloom
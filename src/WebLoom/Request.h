@@ -4,6 +4,7 @@
 #ifndef REQUEST_H_
 #define REQUEST_H_
 #include <string>
+#include <utility>
 #include "RequestMethod.h"
 #include "Header.h"
 
@@ -64,18 +65,29 @@ class Request {
     }
     UserAgentClientPlatform ClientPlatform() { return client_platform_; }
 
+    // Whether the client wants the connection kept open after the response,
+    // defaults from the HTTP version and is overridden by 'Connection'.
+    void KeepAlive(bool keepAlive) { keep_alive_ = keepAlive; }
+    bool KeepAlive() { return keep_alive_; }
+
     void AddHeaders(const Header& header) { header_ = header; }
 
     Header Headers() { return header_; }
 
+    void Body(const std::string &body) { body_ = body; }
+    void Body(std::string &&body) { body_ = std::move(body); }
+    const std::string &Body() { return body_; }
+
  private:
     Header header_;
+    std::string body_;
     std::string host_;
     HttpVersion http_version_;
     std::string path_;
     RequestMethod request_method_;
     std::string user_agent_;
     UserAgentClientPlatform client_platform_;
+    bool keep_alive_;
 };
 
 }   // namespace webloom
@@ -1,15 +1,201 @@
 //  WebLoom Framework
 //  Copyright (C) 2024 WebLoom Framework contributors
 //  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+# include <fcntl.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include "Response.h"
+#include "core/SplicePipe.h"
 
 namespace webloom {
 
+/**
+ * @brief Adds data to the response as one chunk.
+ *
+ * Writing nothing produces no chunk, an empty chunk would end the response.
+ */
+void ChunkWriter::Write(const char *data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    if (spliced_ != 0) {
+        throw std::logic_error("Data written after a spliced part");
+    }
+
+    if (!chunked_) {
+        frames_.append(data, length);
+        return;
+    }
+
+    char size[20];
+    int sizeLength = snprintf(size, sizeof(size), "%zx\r\n", length);
+
+    frames_.append(size, sizeLength);
+    frames_.append(data, length);
+    frames_.append("\r\n");
+}
+
+/**
+ * @brief Moves the next part of the body from a socket into the response's
+ *        pipe, without it passing through user space.
+ *
+ * Only one part can be spliced each time the source is called, and only
+ * when CanSplice() says so. The call waits for data as a read from the
+ * socket would.
+ *
+ * @param socket The socket the body is read from.
+ * @param length The most to move, limited to what the pipe holds.
+ * @return The number of bytes moved, 0 if the socket has been closed.
+ * @throws std::runtime_error if the socket can't be read.
+ */
+size_t ChunkWriter::Splice(int socket, size_t length) {
+    if (!CanSplice()) {
+        throw std::logic_error("The response can't splice this part");
+    }
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    length = std::min(length, pipe_->Capacity());
+
+    ssize_t moved;
+    do {
+        moved = splice(socket, nullptr, pipe_->WriteEnd(), nullptr, length,
+                       SPLICE_F_MOVE);
+    } while (moved == -1 && errno == EINTR);
+
+    if (moved == -1) {
+        throw std::runtime_error(std::string("Unable to splice body: ") +
+                                 strerror(errno));
+    }
+
+    spliced_ = static_cast<size_t>(moved);
+    return spliced_;
+#else
+    (void)socket;
+    (void)length;
+    throw std::logic_error("Splicing is unavailable");
+#endif
+}
+
 Response::Response(core::HttpStatus statusCode,
                    const std::string body,
                    HttpContentType contentType)
          : status_code_(statusCode), header_(Header()), body_(body),
-           content_type_(contentType) {
+           content_type_(contentType), file_descriptor_(-1), file_size_(0),
+           body_omitted_(false), from_upstream_(false) {
+}
+
+/**
+ * @brief Creates a response whose body is the contents of an open file.
+ *
+ * The file is written straight from the page cache to the socket, so its
+ * contents never have to be read into memory. The response takes ownership
+ * of the descriptor.
+ */
+Response::Response(core::HttpStatus statusCode,
+                   int fileDescriptor,
+                   size_t fileSize,
+                   HttpContentType contentType)
+         : status_code_(statusCode), header_(Header()),
+           content_type_(contentType), file_descriptor_(fileDescriptor),
+           file_size_(fileSize), body_omitted_(false),
+           from_upstream_(false) {
+}
+
+/**
+ * @brief Creates a response whose body is produced while it is being sent.
+ *
+ * The source is called for each part of the body in turn once the previous
+ * part has been written, so the body never has to be held in memory as a
+ * whole and the client receives the first part as soon as it is ready.
+ */
+Response::Response(core::HttpStatus statusCode,
+                   ChunkSource source,
+                   HttpContentType contentType)
+         : status_code_(statusCode), header_(Header()),
+           content_type_(contentType), file_descriptor_(-1), file_size_(0),
+           chunk_source_(std::move(source)), body_omitted_(false),
+           from_upstream_(false) {
+}
+
+Response::~Response() {
+    if (file_descriptor_ != -1) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+        _close(file_descriptor_);
+#else
+        close(file_descriptor_);
+#endif
+    }
+}
+
+/**
+ * @brief The value of the response's 'Content-Type' header, which a field
+ *        of that name among the further header fields takes the place of.
+ */
+std::string Response::ContentTypeString() const {
+    const std::string *contentType = header_.Get(HEADER_KEY_CONTENT_TYPE);
+    return contentType ? *contentType : HttpContentTypeString(content_type_);
+}
+
+/**
+ * @brief Runs the chunk source once and takes the chunks it wrote.
+ *
+ * The terminating chunk is added once the source has nothing more to write.
+ * Exceptions thrown by the source are passed on.
+ *
+ * @param frames Set to the framed chunks, ready to be sent.
+ * @param chunked Frame the data as HTTP/1.1 chunks, otherwise it is left
+ *                as written for HTTP/2 to frame. A response whose length
+ *                was given is never framed.
+ * @param spliced Where the connection can take data spliced into a pipe,
+ *                set to what the source spliced after the frames. Null if
+ *                the connection can't.
+ * @return false once the response is complete.
+ */
+bool Response::NextChunks(std::string *frames,
+                          bool chunked,
+                          SplicedData *spliced) {
+    chunked = chunked && !stream_length_;
+
+    // Spliced data has no chunk framing of its own.
+    if (spliced && !chunked && !splice_pipe_) {
+        auto pipe = std::make_shared<core::SplicePipe>();
+        if (pipe->Open()) {
+            splice_pipe_ = std::move(pipe);
+        }
+    }
+
+    ChunkWriter writer(chunked,
+                       spliced && !chunked ? splice_pipe_.get() : nullptr);
+    bool more = chunk_source_(writer);
+
+    if (!more && chunked) {
+        writer.frames_ += "0\r\n\r\n";
+    }
+
+    if (writer.spliced_ != 0) {
+        spliced->pipe = splice_pipe_;
+        spliced->length = writer.spliced_;
+    }
+
+    *frames = std::move(writer.frames_);
+    return more;
 }
 
 }   // namespace webloom
@@ -3,6 +3,10 @@
 //  Released under LGPL 3.0 license (see LICENSE)
 #ifndef RESPONSE_H_
 #define RESPONSE_H_
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
 #include "Header.h"
 #include "HttpContentType.h"
@@ -12,26 +16,136 @@ enum class HttpStatus;
 
 namespace webloom {
 
+namespace core {
+class SplicePipe;
+}   // namespace core
+
+// Part of a streamed body that was spliced into a pipe rather than written,
+// it is spliced on from the pipe into the client's socket.
+struct SplicedData {
+    std::shared_ptr<core::SplicePipe> pipe;
+    size_t length = 0;
+};
+
+/**
+ * @brief Frames the data written by a streamed response as HTTP chunks.
+ *
+ * HTTP/2 frames the data itself, and so does a response whose length was
+ * given up front, the writer then only collects it.
+ */
+class ChunkWriter {
+ public:
+    explicit ChunkWriter(bool chunked = true, core::SplicePipe *pipe = nullptr)
+        : chunked_(chunked), pipe_(pipe), spliced_(0) {}
+
+    void Write(const std::string &data) { Write(data.data(), data.size()); }
+
+    void Write(const char *data, size_t length);
+
+    // Whether the next part may be spliced straight from a socket, which
+    // is only when nothing else has been written for this part.
+    bool CanSplice() const {
+        return pipe_ && frames_.empty() && spliced_ == 0;
+    }
+
+    size_t Splice(int socket, size_t length);
+
+ private:
+    friend class Response;
+
+    bool chunked_;
+    std::string frames_;
+    core::SplicePipe *pipe_;
+    size_t spliced_;
+};
+
+// Writes the next part of a streamed response, returning false once there
+// is nothing more to write. It is called again whenever the previous part
+// has been sent, from a worker thread.
+using ChunkSource = std::function<bool(ChunkWriter &writer)>;
+
 class Response {
  public:
     Response(core::HttpStatus statusCode,
              const std::string body,
              HttpContentType contentType);
 
+    Response(core::HttpStatus statusCode,
+             int fileDescriptor,
+             size_t fileSize,
+             HttpContentType contentType);
+
+    Response(core::HttpStatus statusCode,
+             ChunkSource source,
+             HttpContentType contentType);
+
+    ~Response();
+
+    Response(const Response &) = delete;
+    Response &operator=(const Response &) = delete;
+
     core::HttpStatus StatusCode() const { return status_code_; }
 
-    const Header &ResponseHeader() { return header_; }
+    // Further header fields to send, a 'Content-Type' field taking the
+    // place of the content type.
+    const Header &ResponseHeader() const { return header_; }
     void ResponseHeader(const Header& header ) { header_ = header; }
 
     const std::string &Body() { return body_; }
 
+    // Open file whose contents are the body, -1 when the body is held in
+    // memory. The file is closed along with the response.
+    int FileDescriptor() const { return file_descriptor_; }
+
+    size_t BodyLength() const {
+        return file_descriptor_ == -1 ? body_.size() : file_size_;
+    }
+
+    // The body is produced piece by piece and sent with chunked transfer
+    // encoding rather than with a length, unless its length is given.
+    bool Streamed() const { return static_cast<bool>(chunk_source_); }
+
+    // Length of a streamed body known up front, sent as its Content-Length
+    // so that the body is sent as written rather than as chunks.
+    void StreamLength(size_t length) { stream_length_ = length; }
+    std::optional<size_t> StreamLength() const { return stream_length_; }
+
+    // The response has no body, as one to HEAD, 204 No Content or 304 Not
+    // Modified, and announces the length its body would have had, if any,
+    // rather than 0.
+    void OmitBody(std::optional<size_t> length) {
+        body_omitted_ = true;
+        stream_length_ = length;
+    }
+    bool BodyOmitted() const { return body_omitted_; }
+
+    // The body is read from an upstream server, so producing it may wait on
+    // that server for as long as the proxy timeout.
+    void FromUpstream(bool fromUpstream) { from_upstream_ = fromUpstream; }
+    bool FromUpstream() const { return from_upstream_; }
+
+    bool NextChunks(std::string *frames,
+                    bool chunked = true,
+                    SplicedData *spliced = nullptr);
+
     HttpContentType ContentType() const { return content_type_; }
 
+    std::string ContentTypeString() const;
+
  private:
     core::HttpStatus status_code_;
     Header header_;
     std::string body_;
     HttpContentType content_type_;
+    int file_descriptor_;
+    size_t file_size_;
+    ChunkSource chunk_source_;
+    std::optional<size_t> stream_length_;
+    bool body_omitted_;
+    bool from_upstream_;
+
+    // Pipe the source splices parts of the body into, opened on first use.
+    std::shared_ptr<core::SplicePipe> splice_pipe_;
 };
 
 }   // namespace webloom
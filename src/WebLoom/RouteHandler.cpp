@@ -3,6 +3,7 @@
 //  Released under LGPL 3.0 license (see LICENSE)
 #include <algorithm>
 #include <stdexcept>
+#include <utility>
 #include "RouteHandler.h"
 
 namespace webloom {
@@ -77,4 +78,118 @@ bool RouteHandler::IsValidRoute(const std::string& route,
     return false;
 }
 
+/**
+ * @brief Adds a route that clients open WebSocket connections on.
+ *
+ * A GET request for the route asking to upgrade to WebSocket is answered by
+ * the server, the handlers then serving the connection. Routes are expected
+ * to be added before the server starts, the handlers being used in place.
+ *
+ * @param route The route path as a string (e.g., "/events").
+ * @param handlers The functions serving connections opened on the route.
+ */
+void RouteHandler::AddWebSocketRoute(const std::string& route,
+                                     WebSocketHandlers handlers) {
+    websocket_routes_.emplace(route, std::move(handlers));
+}
+
+/**
+ * @brief Finds the handlers of a WebSocket route.
+ *
+ * @return The handlers, or nullptr if the route is not a WebSocket route.
+ */
+const WebSocketHandlers *RouteHandler::FindWebSocketRoute(
+    const std::string& route) {
+    auto it = websocket_routes_.find(route);
+    return it == websocket_routes_.end() ? nullptr : &it->second;
+}
+
+/**
+ * @brief Adds a route that streams server-sent events.
+ *
+ * A GET request for the route is passed to the handler, which picks the
+ * broadcaster the client subscribes to. The connection is then held open
+ * and sent the broadcaster's events as "text/event-stream" until the client
+ * goes away.
+ *
+ * @param route The route path as a string (e.g., "/updates").
+ * @param handler The function choosing the broadcaster for a request.
+ */
+void RouteHandler::AddEventStreamRoute(const std::string& route,
+                                       EventStreamFunction handler) {
+    event_stream_routes_.emplace(route, std::move(handler));
+}
+
+/**
+ * @brief Adds a route subscribing every client to the same broadcaster.
+ */
+void RouteHandler::AddEventStreamRoute(const std::string& route,
+                                       EventBroadcaster *broadcaster) {
+    AddEventStreamRoute(route, [broadcaster](Request *) {
+        return broadcaster;
+    });
+}
+
+/**
+ * @brief Finds the handler of an event stream route.
+ *
+ * @return The handler, or nullptr if the route is not an event stream route.
+ */
+const EventStreamFunction *RouteHandler::FindEventStreamRoute(
+    const std::string& route) {
+    auto it = event_stream_routes_.find(route);
+    return it == event_stream_routes_.end() ? nullptr : &it->second;
+}
+
+/**
+ * @brief Adds a route forwarding every request under a path prefix to an
+ *        upstream server.
+ *
+ * Requests are sent with their path unchanged over keep-alive connections
+ * pooled for the server, and its answers passed back to the client. Proxy
+ * routes take precedence over other routes and the static website.
+ *
+ * @param prefix The path prefix as a string (e.g., "/api/").
+ * @param host Name or address of the upstream server.
+ * @param port Port the upstream server listens on.
+ */
+void RouteHandler::AddProxyRoute(const std::string& prefix,
+                                 const std::string& host,
+                                 unsigned int port) {
+    proxy_routes_.push_back(
+        { prefix, std::make_unique<core::UpstreamPool>(host, port) });
+}
+
+/**
+ * @brief Finds the upstream server a path is forwarded to, going by the
+ *        longest matching prefix.
+ *
+ * A prefix only matches whole path segments, so "/api" takes "/api" and
+ * "/api/users" but not "/apiother".
+ *
+ * @return The server's connection pool, or nullptr if no proxy route
+ *         matches the path.
+ */
+core::UpstreamPool *RouteHandler::FindProxyRoute(const std::string& path) {
+    const ProxyRoute *found = nullptr;
+
+    for (const auto &route : proxy_routes_) {
+        const std::string &prefix = route.prefix;
+        if (path.compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+
+        bool segmentEnds = path.size() == prefix.size() ||
+                           (!prefix.empty() && prefix.back() == '/') ||
+                           path[prefix.size()] == '/' ||
+                           path[prefix.size()] == '?';
+        if (segmentEnds &&
+            (!found || prefix.size() > found->prefix.size())) {
+            found = &route;
+        }
+    }
+
+    return found ? found->pool.get() : nullptr;
+}
+
 }   // namespace webloom
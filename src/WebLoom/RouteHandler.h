@@ -4,13 +4,17 @@
 #ifndef ROUTEHANDLER_H_
 #define ROUTEHANDLER_H_
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include "EventStream.h"
 #include "Request.h"
 #include "RequestMethod.h"
 #include "Response.h"
+#include "WebSocket.h"
+#include "core/UpstreamPool.h"
 
 namespace webloom {
 
@@ -22,6 +26,13 @@ struct RouteEntry {
     RouteHandlerFunction handler;
 };
 
+// Requests for paths under the prefix are forwarded to the upstream server
+// the pool connects to.
+struct ProxyRoute {
+    std::string prefix;
+    std::unique_ptr<core::UpstreamPool> pool;
+};
+
 class RouteHandler {
  public:
     static RouteHandler& Instance() {
@@ -39,8 +50,30 @@ class RouteHandler {
 
     bool IsValidRoute(const std::string& route, RequestMethod method);
 
+    void AddWebSocketRoute(const std::string& route,
+                           WebSocketHandlers handlers);
+
+    const WebSocketHandlers *FindWebSocketRoute(const std::string& route);
+
+    void AddEventStreamRoute(const std::string& route,
+                             EventStreamFunction handler);
+
+    void AddEventStreamRoute(const std::string& route,
+                             EventBroadcaster *broadcaster);
+
+    const EventStreamFunction *FindEventStreamRoute(const std::string& route);
+
+    void AddProxyRoute(const std::string& prefix,
+                       const std::string& host,
+                       unsigned int port);
+
+    core::UpstreamPool *FindProxyRoute(const std::string& path);
+
  private:
     std::unordered_map<std::string, RouteEntry> routes_;
+    std::unordered_map<std::string, WebSocketHandlers> websocket_routes_;
+    std::unordered_map<std::string, EventStreamFunction> event_stream_routes_;
+    std::vector<ProxyRoute> proxy_routes_;
     RouteHandler() = default;   // Private constructor for singleton pattern
 };
 
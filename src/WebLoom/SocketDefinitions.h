@@ -7,6 +7,7 @@
 
 #if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
 # include <winsock2.h>
+# include <ws2tcpip.h>       // For inet_pton() and sockaddr_in6
 
 typedef int socklen_t;
 
@@ -15,6 +16,10 @@ typedef int socklen_t;
 # include <arpa/inet.h>      // For inet_pton()
 # include <sys/socket.h>     // For socket functions
 # include <netinet/in.h>     // For sockaddr_in
+# include <netinet/tcp.h>    // For TCP socket options
+# include <sys/un.h>         // For sockaddr_un
+# include <fcntl.h>          // For fcntl()
+# include <poll.h>           // For poll()
 
 # define SOCKET int
 
@@ -5,6 +5,7 @@
 #define WEBLOOMEXCEPTIONS_H_
 #include <stdexcept>
 #include <string>
+#include "core/HttpStatus.h"
 
 namespace webloom {
 
@@ -33,6 +34,20 @@ class TemplateRenderFailed : public WebLoomBaseException {
         : WebLoomBaseException(message) {}
 };
 
+// Raised whilst reading a request that cannot be served, e.g. one that
+// exceeds the configured size limits. Carries the status the client is to
+// be answered with.
+class RequestRejected : public WebLoomBaseException {
+ public:
+    RequestRejected(core::HttpStatus status, const std::string& message)
+        : WebLoomBaseException(message), status_(status) {}
+
+    core::HttpStatus Status() const { return status_; }
+
+ private:
+    core::HttpStatus status_;
+};
+
 }   // namespace webloom
 
 #endif  // WEBLOOMEXCEPTIONS_H_
@@ -3,23 +3,122 @@
 //  Released under LGPL 3.0 license (see LICENSE)
 #ifndef WEBLOOMSETTINGS_H_
 #define WEBLOOMSETTINGS_H_
+#include <cstddef>
 #include <string>
+#include <vector>
+#include "core/Platform.h"
 
 namespace webloom {
 
 using NetworkPort = unsigned int;
 
+/**
+ * @brief Selects the connection handling model used by the server.
+ */
+enum class ServerEngine {
+    // Blocking accept loop, each connection is handled by a worker thread
+    // that blocks in recv()/send() for the lifetime of the connection.
+    Threaded,
+
+    // Non-blocking, edge-triggered epoll reactor that multiplexes all of the
+    // connections on one thread and only hands complete requests to the
+    // worker threads (Linux only).
+    Epoll,
+
+    // Completion based io_uring reactor, the same request handling as the
+    // epoll engine with accept, receive and send batched through one ring.
+    // Falls back to the epoll engine when the kernel lacks support (Linux
+    // only).
+    IoUring
+};
+
 const char DEFAULT_STATIC_WEBSITE_DIR[] = "./static_websites";
 const char DEFAULT_TEMPLATE_DIR[] = "./templates";
 const NetworkPort DEFAULT_NETWORK_PORT = 8080;
 const char DEFAULT_LIBMAGIC_DB[] = "";
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+const ServerEngine DEFAULT_SERVER_ENGINE = ServerEngine::Epoll;
+#else
+const ServerEngine DEFAULT_SERVER_ENGINE = ServerEngine::Threaded;
+#endif
+const unsigned int DEFAULT_KEEP_ALIVE_MAX_REQUESTS = 100;
+const unsigned int DEFAULT_KEEP_ALIVE_TIMEOUT = 5;
+const unsigned int DEFAULT_LISTENER_COUNT = 1;
+const unsigned int DEFAULT_WORKER_PROCESSES = 0;
+const char DEFAULT_REACTOR_CPUS[] = "";
+const char DEFAULT_WORKER_CPUS[] = "";
+const unsigned int DEFAULT_BUSY_POLL_BUDGET = 0;
+const int DEFAULT_LISTEN_BACKLOG = 1024;
+const unsigned int DEFAULT_DEFER_ACCEPT_TIMEOUT = 0;
+const unsigned int DEFAULT_FAST_OPEN_QUEUE_LENGTH = 0;
+const size_t DEFAULT_MAX_REQUEST_HEADER_SIZE = 16 * 1024;
+const size_t DEFAULT_MAX_REQUEST_BODY_SIZE = 1024 * 1024;
+const size_t DEFAULT_MAX_CONNECTION_OUTPUT = 1024 * 1024;
+const size_t DEFAULT_MAX_BUFFERED_OUTPUT = 64 * 1024 * 1024;
+const size_t DEFAULT_MEMORY_BUDGET = 0;
+const unsigned int DEFAULT_HEADER_TIMEOUT = 10;
+const unsigned int DEFAULT_BODY_TIMEOUT = 30;
+const unsigned int DEFAULT_WRITE_TIMEOUT = 30;
+const unsigned int DEFAULT_MAX_CONNECTIONS = 10000;
+const unsigned int DEFAULT_DRAIN_TIMEOUT = 10;
+const bool DEFAULT_HTTP2_ENABLED = true;
+const unsigned int DEFAULT_MAX_CONCURRENT_STREAMS = 100;
+const char DEFAULT_TLS_CERTIFICATE_FILE[] = "";
+const char DEFAULT_TLS_PRIVATE_KEY_FILE[] = "";
+const unsigned int DEFAULT_TLS_SESSION_CACHE_SIZE = 20480;
+const unsigned int DEFAULT_TLS_SESSION_LIFETIME = 300;
+const bool DEFAULT_TLS_KERNEL_OFFLOAD = true;
+const size_t DEFAULT_MAX_WEBSOCKET_MESSAGE_SIZE = 1024 * 1024;
+const unsigned int DEFAULT_WEBSOCKET_IDLE_TIMEOUT = 300;
+const unsigned int DEFAULT_PROXY_TIMEOUT = 30;
+const size_t DEFAULT_PROXY_MAX_IDLE_CONNECTIONS = 32;
 
 class WebLoomSettings {
  public:
     WebLoomSettings() : static_website_dir_(DEFAULT_STATIC_WEBSITE_DIR),
                         templates_dir_(DEFAULT_TEMPLATE_DIR),
                         network_port_(DEFAULT_NETWORK_PORT),
-                        libmagic_db_(DEFAULT_LIBMAGIC_DB) {
+                        libmagic_db_(DEFAULT_LIBMAGIC_DB),
+                        server_engine_(DEFAULT_SERVER_ENGINE),
+                        keep_alive_max_requests_(
+                            DEFAULT_KEEP_ALIVE_MAX_REQUESTS),
+                        keep_alive_timeout_(DEFAULT_KEEP_ALIVE_TIMEOUT),
+                        listener_count_(DEFAULT_LISTENER_COUNT),
+                        worker_processes_(DEFAULT_WORKER_PROCESSES),
+                        reactor_cpus_(DEFAULT_REACTOR_CPUS),
+                        worker_cpus_(DEFAULT_WORKER_CPUS),
+                        busy_poll_budget_(DEFAULT_BUSY_POLL_BUDGET),
+                        listen_backlog_(DEFAULT_LISTEN_BACKLOG),
+                        defer_accept_timeout_(DEFAULT_DEFER_ACCEPT_TIMEOUT),
+                        fast_open_queue_length_(
+                            DEFAULT_FAST_OPEN_QUEUE_LENGTH),
+                        max_request_header_size_(
+                            DEFAULT_MAX_REQUEST_HEADER_SIZE),
+                        max_request_body_size_(DEFAULT_MAX_REQUEST_BODY_SIZE),
+                        max_connection_output_(DEFAULT_MAX_CONNECTION_OUTPUT),
+                        max_buffered_output_(DEFAULT_MAX_BUFFERED_OUTPUT),
+                        memory_budget_(DEFAULT_MEMORY_BUDGET),
+                        header_timeout_(DEFAULT_HEADER_TIMEOUT),
+                        body_timeout_(DEFAULT_BODY_TIMEOUT),
+                        write_timeout_(DEFAULT_WRITE_TIMEOUT),
+                        max_connections_(DEFAULT_MAX_CONNECTIONS),
+                        drain_timeout_(DEFAULT_DRAIN_TIMEOUT),
+                        http2_enabled_(DEFAULT_HTTP2_ENABLED),
+                        max_concurrent_streams_(
+                            DEFAULT_MAX_CONCURRENT_STREAMS),
+                        tls_certificate_file_(DEFAULT_TLS_CERTIFICATE_FILE),
+                        tls_private_key_file_(DEFAULT_TLS_PRIVATE_KEY_FILE),
+                        tls_session_cache_size_(
+                            DEFAULT_TLS_SESSION_CACHE_SIZE),
+                        tls_session_lifetime_(DEFAULT_TLS_SESSION_LIFETIME),
+                        tls_kernel_offload_(DEFAULT_TLS_KERNEL_OFFLOAD),
+                        max_websocket_message_size_(
+                            DEFAULT_MAX_WEBSOCKET_MESSAGE_SIZE),
+                        websocket_idle_timeout_(
+                            DEFAULT_WEBSOCKET_IDLE_TIMEOUT),
+                        proxy_timeout_(DEFAULT_PROXY_TIMEOUT),
+                        proxy_max_idle_connections_(
+                            DEFAULT_PROXY_MAX_IDLE_CONNECTIONS) {
     }
 
     std::string StaticWebsiteDir() { return static_website_dir_; }
@@ -31,14 +130,270 @@ class WebLoomSettings {
     NetworkPort ServerNetworkPort() { return network_port_;}
     void ServerNetworkPort(NetworkPort port) { network_port_ = port;}
 
+    // Addresses the server listens on, every one served by the same accept
+    // loop and workers. Each is an IPv4 address and port
+    // ("127.0.0.1:8080", "*:8080"), an IPv6 address and port ("[::1]:8080")
+    // or a Unix domain socket ("unix:/run/webloom.sock", Linux only). When
+    // empty the server listens on every IPv4 address on ServerNetworkPort.
+    std::vector<std::string> ListenEndpoints() { return listen_endpoints_; }
+    void ListenEndpoints(const std::vector<std::string> &endpoints) {
+        listen_endpoints_ = endpoints;
+    }
+
     std::string LibmagicDB () { return libmagic_db_; }
     void LibmagicDB(const std::string &db) { libmagic_db_ = db; }
 
+    ServerEngine Engine() { return server_engine_; }
+    void Engine(ServerEngine engine) { server_engine_ = engine; }
+
+    // Maximum number of requests served over one persistent connection, a
+    // value of 1 disables keep-alive.
+    unsigned int KeepAliveMaxRequests() { return keep_alive_max_requests_; }
+    void KeepAliveMaxRequests(unsigned int requests) {
+        keep_alive_max_requests_ = requests;
+    }
+
+    // Seconds a persistent connection may sit idle waiting for the next
+    // request before it is closed.
+    unsigned int KeepAliveTimeout() { return keep_alive_timeout_; }
+    void KeepAliveTimeout(unsigned int seconds) {
+        keep_alive_timeout_ = seconds;
+    }
+
+    // Number of independent listeners bound to the server port with
+    // SO_REUSEPORT, each with its own accept loop, workers and file server.
+    // Typically set to the number of cores (Linux only).
+    unsigned int ListenerCount() { return listener_count_; }
+    void ListenerCount(unsigned int count) { listener_count_ = count; }
+
+    // Number of worker processes forked by a supervising process, which
+    // binds the listening sockets once and restarts any worker that exits,
+    // so that a crashing handler only takes down its own worker. Each worker
+    // runs the configured engine with a single listener. 0 serves from the
+    // calling process (Linux only).
+    unsigned int WorkerProcesses() { return worker_processes_; }
+    void WorkerProcesses(unsigned int count) { worker_processes_ = count; }
+
+    // CPUs the accept loop or reactor of the server is pinned to, as a list
+    // of CPUs and ranges ("0-3,8") in which "nodeN" stands for the CPUs of
+    // NUMA node N. With several listeners or worker processes each one is
+    // pinned to the next CPU of the list in turn. The reactor's buffers are
+    // then allocated on its own node. Empty leaves the scheduler to place
+    // it (Linux only).
+    std::string ReactorCpus() { return reactor_cpus_; }
+    void ReactorCpus(const std::string &cpus) { reactor_cpus_ = cpus; }
+
+    // CPUs the worker threads running the route handlers are pinned to, in
+    // the same form as ReactorCpus. Each worker may run on any CPU of the
+    // list (Linux only).
+    std::string WorkerCpus() { return worker_cpus_; }
+    void WorkerCpus(const std::string &cpus) { worker_cpus_ = cpus; }
+
+    // Microseconds the reactor keeps polling its sockets without sleeping
+    // once it has run out of events, before it blocks waiting for more.
+    // Client sockets also get SO_BUSY_POLL and SO_PREFER_BUSY_POLL so that
+    // the kernel polls the device rather than waiting for an interrupt. This
+    // trades a core per reactor, best pinned with ReactorCpus, for lower
+    // latency. 0 disables busy polling (epoll and io_uring engines).
+    unsigned int BusyPollBudget() { return busy_poll_budget_; }
+    void BusyPollBudget(unsigned int microseconds) {
+        busy_poll_budget_ = microseconds;
+    }
+
+    // Length of the queue of connections waiting to be accepted, the kernel
+    // caps it (net.core.somaxconn on Linux).
+    int ListenBacklog() { return listen_backlog_; }
+    void ListenBacklog(int backlog) { listen_backlog_ = backlog; }
+
+    // Seconds the kernel holds a new connection back until its first data
+    // arrives (TCP_DEFER_ACCEPT), 0 disables it (Linux only).
+    unsigned int DeferAcceptTimeout() { return defer_accept_timeout_; }
+    void DeferAcceptTimeout(unsigned int seconds) {
+        defer_accept_timeout_ = seconds;
+    }
+
+    // Maximum number of pending TCP Fast Open requests (TCP_FASTOPEN), 0
+    // disables it (Linux only).
+    unsigned int FastOpenQueueLength() { return fast_open_queue_length_; }
+    void FastOpenQueueLength(unsigned int length) {
+        fast_open_queue_length_ = length;
+    }
+
+    // Largest request line plus headers accepted, larger requests are
+    // answered with 431 Request Header Fields Too Large.
+    size_t MaxRequestHeaderSize() { return max_request_header_size_; }
+    void MaxRequestHeaderSize(size_t size) { max_request_header_size_ = size; }
+
+    // Largest request body accepted, larger bodies are answered with 413
+    // Payload Too Large before they are read.
+    size_t MaxRequestBodySize() { return max_request_body_size_; }
+    void MaxRequestBodySize(size_t size) { max_request_body_size_ = size; }
+
+    // Response bytes held in memory for one connection beyond which no more
+    // of its requests are handled until the client has read them (epoll and
+    // io_uring engines).
+    size_t MaxConnectionOutput() { return max_connection_output_; }
+    void MaxConnectionOutput(size_t size) { max_connection_output_ = size; }
+
+    // Response bytes held in memory across every connection of a server
+    // beyond which no new requests are handled until clients have read them
+    // (epoll and io_uring engines).
+    size_t MaxBufferedOutput() { return max_buffered_output_; }
+    void MaxBufferedOutput(size_t size) { max_buffered_output_ = size; }
+
+    // Bytes of connection buffers, queued output and request bodies the
+    // process may hold, 0 for no limit. The TLS session cache is not
+    // counted, it is bounded by its number of entries. Once reached new connections are turned away with 503
+    // Service Unavailable, and the epoll and io_uring engines stop reading
+    // and handling requests until enough has been released. Each worker
+    // process has a budget of its own.
+    size_t MemoryBudget() { return memory_budget_; }
+    void MemoryBudget(size_t size) { memory_budget_ = size; }
+
+    // Seconds a client has to send the request line and headers, from the
+    // first byte of the request (or from connecting), before the request
+    // is answered with 408 Request Timeout.
+    unsigned int HeaderTimeout() { return header_timeout_; }
+    void HeaderTimeout(unsigned int seconds) { header_timeout_ = seconds; }
+
+    // Seconds a client has to send the request body once the headers have
+    // arrived.
+    unsigned int BodyTimeout() { return body_timeout_; }
+    void BodyTimeout(unsigned int seconds) { body_timeout_ = seconds; }
+
+    // Seconds a response may wait for the client to read more of it before
+    // the connection is dropped.
+    unsigned int WriteTimeout() { return write_timeout_; }
+    void WriteTimeout(unsigned int seconds) { write_timeout_ = seconds; }
+
+    // Maximum number of open connections for each listener, connections
+    // beyond it are answered with 503 Service Unavailable and closed. 0
+    // removes the limit.
+    unsigned int MaxConnections() { return max_connections_; }
+    void MaxConnections(unsigned int count) { max_connections_ = count; }
+
+    // Seconds a shutdown waits for the requests already in progress to be
+    // answered before the remaining connections are closed.
+    unsigned int DrainTimeout() { return drain_timeout_; }
+    void DrainTimeout(unsigned int seconds) { drain_timeout_ = seconds; }
+
+    // Accept HTTP/2 over cleartext TCP (h2c), from clients that start with
+    // the connection preface or upgrade an HTTP/1.1 request (epoll and
+    // io_uring engines).
+    bool Http2Enabled() { return http2_enabled_; }
+    void Http2Enabled(bool enabled) { http2_enabled_ = enabled; }
+
+    // Maximum number of HTTP/2 streams a client may have open on one
+    // connection, further streams are refused.
+    unsigned int MaxConcurrentStreams() { return max_concurrent_streams_; }
+    void MaxConcurrentStreams(unsigned int count) {
+        max_concurrent_streams_ = count;
+    }
+
+    // PEM file holding the server certificate followed by any intermediate
+    // certificates. Every connection is served over TLS when it is set,
+    // which needs the library to have been built with OpenSSL (epoll and
+    // threaded engines, io_uring falls back to epoll).
+    std::string TlsCertificateFile() { return tls_certificate_file_; }
+    void TlsCertificateFile(const std::string &file) {
+        tls_certificate_file_ = file;
+    }
+
+    // PEM file holding the private key of the server certificate.
+    std::string TlsPrivateKeyFile() { return tls_private_key_file_; }
+    void TlsPrivateKeyFile(const std::string &file) {
+        tls_private_key_file_ = file;
+    }
+
+    // Maximum number of TLS sessions kept for clients to resume by session
+    // ID, 0 disables the cache. Session tickets need no cache.
+    unsigned int TlsSessionCacheSize() { return tls_session_cache_size_; }
+    void TlsSessionCacheSize(unsigned int sessions) {
+        tls_session_cache_size_ = sessions;
+    }
+
+    // Seconds a client may resume its TLS session for, by session ID or
+    // ticket.
+    unsigned int TlsSessionLifetime() { return tls_session_lifetime_; }
+    void TlsSessionLifetime(unsigned int seconds) {
+        tls_session_lifetime_ = seconds;
+    }
+
+    // Let the kernel encrypt responses once the handshake is done (kTLS),
+    // so that bodies are still sent without being copied. Connections whose
+    // cipher the kernel can't handle are encrypted by OpenSSL (Linux only).
+    bool TlsKernelOffload() { return tls_kernel_offload_; }
+    void TlsKernelOffload(bool enabled) { tls_kernel_offload_ = enabled; }
+
+    // Largest WebSocket message a client may send, counting every fragment.
+    // A larger message closes the connection with status 1009.
+    size_t MaxWebSocketMessageSize() { return max_websocket_message_size_; }
+    void MaxWebSocketMessageSize(size_t size) {
+        max_websocket_message_size_ = size;
+    }
+
+    // Seconds a WebSocket connection may go with nothing sent either way
+    // before it is closed, 0 leaves idle connections open. Clients that have
+    // nothing to say keep the connection with pings.
+    unsigned int WebSocketIdleTimeout() { return websocket_idle_timeout_; }
+    void WebSocketIdleTimeout(unsigned int seconds) {
+        websocket_idle_timeout_ = seconds;
+    }
+
+    // Seconds a proxied request may wait on the upstream server, for the
+    // connection and for each read and write. A request the server doesn't
+    // answer in time is answered with 504 Gateway Timeout. The epoll and
+    // io_uring engines wait on upstream servers from 8 workers of their
+    // own, further proxied requests queue for them without holding up
+    // other routes. The threaded engine waits on the connection's thread.
+    unsigned int ProxyTimeout() { return proxy_timeout_; }
+    void ProxyTimeout(unsigned int seconds) { proxy_timeout_ = seconds; }
+
+    // Most idle keep-alive connections kept open to each upstream server of
+    // a proxy route, any more are closed once their response is done.
+    size_t ProxyMaxIdleConnections() { return proxy_max_idle_connections_; }
+    void ProxyMaxIdleConnections(size_t connections) {
+        proxy_max_idle_connections_ = connections;
+    }
+
  private:
     std::string static_website_dir_;
     std::string templates_dir_;
     NetworkPort network_port_;
+    std::vector<std::string> listen_endpoints_;
     std::string libmagic_db_;
+    ServerEngine server_engine_;
+    unsigned int keep_alive_max_requests_;
+    unsigned int keep_alive_timeout_;
+    unsigned int listener_count_;
+    unsigned int worker_processes_;
+    std::string reactor_cpus_;
+    std::string worker_cpus_;
+    unsigned int busy_poll_budget_;
+    int listen_backlog_;
+    unsigned int defer_accept_timeout_;
+    unsigned int fast_open_queue_length_;
+    size_t max_request_header_size_;
+    size_t max_request_body_size_;
+    size_t max_connection_output_;
+    size_t max_buffered_output_;
+    size_t memory_budget_;
+    unsigned int header_timeout_;
+    unsigned int body_timeout_;
+    unsigned int write_timeout_;
+    unsigned int max_connections_;
+    unsigned int drain_timeout_;
+    bool http2_enabled_;
+    unsigned int max_concurrent_streams_;
+    std::string tls_certificate_file_;
+    std::string tls_private_key_file_;
+    unsigned int tls_session_cache_size_;
+    unsigned int tls_session_lifetime_;
+    bool tls_kernel_offload_;
+    size_t max_websocket_message_size_;
+    unsigned int websocket_idle_timeout_;
+    unsigned int proxy_timeout_;
+    size_t proxy_max_idle_connections_;
 };
 
 }   // namespace webloom
@@ -0,0 +1,170 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <string>
+#include <utility>
+#include "WebSocket.h"
+
+namespace webloom {
+
+using core::WebSocketCodec;
+
+/**
+ * @param path The path of the route the connection was opened on.
+ * @param handlers The functions serving the route.
+ */
+WebSocket::WebSocket(std::string path, const WebSocketHandlers *handlers)
+    : path_(std::move(path)), handlers_(handlers), close_pending_(false),
+      closed_(false), handling_(true), close_deferred_(false),
+      close_code_(WEBSOCKET_CLOSE_ABNORMAL) {
+}
+
+/**
+ * @brief Sends a text message, which must be UTF-8.
+ *
+ * @return false if the connection has closed, nothing is sent then.
+ */
+bool WebSocket::SendText(std::string_view text) {
+    return Send(WebSocketCodec::Opcode::Text, text);
+}
+
+/**
+ * @brief Sends a binary message.
+ *
+ * @return false if the connection has closed, nothing is sent then.
+ */
+bool WebSocket::SendBinary(std::string_view data) {
+    return Send(WebSocketCodec::Opcode::Binary, data);
+}
+
+/**
+ * @brief Closes the connection with a status code, once everything sent
+ *        before has been written.
+ */
+void WebSocket::Close(uint16_t code) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    std::string frames;
+    WebSocketCodec::EncodeClose(code, &frames);
+
+    if (sink_) {
+        sink_(std::move(frames), true);
+    } else {
+        pending_ += frames;
+        close_pending_ = true;
+    }
+}
+
+bool WebSocket::IsOpen() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !closed_;
+}
+
+bool WebSocket::Send(WebSocketCodec::Opcode opcode,
+                     std::string_view payload) {
+    std::string frames;
+    WebSocketCodec::EncodeFrame(opcode, payload, &frames);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (closed_) {
+        return false;
+    }
+
+    if (sink_) {
+        sink_(std::move(frames), false);
+    } else {
+        pending_ += frames;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Connects the WebSocket to its connection once the handshake has
+ *        been answered, handing over whatever was sent before then.
+ */
+void WebSocket::Attach(FrameSink sink) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!pending_.empty()) {
+        sink(std::move(pending_), close_pending_);
+        pending_.clear();
+    }
+
+    // Nothing more is sent once a close frame has been.
+    if (!close_pending_) {
+        sink_ = std::move(sink);
+    }
+}
+
+/**
+ * @brief Disconnects the WebSocket from its connection, which has gone.
+ *
+ * @param code The status the client closed the connection with.
+ * @return true if onClose should be called now, otherwise a handler is
+ *         still running and FinishHandling() reports it once done.
+ */
+bool WebSocket::Detach(uint16_t code) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sink_ = nullptr;
+    pending_.clear();
+    closed_ = true;
+    close_code_ = code;
+
+    if (handling_) {
+        close_deferred_ = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Stops the handlers sending anything more, the server closing the
+ *        connection itself.
+ *
+ * @return false if a close frame has already been sent.
+ */
+bool WebSocket::StopSending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (closed_) {
+        return false;
+    }
+
+    closed_ = true;
+    sink_ = nullptr;
+    return true;
+}
+
+void WebSocket::StartHandling() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    handling_ = true;
+}
+
+/**
+ * @brief Marks the running handler as done.
+ *
+ * @param code Set to the close status if the connection went whilst the
+ *             handler ran.
+ * @return true if onClose should be called now.
+ */
+bool WebSocket::FinishHandling(uint16_t *code) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    handling_ = false;
+    *code = close_code_;
+
+    bool deferred = close_deferred_;
+    close_deferred_ = false;
+    return deferred;
+}
+
+}   // namespace webloom
@@ -0,0 +1,123 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef WEBSOCKET_H_
+#define WEBSOCKET_H_
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>                // NOLINT(build/c++11)
+#include <string>
+#include <string_view>
+#include "Request.h"
+#include "core/WebSocketCodec.h"
+
+namespace webloom {
+
+namespace core {
+class AsyncServerBase;
+}   // namespace core
+
+class WebSocket;
+
+// Status codes a WebSocket connection is closed with (RFC 6455 section 7.4).
+const uint16_t WEBSOCKET_CLOSE_NORMAL = 1000;
+const uint16_t WEBSOCKET_CLOSE_GOING_AWAY = 1001;
+const uint16_t WEBSOCKET_CLOSE_ABNORMAL = 1006;
+const uint16_t WEBSOCKET_CLOSE_INTERNAL_ERROR = 1011;
+
+struct WebSocketMessage {
+    bool binary;
+    std::string data;
+};
+
+using WebSocketPtr = std::shared_ptr<WebSocket>;
+
+// Called with the upgrade request, returning false refuses the connection
+// with 403 Forbidden.
+using WebSocketOpenFunction = std::function<bool(WebSocketPtr, Request *)>;
+using WebSocketMessageFunction =
+    std::function<void(WebSocketPtr, const WebSocketMessage &)>;
+// Called once the connection has gone, with the status the client closed it
+// with or 1006 if it went without one.
+using WebSocketCloseFunction = std::function<void(WebSocketPtr, uint16_t)>;
+
+/**
+ * @brief The functions serving a WebSocket route, any of which may be left
+ *        empty.
+ *
+ * They are called from the worker threads, one at a time for a connection
+ * and with its messages in the order they arrived.
+ */
+struct WebSocketHandlers {
+    WebSocketOpenFunction onOpen;
+    WebSocketMessageFunction onMessage;
+    WebSocketCloseFunction onClose;
+};
+
+/**
+ * @brief The server's end of a WebSocket connection.
+ *
+ * Handlers may keep hold of it and send messages from any thread for as long
+ * as the connection stays open, which is what makes it a push channel.
+ * Messages sent before the handshake has been answered follow the answer.
+ */
+class WebSocket {
+ public:
+    WebSocket(std::string path, const WebSocketHandlers *handlers);
+
+    WebSocket(const WebSocket &) = delete;
+    WebSocket &operator=(const WebSocket &) = delete;
+
+    const std::string &Path() const { return path_; }
+
+    bool SendText(std::string_view text);
+
+    bool SendBinary(std::string_view data);
+
+    void Close(uint16_t code = WEBSOCKET_CLOSE_NORMAL);
+
+    bool IsOpen();
+
+ private:
+    friend class core::AsyncServerBase;
+
+    // Hands frames to the connection, the last of them being a close frame
+    // when close is set.
+    using FrameSink = std::function<void(std::string frames, bool close)>;
+
+    std::string path_;
+    const WebSocketHandlers *handlers_;
+
+    std::mutex mutex_;
+    FrameSink sink_;
+
+    // Frames sent before the connection was attached.
+    std::string pending_;
+    bool close_pending_;
+
+    // A close frame has been sent, or the connection has gone.
+    bool closed_;
+
+    // A handler is running for the connection, onClose waits for it.
+    bool handling_;
+    bool close_deferred_;
+    uint16_t close_code_;
+
+    bool Send(core::WebSocketCodec::Opcode opcode,
+              std::string_view payload);
+
+    void Attach(FrameSink sink);
+
+    bool Detach(uint16_t code);
+
+    bool StopSending();
+
+    void StartHandling();
+
+    bool FinishHandling(uint16_t *code);
+};
+
+}   // namespace webloom
+
+#endif  // WEBSOCKET_H_
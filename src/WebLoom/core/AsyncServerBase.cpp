@@ -0,0 +1,1603 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "AsyncServerBase.h"
+#include "core/HttpStatus.h"
+#include "core/ThreadPool.h"
+#include "HttpContentType.h"
+#include "Response.h"
+#include "RouteHandler.h"
+#include "WebLoomExceptions.h"
+
+namespace webloom::core {
+
+// Maximum number of pipelined requests from one connection that may be with
+// the workers at once, further requests stay buffered until responses drain.
+constexpr uint64_t MAX_PIPELINED_REQUESTS = 16;
+
+// Resolution of the connection timeouts.
+constexpr auto TIMER_TICK = std::chrono::milliseconds(100);
+
+constexpr const char* HEADER_KEY_UPGRADE = "Upgrade";
+constexpr const char* HEADER_KEY_HTTP2_SETTINGS = "HTTP2-Settings";
+constexpr const char* UPGRADE_TOKEN_H2C = "h2c";
+
+constexpr const char* HEADER_KEY_WEBSOCKET_KEY = "Sec-WebSocket-Key";
+constexpr const char* HEADER_KEY_WEBSOCKET_VERSION = "Sec-WebSocket-Version";
+constexpr const char* UPGRADE_TOKEN_WEBSOCKET = "websocket";
+constexpr const char* WEBSOCKET_VERSION = "13";
+
+// The request asking for the upgrade is answered on stream 1.
+constexpr uint32_t UPGRADE_STREAM_ID = 1;
+
+constexpr const char* SWITCHING_TO_HTTP2 =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: h2c\r\n\r\n";
+
+constexpr const char* SWITCHING_TO_WEBSOCKET =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: websocket\r\n"
+    "Sec-WebSocket-Accept: ";
+
+// An event stream has no length, it ends when the connection closes.
+constexpr const char* EVENT_STREAM_HEADERS =
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n\r\n";
+
+/**
+ * @brief Finds a header of a request whatever the case of its name.
+ */
+static const std::string *FindHeader(Header *headers, const char *name) {
+    for (const std::string &key : headers->AllKeys()) {
+        if (strcasecmp(key.c_str(), name) == 0) {
+            return headers->Get(key);
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Checks whether a comma separated header value lists a token.
+ */
+static bool HasToken(const std::string &value, const char *token) {
+    std::istringstream stream(value);
+    std::string option;
+
+    while (std::getline(stream, option, ',')) {
+        option.erase(0, option.find_first_not_of(' '));
+        option.erase(option.find_last_not_of(' ') + 1);
+
+        if (strcasecmp(option.c_str(), token) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+AsyncServerBase::AsyncServerBase(Logger* logger,
+                                 WebLoomSettings *settings,
+                                 core::FileServer *fileServer,
+                                 ConnectionId firstConnectionId)
+    : ServerBase(logger, settings, fileServer), wakeup_fd_(-1),
+      buffered_output_(0), timers_(TIMER_TICK), draining_(false),
+      next_connection_id_(firstConnectionId), memory_exhausted_(false) {
+}
+
+AsyncServerBase::~AsyncServerBase() {
+    // Broadcasters outlive the server, they must not post events to it once
+    // it has gone.
+    for (auto &entry : subscriptions_) {
+        entry.first->RemoveListener(entry.second.listener);
+    }
+}
+
+void AsyncServerBase::OpenWakeupEvent() {
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ == -1) {
+        throw std::runtime_error("Failed to create reactor wakeup event");
+    }
+}
+
+void AsyncServerBase::CloseWakeupEvent() {
+    // Workers still running handlers must not signal a closed (and possibly
+    // reused) descriptor.
+    std::lock_guard<std::mutex> lock(completed_mutex_);
+    if (wakeup_fd_ != -1) {
+        closesocket(wakeup_fd_);
+        wakeup_fd_ = -1;
+    }
+    completed_.clear();
+}
+
+/**
+ * @brief Takes ownership of a newly accepted connection.
+ *
+ * @return The connection, now carrying its identifier.
+ */
+AsyncServerBase::Connection *AsyncServerBase::AddConnection(
+    std::unique_ptr<Connection> connection) {
+    connection->id = next_connection_id_++;
+    connection->lastActivity = std::chrono::steady_clock::now();
+    connection->timer.owner = connection->id;
+
+    Connection *added = connection.get();
+    connections_.emplace(added->id, std::move(connection));
+    UpdateTimer(added);
+    return added;
+}
+
+AsyncServerBase::Connection *AsyncServerBase::FindConnection(ConnectionId id) {
+    auto it = connections_.find(id);
+    return it == connections_.end() ? nullptr : it->second.get();
+}
+
+void AsyncServerBase::RemoveConnection(Connection *connection) {
+    if (connection->webSocket) {
+        WebSocketGone(std::move(connection->webSocket), connection->closeCode);
+    }
+
+    if (connection->eventStream) {
+        UnsubscribeFromEvents(connection);
+    }
+
+    connections_.erase(connection->id);
+}
+
+void AsyncServerBase::CloseAllConnections() {
+    for (auto it = connections_.begin(); it != connections_.end();) {
+        Connection *connection = it->second.get();
+        ++it;
+        CloseConnection(connection);
+    }
+}
+
+/**
+ * @brief Lets the requests in progress finish, with the server no longer
+ *        accepting connections.
+ *
+ * Connections between requests are closed straight away, the others once
+ * their current request has been answered. The reactor keeps running until
+ * every connection has gone or the deadline has passed.
+ */
+void AsyncServerBase::DrainConnections(
+    std::chrono::steady_clock::time_point deadline) {
+    draining_ = true;
+
+    for (auto it = connections_.begin(); it != connections_.end();) {
+        Connection *connection = it->second.get();
+        ++it;
+
+        // HTTP/2 clients are told to open no more streams, and the
+        // connection closes once the open ones have been answered.
+        if (connection->http2) {
+            connection->http2->GoAway();
+            SendHttp2Frames(connection);
+        } else if (connection->webSocket) {
+            // WebSocket clients are told the server is going away, the
+            // connection closing once the close frame has been written.
+            SendWebSocketClose(connection, WEBSOCKET_CLOSE_GOING_AWAY);
+            WriteToConnection(connection);
+        } else {
+            CloseIfFinished(connection);
+        }
+    }
+
+    while (!connections_.empty() &&
+           std::chrono::steady_clock::now() < deadline) {
+        ServerLoop();
+    }
+
+    if (!connections_.empty()) {
+        logger_->LogWarn("%zu connections were still open after the drain "
+                         "timeout", connections_.size());
+    }
+}
+
+/**
+ * @brief Closes the connection if it is closing, or between requests whilst
+ *        draining, and has nothing outstanding.
+ *
+ * @return true if the connection was closed.
+ */
+bool AsyncServerBase::CloseIfFinished(Connection *connection) {
+    bool finished = connection->closing || connection->peerClosed ||
+                    (draining_ && connection->input.Empty());
+
+    if (finished &&
+        connection->Outstanding() == 0 && !connection->Writing()) {
+        CloseConnection(connection);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Sets the connection's timer for whatever it is waiting on.
+ *
+ * Only time spent waiting on the client counts, there is no timeout whilst
+ * the connection waits on a handler or is held back by the output limits.
+ */
+void AsyncServerBase::UpdateTimer(Connection *connection) {
+    using std::chrono::seconds;
+    const std::chrono::steady_clock::time_point unset;
+    std::chrono::steady_clock::time_point deadline;
+
+    if (connection->Writing()) {
+        deadline = connection->lastWrite + seconds(settings_->WriteTimeout());
+    } else if (connection->Outstanding() > 0 || connection->held) {
+        timers_.Cancel(&connection->timer);
+        return;
+    } else if (connection->webSocket) {
+        if (settings_->WebSocketIdleTimeout() == 0) {
+            timers_.Cancel(&connection->timer);
+            return;
+        }
+
+        deadline = connection->lastActivity +
+                   seconds(settings_->WebSocketIdleTimeout());
+    } else if (connection->eventStream) {
+        // An event stream waits on the broadcaster, not the client.
+        timers_.Cancel(&connection->timer);
+        return;
+    } else if (connection->bodyStarted != unset) {
+        deadline = connection->bodyStarted +
+                   seconds(settings_->BodyTimeout());
+    } else if (connection->requestStarted != unset) {
+        deadline = connection->requestStarted +
+                   seconds(settings_->HeaderTimeout());
+    } else if (connection->requestsServed == 0) {
+        // A new connection has as long to start its first request as it
+        // has to send the headers.
+        deadline = connection->lastActivity +
+                   seconds(settings_->HeaderTimeout());
+    } else {
+        deadline = connection->lastActivity +
+                   seconds(settings_->KeepAliveTimeout());
+    }
+
+    timers_.Schedule(&connection->timer, deadline);
+}
+
+/**
+ * @brief Keeps polling for events without sleeping, until poll() finds some
+ *        or the busy poll budget has been spent.
+ *
+ * @return true if poll() found events.
+ */
+bool AsyncServerBase::BusyPoll(const std::function<bool()> &poll) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(settings_->BusyPollBudget());
+
+    do {
+        if (poll()) {
+            return true;
+        }
+    } while (!shutdown_requested_ &&
+             std::chrono::steady_clock::now() < deadline);
+
+    return false;
+}
+
+/**
+ * @brief Deals with every connection whose timer has expired.
+ *
+ * Called on every pass of the reactor.
+ */
+void AsyncServerBase::ExpireTimers() {
+    timers_.Advance(std::chrono::steady_clock::now(),
+                    [this](TimerWheel::Timer *timer) {
+        Connection *connection = FindConnection(timer->owner);
+        if (connection) {
+            ConnectionTimedOut(connection);
+        }
+    });
+}
+
+/**
+ * @brief Ends a connection that has waited too long for its client.
+ *
+ * A request arriving too slowly is answered with 408 Request Timeout before
+ * the connection is closed.
+ */
+void AsyncServerBase::ConnectionTimedOut(Connection *connection) {
+    if (connection->Writing()) {
+        logger_->LogDebug("Closing connection, client stopped reading");
+        CloseConnection(connection);
+        return;
+    }
+
+    // There is no 408 Request Timeout for an HTTP/2 stream or a WebSocket.
+    if (connection->input.Empty() || connection->http2 ||
+        connection->webSocket) {
+        logger_->LogDebug("Closing idle connection");
+        CloseConnection(connection);
+        return;
+    }
+
+    logger_->LogDebug("Request timed out");
+    connection->closing = true;
+    connection->input.Clear();
+    connection->output.Append(
+        GenerateErrorResponse(HttpStatus::RequestTimeout));
+    connection->lastWrite = std::chrono::steady_clock::now();
+
+    if (WriteToConnection(connection)) {
+        UpdateTimer(connection);
+    }
+}
+
+/**
+ * @brief Hands every complete buffered request to the workers.
+ *
+ * Clients may pipeline requests, so several can be taken from the input
+ * buffer in one go. Each is numbered so that the responses can be written in
+ * request order however the workers complete them. Malformed requests are
+ * rejected on the reactor thread without involving a worker. Requests wait
+ * in the input buffer whilst too much output is waiting to be written.
+ *
+ * @return false if the connection was closed, otherwise true.
+ */
+bool AsyncServerBase::DispatchRequests(Connection *connection) {
+    if (connection->http2) {
+        return DispatchHttp2Requests(connection);
+    }
+
+    if (connection->webSocket) {
+        return DispatchWebSocketMessages(connection);
+    }
+
+    // Nothing more is taken from the client of an event stream.
+    if (connection->eventStream) {
+        connection->input.Clear();
+        return true;
+    }
+
+    // A client that knows the server speaks HTTP/2 starts with its preface.
+    if (connection->nextSequence == 0 && settings_->Http2Enabled() &&
+        !connection->input.Empty() &&
+        Http2Session::MatchesPreface(connection->input.View())) {
+        if (connection->input.Size() < Http2Session::PREFACE_LENGTH) {
+            UpdateTimer(connection);
+            return true;
+        }
+
+        connection->http2 = std::make_unique<Http2Session>(settings_,
+                                                           memory_budget_);
+        connection->http2->Start();
+        return DispatchHttp2Requests(connection);
+    }
+
+    while (!connection->closing && !connection->upgrading) {
+        Request *request = nullptr;
+        std::string rejection;
+
+        try {
+            size_t frameLength = RequestFrameLength(&connection->parser,
+                                                    connection->input.View());
+            if (frameLength == 0) {
+                break;
+            }
+
+            // The request stays parsed in the input until it can be handled.
+            if (connection->Outstanding() >= MAX_PIPELINED_REQUESTS ||
+                OutputLimitReached(connection)) {
+                break;
+            }
+
+            request = ProcessRequest(connection->parser);
+            connection->input.Consume(frameLength);
+            connection->parser.Reset();
+            connection->requestStarted = {};
+            connection->bodyStarted = {};
+        }
+        catch (std::invalid_argument &ex) {
+            logger_->LogWarn("Rejecting malformed request: %s", ex.what());
+            rejection = GenerateErrorResponse(HttpStatus::BadRequest);
+        }
+        catch (RequestRejected &ex) {
+            logger_->LogWarn("Rejecting request: %s", ex.what());
+            rejection = GenerateErrorResponse(ex.Status());
+        }
+
+        // Rejected requests are answered on the reactor thread without
+        // involving a worker, and end the connection.
+        if (!request) {
+            uint64_t sequence = connection->nextSequence++;
+            connection->readyResponses[sequence] = {
+                connection->id, sequence, std::move(rejection), nullptr };
+            connection->closing = true;
+            connection->input.Clear();
+            connection->parser.Reset();
+            return SendReadyResponses(connection);
+        }
+
+        // The body is charged until the worker handling the request has
+        // deleted it.
+        ChargeMemory(MemoryBudget::Use::RequestBodies,
+                     request->Body().size());
+
+        if (UpgradeToHttp2(connection, request)) {
+            return DispatchHttp2Requests(connection);
+        }
+
+        uint64_t sequence = connection->nextSequence++;
+        connection->requestsServed++;
+
+        // The handshake is answered in its turn, whatever follows it is
+        // read as frames if the connection switches.
+        const WebSocketHandlers *webSocketHandlers =
+            RouteHandler::Instance().FindWebSocketRoute(request->Path());
+        if (webSocketHandlers) {
+            connection->upgrading = true;
+            threadpool_->enqueue(
+                std::bind(&AsyncServerBase::OpenWebSocketOnWorker,
+                          this,
+                          connection->id,
+                          sequence,
+                          request,
+                          webSocketHandlers));
+            break;
+        }
+
+        const EventStreamFunction *eventStreamHandler =
+            request->Method() == RequestMethod::Get ?
+            RouteHandler::Instance().FindEventStreamRoute(request->Path()) :
+            nullptr;
+        if (eventStreamHandler) {
+            connection->upgrading = true;
+            threadpool_->enqueue(
+                std::bind(&AsyncServerBase::OpenEventStreamOnWorker,
+                          this,
+                          connection->id,
+                          sequence,
+                          request,
+                          eventStreamHandler));
+            break;
+        }
+
+        bool keepAlive = request->KeepAlive() && !draining_ &&
+            connection->requestsServed < settings_->KeepAliveMaxRequests();
+        if (!keepAlive) {
+            connection->closing = true;
+        }
+
+        WorkersFor(request)->enqueue(
+            std::bind(&AsyncServerBase::HandleRequestOnWorker,
+                      this,
+                      connection->id,
+                      sequence,
+                      request,
+                      keepAlive,
+                      false));
+    }
+
+    if (connection->input.Size() > MaxPendingInput()) {
+        logger_->LogWarn("Closing connection, too much pending input");
+        CloseConnection(connection);
+        return false;
+    }
+
+    // The timeouts of a partly received request run from when it began to
+    // arrive and from when its headers were complete.
+    if (!connection->input.Empty()) {
+        auto now = std::chrono::steady_clock::now();
+        const std::chrono::steady_clock::time_point unset;
+
+        if (connection->requestStarted == unset) {
+            connection->requestStarted = now;
+        }
+
+        if (connection->bodyStarted == unset &&
+            connection->parser.HeadersComplete()) {
+            connection->bodyStarted = now;
+        }
+    }
+
+    UpdateTimer(connection);
+    return true;
+}
+
+/**
+ * @brief Queues the completed responses that are next in request order.
+ *
+ * @return false if the connection was closed, otherwise true.
+ */
+bool AsyncServerBase::SendReadyResponses(Connection *connection) {
+    auto it = connection->readyResponses.find(connection->nextSequenceToSend);
+
+    // The write timeout runs from when the output starts waiting.
+    if (it != connection->readyResponses.end() && !connection->Writing()) {
+        connection->lastWrite = std::chrono::steady_clock::now();
+    }
+
+    while (it != connection->readyResponses.end()) {
+        connection->output.Append(std::move(it->second.header),
+                                  std::move(it->second.response));
+        connection->output.Append(std::move(it->second.spliced));
+        connection->streaming = std::move(it->second.stream);
+
+        // Nothing can follow the answer to a WebSocket handshake or event
+        // stream request, the connection either switches or closes.
+        if (it->second.upgrade) {
+            std::shared_ptr<WebSocket> webSocket =
+                std::move(it->second.webSocket);
+            EventBroadcaster *broadcaster = it->second.broadcaster;
+            connection->readyResponses.erase(it);
+            connection->nextSequenceToSend++;
+
+            if (webSocket) {
+                SwitchToWebSocket(connection, std::move(webSocket));
+            } else if (broadcaster) {
+                SubscribeToEvents(connection, broadcaster);
+            } else {
+                connection->closing = true;
+                connection->input.Clear();
+            }
+            break;
+        }
+
+        connection->readyResponses.erase(it);
+
+        // Later responses wait behind a streamed response until it ends.
+        if (connection->streaming) {
+            break;
+        }
+        connection->nextSequenceToSend++;
+
+        it = connection->readyResponses.find(connection->nextSequenceToSend);
+    }
+
+    if (!WriteToConnection(connection)) {
+        return false;
+    }
+
+    UpdateTimer(connection);
+    return true;
+}
+
+/**
+ * @brief Picks the workers a request is handled on, proxied requests having
+ *        workers of their own so that waiting on upstream servers can't
+ *        hold up the other routes.
+ */
+ThreadPool *AsyncServerBase::WorkersFor(Request *request) {
+    return RouteHandler::Instance().FindProxyRoute(request->Path()) ?
+        proxy_pool_ : threadpool_;
+}
+
+/**
+ * @brief Picks the workers the next chunks of a streamed response are
+ *        produced on, as for the request it answers.
+ */
+ThreadPool *AsyncServerBase::WorkersFor(const Response *response) {
+    return response->FromUpstream() ? proxy_pool_ : threadpool_;
+}
+
+/**
+ * @brief Carries on with a connection once everything queued for it has
+ *        been written.
+ *
+ * @return false if the connection was closed, otherwise true.
+ */
+bool AsyncServerBase::OutputDrained(Connection *connection) {
+    connection->lastActivity = std::chrono::steady_clock::now();
+
+    if (CloseIfFinished(connection)) {
+        return false;
+    }
+
+    // The next chunks of a streamed response are only produced once the
+    // previous ones have been written, so a slow client holds back the
+    // response rather than having it pile up in memory.
+    if (connection->streaming) {
+        Response *response = connection->streaming.release();
+        WorkersFor(response)->enqueue(
+            std::bind(&AsyncServerBase::ProduceChunksOnWorker,
+                      this,
+                      connection->id,
+                      connection->nextSequenceToSend,
+                      response,
+                      false));
+    }
+
+    // Responses have drained, so requests held back by the pipeline and
+    // output limits can now be dispatched.
+    return DispatchRequests(connection);
+}
+
+/**
+ * @brief Switches the connection to HTTP/2 if the request asks for it with
+ *        "Upgrade: h2c", the request then being answered on stream 1.
+ *
+ * Only a request without a body that has no responses outstanding ahead of
+ * it is upgraded, any other carries on with HTTP/1.1.
+ *
+ * @return true if the connection has switched, the request has then been
+ *         handed to a worker.
+ */
+bool AsyncServerBase::UpgradeToHttp2(Connection *connection,
+                                     Request *request) {
+    if (!settings_->Http2Enabled() || draining_ ||
+        connection->Outstanding() > 0 ||
+        request->HttpRequestVersion() != HttpVersion::HTTP_1_1 ||
+        !request->Body().empty()) {
+        return false;
+    }
+
+    Header headers = request->Headers();
+    const std::string *upgrade = FindHeader(&headers, HEADER_KEY_UPGRADE);
+    const std::string *http2Settings =
+        FindHeader(&headers, HEADER_KEY_HTTP2_SETTINGS);
+
+    if (!upgrade || !http2Settings ||
+        !HasToken(CleanHeaderString(*upgrade), UPGRADE_TOKEN_H2C)) {
+        return false;
+    }
+
+    auto session = std::make_unique<Http2Session>(settings_, memory_budget_);
+    try {
+        session->StartUpgraded(CleanHeaderString(*http2Settings));
+    }
+    catch (std::invalid_argument &ex) {
+        logger_->LogDebug("Not upgrading to HTTP/2: %s", ex.what());
+        return false;
+    }
+
+    connection->output.Append(SWITCHING_TO_HTTP2);
+    connection->http2 = std::move(session);
+    connection->requestsServed++;
+
+    WorkersFor(request)->enqueue(
+        std::bind(&AsyncServerBase::HandleRequestOnWorker,
+                  this,
+                  connection->id,
+                  UPGRADE_STREAM_ID,
+                  request,
+                  true,
+                  true));
+    return true;
+}
+
+/**
+ * @brief Processes the HTTP/2 frames received and hands every complete
+ *        stream to the workers.
+ *
+ * Requests that can not be handled are answered on their stream straight
+ * away, the other streams carry on. A connection error ends the connection
+ * once the GOAWAY frame has been sent. Frames wait in the input whilst too
+ * much output is waiting to be written, as the replies to pings, settings
+ * and refused streams add to it.
+ *
+ * @return false if the connection was closed, otherwise true.
+ */
+bool AsyncServerBase::DispatchHttp2Requests(Connection *connection) {
+    Http2Session *session = connection->http2.get();
+    std::vector<Http2Session::ReceivedRequest> received;
+    size_t room = OutputLimitReached(connection) ? 0 :
+        settings_->MaxConnectionOutput() - connection->BufferedOutput();
+
+    if (!session->Receive(&connection->input, room, &received)) {
+        logger_->LogWarn("Closing HTTP/2 connection: %s",
+                         session->ErrorReason().c_str());
+        connection->closing = true;
+        connection->input.Clear();
+    }
+
+    for (auto &entry : received) {
+        Request *request = nullptr;
+        HttpStatus rejection = HttpStatus::PayloadTooLarge;
+
+        if (!entry.bodyTooLarge) {
+            try {
+                request = ProcessHttp2Request(entry.fields,
+                                              std::move(entry.body));
+            }
+            catch (std::invalid_argument &ex) {
+                logger_->LogWarn("Rejecting malformed request: %s",
+                                 ex.what());
+                rejection = HttpStatus::BadRequest;
+            }
+        }
+
+        connection->requestsServed++;
+
+        if (!request) {
+            session->SubmitResponse(
+                entry.streamId,
+                std::unique_ptr<Response>(CreateErrorResponse(rejection)),
+                "", false);
+            continue;
+        }
+
+        ChargeMemory(MemoryBudget::Use::RequestBodies,
+                     request->Body().size());
+
+        WorkersFor(request)->enqueue(
+            std::bind(&AsyncServerBase::HandleRequestOnWorker,
+                      this,
+                      connection->id,
+                      entry.streamId,
+                      request,
+                      true,
+                      true));
+    }
+
+    // Frames from the client, pings included, keep the connection alive.
+    connection->lastActivity = std::chrono::steady_clock::now();
+
+    return SendHttp2Frames(connection);
+}
+
+/**
+ * @brief Frames what the HTTP/2 session has ready and writes it.
+ *
+ * Writing the frames can drain the output, which lets the session frame
+ * more, so this carries on until the socket is full or there is nothing
+ * more to send. Streamed responses that need their next chunks are handed
+ * to the workers.
+ *
+ * @return false if the connection was closed, otherwise true.
+ */
+bool AsyncServerBase::SendHttp2Frames(Connection *connection) {
+    // Called again from OutputDrained() whilst writing, the loop below
+    // takes care of it.
+    if (connection->sendingFrames) {
+        return true;
+    }
+
+    connection->sendingFrames = true;
+
+    do {
+        Http2Session::ChunkRequests wanted;
+        bool writing = connection->Writing();
+        size_t limit = settings_->MaxConnectionOutput();
+
+        // The frames pending in the session count towards the room taken
+        // by Flush() itself.
+        size_t buffered = connection->BufferedOutput() -
+                          connection->PendingFrames();
+
+        connection->http2->Flush(&connection->output,
+                                 buffered < limit ? limit - buffered : 0,
+                                 &wanted);
+
+        for (auto &entry : wanted) {
+            Response *response = entry.second.release();
+            WorkersFor(response)->enqueue(
+                std::bind(&AsyncServerBase::ProduceChunksOnWorker,
+                          this,
+                          connection->id,
+                          entry.first,
+                          response,
+                          true));
+        }
+
+        if (connection->output.Empty()) {
+            break;
+        }
+
+        // The write timeout runs from when the output starts waiting.
+        if (!writing) {
+            connection->lastWrite = std::chrono::steady_clock::now();
+        }
+
+        if (!WriteToConnection(connection)) {
+            return false;
+        }
+    } while (connection->output.Empty());
+
+    connection->sendingFrames = false;
+
+    if (CloseIfFinished(connection)) {
+        return false;
+    }
+
+    UpdateTimer(connection);
+    return true;
+}
+
+/**
+ * @brief Passes a response completed by a worker to the connection's HTTP/2
+ *        session.
+ */
+void AsyncServerBase::CompleteHttp2Response(Connection *connection,
+                                            CompletedResponse *completed) {
+    Http2Session *session = connection->http2.get();
+    auto streamId = static_cast<uint32_t>(completed->sequence);
+
+    if (completed->failed) {
+        session->ResetStream(streamId);
+    } else if (completed->response) {
+        session->SubmitResponse(streamId,
+                                std::move(completed->response),
+                                std::move(completed->header),
+                                completed->moreChunks);
+    } else {
+        session->SubmitChunks(streamId,
+                              std::move(completed->header),
+                              std::move(completed->stream));
+    }
+
+    SendHttp2Frames(connection);
+}
+
+/**
+ * @brief Hands the connection over to WebSocket once the handshake's answer
+ *        has been queued.
+ *
+ * Whatever the handlers sent whilst the handshake was being answered is
+ * posted back to the reactor as soon as the WebSocket is attached.
+ */
+void AsyncServerBase::SwitchToWebSocket(Connection *connection,
+                                        std::shared_ptr<WebSocket> webSocket) {
+    connection->upgrading = false;
+    connection->requestStarted = {};
+    connection->bodyStarted = {};
+    connection->webSocketCodec = std::make_unique<WebSocketCodec>(
+        settings_->MaxWebSocketMessageSize(), memory_budget_);
+    connection->webSocket = webSocket;
+
+    ConnectionId id = connection->id;
+    webSocket->Attach([this, id](std::string frames, bool close) {
+        CompletedResponse completed { id, 0, std::move(frames), nullptr };
+        completed.closesWebSocket = close;
+        PostCompletedResponse(std::move(completed));
+    });
+
+    if (draining_) {
+        webSocket->Close(WEBSOCKET_CLOSE_GOING_AWAY);
+    }
+}
+
+/**
+ * @brief Reads the frames received on a WebSocket connection, answering the
+ *        control frames and handing the next message to the workers.
+ *
+ * Only one message is with the workers at a time, frames are left in the
+ * input until its handler has returned. A client that breaks the protocol
+ * is sent a close frame with the reason's status, and the connection closes
+ * once it has been written.
+ *
+ * @return false if the connection was closed, otherwise true.
+ */
+bool AsyncServerBase::DispatchWebSocketMessages(Connection *connection) {
+    WebSocketCodec::Message message;
+    bool writing = connection->Writing();
+
+    try {
+        while (!connection->closing && !connection->handlingMessage &&
+               !OutputLimitReached(connection) &&
+               connection->webSocketCodec->Next(&connection->input,
+                                                &message)) {
+            switch (message.opcode) {
+                case WebSocketCodec::Opcode::Ping: {
+                    std::string frames;
+                    WebSocketCodec::EncodeFrame(WebSocketCodec::Opcode::Pong,
+                                                message.payload,
+                                                &frames);
+                    connection->output.Append(std::move(frames));
+                    break;
+                }
+
+                case WebSocketCodec::Opcode::Pong:
+                    break;
+
+                case WebSocketCodec::Opcode::Close:
+                    connection->closeCode =
+                        WebSocketCodec::CloseCode(message.payload);
+                    // The client's status is echoed back, an empty close
+                    // frame being answered with one.
+                    SendWebSocketClose(connection, connection->closeCode);
+                    break;
+
+                default:
+                    connection->handlingMessage = true;
+                    connection->webSocket->StartHandling();
+                    ChargeMemory(MemoryBudget::Use::RequestBodies,
+                                 message.payload.size());
+                    threadpool_->enqueue(std::bind(
+                        &AsyncServerBase::HandleWebSocketMessageOnWorker,
+                        this,
+                        connection->id,
+                        connection->webSocket,
+                        WebSocketMessage {
+                            message.opcode == WebSocketCodec::Opcode::Binary,
+                            std::move(message.payload) }));
+                    break;
+            }
+        }
+    }
+    catch (WebSocketError &ex) {
+        logger_->LogWarn("Closing WebSocket connection: %s", ex.what());
+        SendWebSocketClose(connection, ex.Code());
+    }
+
+    // Input waiting behind a message being handled is bounded like that of
+    // pipelined requests.
+    if (connection->input.Size() >
+        std::max(MaxPendingInput(), settings_->MaxWebSocketMessageSize())) {
+        logger_->LogWarn("Closing connection, too much pending input");
+        CloseConnection(connection);
+        return false;
+    }
+
+    // Frames from the client, pings included, keep the connection alive.
+    connection->lastActivity = std::chrono::steady_clock::now();
+
+    if (!connection->output.Empty()) {
+        // The write timeout runs from when the output starts waiting.
+        if (!writing) {
+            connection->lastWrite = std::chrono::steady_clock::now();
+        }
+
+        if (!WriteToConnection(connection)) {
+            return false;
+        }
+    }
+
+    UpdateTimer(connection);
+    return true;
+}
+
+/**
+ * @brief Queues a close frame, after which the connection takes no more
+ *        input and closes once everything queued has been written.
+ *
+ * No frame is queued if a handler has already closed the WebSocket, its
+ * close frame is on the way to the reactor.
+ */
+void AsyncServerBase::SendWebSocketClose(Connection *connection,
+                                         uint16_t code) {
+    if (!connection->closeSent && connection->webSocket->StopSending()) {
+        std::string frames;
+        WebSocketCodec::EncodeClose(code, &frames);
+        connection->output.Append(std::move(frames));
+        connection->closeSent = true;
+    }
+
+    connection->closing = true;
+    connection->input.Clear();
+}
+
+/**
+ * @brief Queues the frames sent by a WebSocket's handlers, or carries on
+ *        with the next message once a handler has returned.
+ *
+ * A client that has fallen so far behind that the connection's output limit
+ * has been reached is disconnected, rather than the frames being held back
+ * for it.
+ */
+void AsyncServerBase::CompleteWebSocketFrames(Connection *connection,
+                                              CompletedResponse *completed) {
+    if (completed->messageHandled) {
+        connection->handlingMessage = false;
+    }
+
+    if (!completed->header.empty() && !connection->closeSent) {
+        bool writing = connection->Writing();
+
+        if (writing && connection->BufferedOutput() >=
+                       settings_->MaxConnectionOutput()) {
+            logger_->LogWarn("Closing WebSocket connection, client is not "
+                             "keeping up");
+            CloseConnection(connection);
+            return;
+        }
+
+        connection->output.Append(std::move(completed->header));
+
+        if (completed->closesWebSocket) {
+            connection->closeSent = true;
+            connection->closing = true;
+            connection->input.Clear();
+        }
+
+        // The write timeout runs from when the output starts waiting.
+        if (!writing) {
+            connection->lastWrite = std::chrono::steady_clock::now();
+        }
+
+        if (!WriteToConnection(connection)) {
+            return;
+        }
+    }
+
+    if (CloseIfFinished(connection)) {
+        return;
+    }
+
+    if (completed->messageHandled) {
+        DispatchWebSocketMessages(connection);
+    }
+}
+
+/**
+ * @brief Lets a WebSocket's handlers know its connection has gone, once any
+ *        handler still running for it has returned.
+ */
+void AsyncServerBase::WebSocketGone(std::shared_ptr<WebSocket> webSocket,
+                                    uint16_t code) {
+    if (webSocket->Detach(code) && threadpool_) {
+        threadpool_->enqueue(std::bind(&AsyncServerBase::CloseWebSocketOnWorker,
+                                       this,
+                                       std::move(webSocket),
+                                       code));
+    }
+}
+
+/**
+ * @brief Subscribes the connection to a broadcaster once the event stream's
+ *        header has been queued.
+ *
+ * The first connection of the server to subscribe to a broadcaster adds the
+ * listener through which its events reach the reactor.
+ */
+void AsyncServerBase::SubscribeToEvents(Connection *connection,
+                                        EventBroadcaster *broadcaster) {
+    connection->upgrading = false;
+    connection->requestStarted = {};
+    connection->bodyStarted = {};
+    connection->input.Clear();
+    connection->eventStream = broadcaster;
+
+    auto it = subscriptions_.find(broadcaster);
+    if (it == subscriptions_.end()) {
+        uint64_t listener = broadcaster->AddListener(
+            [this, broadcaster](std::shared_ptr<const std::string> event) {
+                CompletedResponse completed;
+                completed.broadcaster = broadcaster;
+                completed.event = std::move(event);
+                PostCompletedResponse(std::move(completed));
+            });
+
+        it = subscriptions_.emplace(broadcaster,
+                                    EventSubscription { listener, {} }).first;
+    }
+
+    it->second.connections.insert(connection->id);
+    broadcaster->subscribers_++;
+}
+
+void AsyncServerBase::UnsubscribeFromEvents(Connection *connection) {
+    EventBroadcaster *broadcaster = connection->eventStream;
+    connection->eventStream = nullptr;
+    broadcaster->subscribers_--;
+
+    auto it = subscriptions_.find(broadcaster);
+    if (it == subscriptions_.end()) {
+        return;
+    }
+
+    it->second.connections.erase(connection->id);
+    if (it->second.connections.empty()) {
+        broadcaster->RemoveListener(it->second.listener);
+        subscriptions_.erase(it);
+    }
+}
+
+/**
+ * @brief Queues an event on every connection subscribed to its broadcaster.
+ *
+ * The event is queued by reference, so however many subscribers there are
+ * it is held in memory once, and charged to the memory budget once until
+ * the last of them has been written to. A subscriber that has fallen so far behind
+ * that the connection's output limit has been reached is disconnected,
+ * rather than events piling up for it.
+ */
+void AsyncServerBase::BroadcastEvent(
+    EventBroadcaster *broadcaster,
+    const std::shared_ptr<const std::string> &event) {
+    auto it = subscriptions_.find(broadcaster);
+    if (it == subscriptions_.end()) {
+        return;
+    }
+
+    // The queues do not charge what they share, so the event is charged
+    // here and refunded when the last queue holding it lets go.
+    std::shared_ptr<const std::string> queued = event;
+    if (memory_budget_) {
+        MemoryBudget *budget = memory_budget_;
+        size_t size = event->size();
+        budget->Charge(MemoryBudget::Use::QueuedOutput, size);
+        queued = std::shared_ptr<const std::string>(
+            event.get(), [budget, size, event](const std::string *) {
+                budget->Refund(MemoryBudget::Use::QueuedOutput, size);
+            });
+    }
+
+    // Writing may close connections, which unsubscribes them.
+    std::vector<ConnectionId> subscribers(it->second.connections.begin(),
+                                          it->second.connections.end());
+    auto now = std::chrono::steady_clock::now();
+
+    for (ConnectionId id : subscribers) {
+        Connection *connection = FindConnection(id);
+        if (!connection) {
+            continue;
+        }
+
+        bool writing = connection->Writing();
+        if (writing && connection->BufferedOutput() >=
+                       settings_->MaxConnectionOutput()) {
+            logger_->LogWarn("Closing event stream, client is not keeping "
+                             "up");
+            CloseConnection(connection);
+            continue;
+        }
+
+        connection->output.Append(queued);
+
+        // The write timeout runs from when the output starts waiting.
+        if (!writing) {
+            connection->lastWrite = now;
+        }
+
+        if (WriteToConnection(connection)) {
+            UpdateTimer(connection);
+        }
+    }
+}
+
+/**
+ * @brief Checks whether so much output is waiting to be written, or so much
+ *        memory is held across the process, that no further requests should
+ *        be handled for the connection.
+ *
+ * A connection stopped by the server wide limit or the memory budget is
+ * remembered, so that it can carry on once other connections have drained.
+ */
+bool AsyncServerBase::OutputLimitReached(Connection *connection) {
+    if (connection->BufferedOutput() >= settings_->MaxConnectionOutput()) {
+        return true;
+    }
+
+    if (buffered_output_ < settings_->MaxBufferedOutput() &&
+        !MemoryBudgetExhausted()) {
+        return false;
+    }
+
+    // Only connections with a request waiting need to be carried on.
+    if (!connection->held && !connection->input.Empty()) {
+        connection->held = true;
+        held_connections_.push_back(connection->id);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Stops reading from a connection whilst the memory budget is
+ *        exhausted, the connection is held until enough memory has been
+ *        released.
+ *
+ * @return true if reading has been paused.
+ */
+bool AsyncServerBase::PauseReading(Connection *connection) {
+    if (!MemoryBudgetExhausted()) {
+        return false;
+    }
+
+    connection->readPaused = true;
+    if (!connection->held) {
+        connection->held = true;
+        held_connections_.push_back(connection->id);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Carries on with the connections held back by the server wide output
+ *        limit or the memory budget once enough has drained.
+ *
+ * Called on every pass of the reactor, output is released both as it is
+ * written and as connections close. Whilst the memory budget is exhausted
+ * the buffers kept for reuse are freed as well.
+ */
+void AsyncServerBase::ResumeHeldConnections() {
+    bool exhausted = MemoryBudgetExhausted();
+    if (exhausted != memory_exhausted_) {
+        memory_exhausted_ = exhausted;
+        if (exhausted) {
+            logger_->LogWarn("Memory budget exhausted, %zu bytes in use",
+                             memory_budget_->Used());
+        } else {
+            logger_->LogInfo("Memory use back within budget");
+        }
+    }
+
+    if (exhausted) {
+        buffer_pool_.Trim();
+    }
+
+    if (held_connections_.empty() || exhausted ||
+        buffered_output_ >= settings_->MaxBufferedOutput()) {
+        return;
+    }
+
+    std::vector<ConnectionId> held;
+    held.swap(held_connections_);
+
+    for (ConnectionId id : held) {
+        Connection *connection = FindConnection(id);
+        if (!connection) {
+            continue;
+        }
+
+        connection->held = false;
+        if (connection->readPaused) {
+            connection->readPaused = false;
+            ResumeReading(connection);
+        } else {
+            DispatchRequests(connection);
+        }
+    }
+}
+
+/**
+ * @param http2 The request came on an HTTP/2 stream, whose session frames
+ *              the response instead of it having an HTTP/1.1 header.
+ */
+void AsyncServerBase::HandleRequestOnWorker(ConnectionId connectionId,
+                                            uint64_t sequence,
+                                            Request *request,
+                                            bool keepAlive,
+                                            bool http2) {
+    Response *response = nullptr;
+    std::string firstChunks;
+    SplicedData spliced;
+    bool moreChunks = false;
+
+    // As charged, whatever the handler does with the body.
+    size_t bodySize = request->Body().size();
+
+    try {
+        response = DispatchRequest(request);
+
+        // The first chunks of a streamed response go out with the header,
+        // a source that fails before then can still be answered with an
+        // error. Only HTTP/1.x can splice the body into the socket, HTTP/2
+        // has to frame it.
+        if (response && response->Streamed()) {
+            moreChunks = response->NextChunks(&firstChunks, !http2,
+                                              http2 ? nullptr : &spliced);
+        }
+    }
+    catch (std::exception &ex) {
+        logger_->LogError("Route handler for '%s' failed: %s",
+                          request->Path().c_str(), ex.what());
+        delete response;
+        response = nullptr;
+    }
+
+    if (!response) {
+        response = new Response(
+            core::HttpStatus::InternalServerError,
+            "<html><body><h1>500 Internal Server Error</h1></body></html>",
+            HttpContentType::TextHTML);
+    }
+
+    delete request;
+    RefundMemory(MemoryBudget::Use::RequestBodies, bodySize);
+
+    if (http2) {
+        CompletedResponse completed { connectionId,
+                                      sequence,
+                                      std::move(firstChunks),
+                                      std::unique_ptr<Response>(response) };
+        completed.moreChunks = moreChunks;
+
+        PostCompletedResponse(std::move(completed));
+        return;
+    }
+
+    // The body stays with the response, it is written from there by the
+    // reactor without being copied behind the header.
+    std::string header = GenerateResponseHeader(response, keepAlive);
+
+    if (response->Streamed()) {
+        CompletedResponse completed { connectionId,
+                                      sequence,
+                                      header + firstChunks,
+                                      nullptr };
+        completed.spliced = std::move(spliced);
+        if (moreChunks) {
+            completed.stream.reset(response);
+        } else {
+            delete response;
+        }
+
+        PostCompletedResponse(std::move(completed));
+        return;
+    }
+
+    PostCompletedResponse({ connectionId,
+                            sequence,
+                            std::move(header),
+                            std::unique_ptr<Response>(response) });
+}
+
+void AsyncServerBase::ProduceChunksOnWorker(ConnectionId connectionId,
+                                            uint64_t sequence,
+                                            Response *response,
+                                            bool http2) {
+    std::unique_ptr<Response> stream(response);
+    CompletedResponse completed { connectionId, sequence, "", nullptr };
+
+    try {
+        if (stream->NextChunks(&completed.header, !http2,
+                               http2 ? nullptr : &completed.spliced)) {
+            completed.stream = std::move(stream);
+        }
+    }
+    catch (std::exception &ex) {
+        logger_->LogError("Streamed response failed: %s", ex.what());
+        completed.failed = true;
+    }
+
+    PostCompletedResponse(std::move(completed));
+}
+
+/**
+ * @brief Answers a WebSocket handshake, passing the request to the route's
+ *        onOpen handler if it is a valid one.
+ *
+ * An accepted handshake is answered with 101 Switching Protocols and carries
+ * the WebSocket back to the reactor, any other answer closes the connection.
+ */
+void AsyncServerBase::OpenWebSocketOnWorker(ConnectionId connectionId,
+                                            uint64_t sequence,
+                                            Request *request,
+                                            const WebSocketHandlers *handlers) {
+    if (stats_) {
+        stats_->requests.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t bodySize = request->Body().size();
+
+    Header headers = request->Headers();
+    const std::string *upgrade = FindHeader(&headers, HEADER_KEY_UPGRADE);
+    const std::string *key = FindHeader(&headers, HEADER_KEY_WEBSOCKET_KEY);
+    const std::string *version =
+        FindHeader(&headers, HEADER_KEY_WEBSOCKET_VERSION);
+
+    CompletedResponse completed { connectionId, sequence, "", nullptr };
+    completed.upgrade = true;
+    HttpStatus refusal = HttpStatus::OK;
+
+    if (request->Method() != RequestMethod::Get ||
+        request->HttpRequestVersion() != HttpVersion::HTTP_1_1 ||
+        !upgrade || !key ||
+        !HasToken(CleanHeaderString(*upgrade), UPGRADE_TOKEN_WEBSOCKET)) {
+        refusal = HttpStatus::BadRequest;
+    } else if (!version || CleanHeaderString(*version) != WEBSOCKET_VERSION) {
+        refusal = HttpStatus::Upgrade_Required;
+    } else {
+        auto webSocket = std::make_shared<WebSocket>(request->Path(),
+                                                     handlers);
+        bool accepted = true;
+
+        try {
+            if (handlers->onOpen) {
+                accepted = handlers->onOpen(webSocket, request);
+            }
+        }
+        catch (std::exception &ex) {
+            logger_->LogError("WebSocket handler for '%s' failed: %s",
+                              request->Path().c_str(), ex.what());
+            accepted = false;
+            refusal = HttpStatus::InternalServerError;
+        }
+
+        uint16_t code;
+        webSocket->FinishHandling(&code);
+
+        if (accepted) {
+            completed.header = SWITCHING_TO_WEBSOCKET +
+                WebSocketCodec::AcceptKey(CleanHeaderString(*key)) +
+                "\r\n\r\n";
+            completed.webSocket = std::move(webSocket);
+        } else {
+            // Handlers that kept hold of a refused WebSocket can send
+            // nothing on it.
+            webSocket->Detach(WEBSOCKET_CLOSE_ABNORMAL);
+            if (refusal == HttpStatus::OK) {
+                refusal = HttpStatus::Forbidden;
+            }
+        }
+    }
+
+    if (refusal != HttpStatus::OK) {
+        std::unique_ptr<Response> response(CreateErrorResponse(refusal));
+        completed.header = GenerateResponseHeader(response.get(), false);
+
+        // Clients are told which version to ask for instead.
+        if (refusal == HttpStatus::Upgrade_Required) {
+            completed.header.insert(completed.header.size() - 2,
+                                    std::string(HEADER_KEY_WEBSOCKET_VERSION) +
+                                    ": " + WEBSOCKET_VERSION + "\r\n");
+        }
+        completed.header += response->Body();
+    }
+
+    delete request;
+    RefundMemory(MemoryBudget::Use::RequestBodies, bodySize);
+    PostCompletedResponse(std::move(completed));
+}
+
+/**
+ * @brief Answers a request for an event stream, asking the route's handler
+ *        for the broadcaster to subscribe the client to.
+ *
+ * A refused request is answered with an error and closes the connection.
+ */
+void AsyncServerBase::OpenEventStreamOnWorker(
+    ConnectionId connectionId,
+    uint64_t sequence,
+    Request *request,
+    const EventStreamFunction *handler) {
+    if (stats_) {
+        stats_->requests.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t bodySize = request->Body().size();
+
+    EventBroadcaster *broadcaster = nullptr;
+    HttpStatus refusal = HttpStatus::Forbidden;
+
+    try {
+        broadcaster = (*handler)(request);
+    }
+    catch (std::exception &ex) {
+        logger_->LogError("Event stream handler for '%s' failed: %s",
+                          request->Path().c_str(), ex.what());
+        refusal = HttpStatus::InternalServerError;
+    }
+
+    CompletedResponse completed { connectionId, sequence, "", nullptr };
+    completed.upgrade = true;
+
+    if (broadcaster) {
+        completed.header = "HTTP/1.1 200 OK\r\nContent-Type: " +
+            HttpContentTypeString(HttpContentType::TextEventStream) +
+            "\r\n" + EVENT_STREAM_HEADERS;
+        completed.broadcaster = broadcaster;
+    } else {
+        completed.header = GenerateErrorResponse(refusal);
+    }
+
+    delete request;
+    RefundMemory(MemoryBudget::Use::RequestBodies, bodySize);
+    PostCompletedResponse(std::move(completed));
+}
+
+/**
+ * @brief Passes a WebSocket message to the route's onMessage handler.
+ *
+ * A handler that throws closes the connection with 1011 Internal Error.
+ */
+void AsyncServerBase::HandleWebSocketMessageOnWorker(
+    ConnectionId connectionId,
+    std::shared_ptr<WebSocket> webSocket,
+    WebSocketMessage message) {
+    const WebSocketHandlers *handlers = webSocket->handlers_;
+
+    try {
+        if (handlers->onMessage) {
+            handlers->onMessage(webSocket, message);
+        }
+    }
+    catch (std::exception &ex) {
+        logger_->LogError("WebSocket handler for '%s' failed: %s",
+                          webSocket->Path().c_str(), ex.what());
+        webSocket->Close(WEBSOCKET_CLOSE_INTERNAL_ERROR);
+    }
+    RefundMemory(MemoryBudget::Use::RequestBodies, message.data.size());
+
+    CompletedResponse completed { connectionId, 0, "", nullptr };
+    completed.messageHandled = true;
+    PostCompletedResponse(std::move(completed));
+
+    // The connection may have gone whilst the handler ran.
+    uint16_t code;
+    if (webSocket->FinishHandling(&code)) {
+        CloseWebSocketOnWorker(std::move(webSocket), code);
+    }
+}
+
+void AsyncServerBase::CloseWebSocketOnWorker(
+    std::shared_ptr<WebSocket> webSocket, uint16_t code) {
+    const WebSocketHandlers *handlers = webSocket->handlers_;
+
+    try {
+        if (handlers->onClose) {
+            handlers->onClose(webSocket, code);
+        }
+    }
+    catch (std::exception &ex) {
+        logger_->LogError("WebSocket handler for '%s' failed: %s",
+                          webSocket->Path().c_str(), ex.what());
+    }
+}
+
+void AsyncServerBase::PostCompletedResponse(CompletedResponse completed) {
+    std::lock_guard<std::mutex> lock(completed_mutex_);
+
+    if (wakeup_fd_ == -1) {
+        return;
+    }
+
+    completed_.push_back(std::move(completed));
+
+    uint64_t value = 1;
+    if (write(wakeup_fd_, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        logger_->LogError("Failed to wake reactor: %s", strerror(errno));
+    }
+}
+
+void AsyncServerBase::ProcessCompletedResponses() {
+    std::vector<CompletedResponse> completed;
+    {
+        std::lock_guard<std::mutex> lock(completed_mutex_);
+        completed.swap(completed_);
+    }
+
+    for (auto &entry : completed) {
+        if (entry.event) {
+            BroadcastEvent(entry.broadcaster, entry.event);
+            continue;
+        }
+
+        // The client may have gone away whilst the worker was busy.
+        Connection *connection = FindConnection(entry.connectionId);
+        if (!connection) {
+            if (entry.webSocket) {
+                WebSocketGone(std::move(entry.webSocket),
+                              WEBSOCKET_CLOSE_ABNORMAL);
+            }
+            continue;
+        }
+
+        if (connection->http2) {
+            CompleteHttp2Response(connection, &entry);
+            continue;
+        }
+
+        if (connection->webSocket) {
+            CompleteWebSocketFrames(connection, &entry);
+            continue;
+        }
+
+        if (entry.failed) {
+            CloseConnection(connection);
+            continue;
+        }
+
+        uint64_t sequence = entry.sequence;
+        connection->readyResponses[sequence] = std::move(entry);
+        SendReadyResponses(connection);
+    }
+}
+
+}   // namespace webloom::core
+
+#endif  // WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX
@@ -0,0 +1,382 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_ASYNCSERVERBASE_H_
+#define CORE_ASYNCSERVERBASE_H_
+#include <chrono>               // NOLINT(build/c++11)
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>                // NOLINT(build/c++11)
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "EventStream.h"
+#include "Request.h"
+#include "ServerBase.h"
+#include "WebSocket.h"
+#include "core/Http2Session.h"
+#include "core/OutputQueue.h"
+#include "core/ReadBuffer.h"
+#include "core/RequestParser.h"
+#include "core/TimerWheel.h"
+#include "core/WebSocketCodec.h"
+
+namespace webloom::core {
+
+using ConnectionId = uint64_t;
+
+/**
+ * @brief Common connection handling for the reactor based servers.
+ *
+ * A single reactor thread owns every connection. It frames and parses the
+ * requests, hands complete requests to the worker thread pool and writes the
+ * responses back in request order once the workers post them back through
+ * the wakeup event. Derived servers only supply the socket I/O.
+ *
+ * Connections can switch to HTTP/2 (h2c), either from the start with the
+ * client's connection preface or by upgrading an HTTP/1.1 request. Each
+ * stream is then handed to the workers as it completes, and the responses
+ * are framed by the connection's Http2Session in whatever order they
+ * complete.
+ *
+ * Requests for a WebSocket route hand the connection over to WebSocket once
+ * the route's handlers have accepted it. Its messages then go to the workers
+ * one at a time, and whatever the handlers send is posted back to the
+ * reactor like a response.
+ *
+ * Requests for an event stream route subscribe the connection to a
+ * broadcaster. Each event published is posted to the reactor once and
+ * queued by reference on every subscribed connection.
+ */
+class AsyncServerBase : public ServerBase {
+ public:
+    AsyncServerBase(Logger *logger,
+                    WebLoomSettings *settings,
+                    core::FileServer *fileServer,
+                    ConnectionId firstConnectionId);
+
+    virtual ~AsyncServerBase();
+
+ protected:
+    struct CompletedResponse {
+        CompletedResponse() = default;
+
+        CompletedResponse(ConnectionId id,
+                          uint64_t number,
+                          std::string data,
+                          std::unique_ptr<Response> owner)
+            : connectionId(id), sequence(number), header(std::move(data)),
+              response(std::move(owner)) {}
+
+        ConnectionId connectionId = 0;
+        uint64_t sequence = 0;
+        std::string header;
+        std::unique_ptr<Response> response;
+
+        // Set while a streamed response has further chunks to produce.
+        std::unique_ptr<Response> stream;
+
+        // Part of a streamed body waiting in a pipe, sent after header.
+        SplicedData spliced;
+
+        // A streamed response failed part way, all the connection can do is
+        // close.
+        bool failed = false;
+
+        // HTTP/2 only, the streamed response in response has further chunks
+        // to produce.
+        bool moreChunks = false;
+
+        // The answer to a WebSocket handshake, carrying the connection's
+        // WebSocket unless the handshake was refused.
+        bool upgrade = false;
+        std::shared_ptr<WebSocket> webSocket;
+
+        // WebSocket only, header holds frames sent by a handler, the last of
+        // them a close frame when closesWebSocket is set.
+        bool closesWebSocket = false;
+
+        // WebSocket only, the handler of the last message has returned.
+        bool messageHandled = false;
+
+        // The answer to an event stream request carries the broadcaster to
+        // subscribe to, unless the request was refused.
+        EventBroadcaster *broadcaster = nullptr;
+
+        // An event published by broadcaster, for all its subscribers rather
+        // than one connection.
+        std::shared_ptr<const std::string> event;
+    };
+
+    struct Connection {
+        Connection(BufferPool *pool,
+                   size_t *bufferedOutput,
+                   MemoryBudget *budget)
+            : input(pool), output(bufferedOutput, budget) {}
+
+        virtual ~Connection() = default;
+
+        // Response bytes held in memory for the connection.
+        virtual size_t BufferedOutput() const {
+            return output.BufferedBytes() + PendingFrames();
+        }
+
+        // HTTP/2 frames queued by the session but not yet in the output.
+        size_t PendingFrames() const {
+            return http2 ? http2->PendingFrames() : 0;
+        }
+
+        // A response is being written to the connection.
+        virtual bool Writing() const { return !output.Empty(); }
+
+        ConnectionId id = 0;
+        SOCKET socket = INVALID_SOCKET;
+        ReadBuffer input;
+        OutputQueue output;
+
+        // Parses the HTTP/1.x request at the start of input as it arrives.
+        RequestParser parser;
+
+        // No further requests are taken from the connection, it is closed
+        // once everything outstanding has been written.
+        bool closing = false;
+
+        // The client has shut down its side, no more input will arrive.
+        bool peerClosed = false;
+
+        unsigned int requestsServed = 0;
+
+        // Requests are numbered as they are dispatched. Responses that
+        // complete out of order are held until every earlier response has
+        // been queued.
+        uint64_t nextSequence = 0;
+        uint64_t nextSequenceToSend = 0;
+        std::map<uint64_t, CompletedResponse> readyResponses;
+
+        // Streamed response waiting for its last chunks to be written
+        // before the next ones are produced. It keeps its place in the
+        // sequence until the terminating chunk has been queued.
+        std::unique_ptr<Response> streaming;
+
+        // Requests are being held back until output across the server has
+        // drained below its limit and memory use across the process has
+        // fallen below its budget.
+        bool held = false;
+
+        // Nothing is read from the connection until it is no longer held.
+        bool readPaused = false;
+
+        std::chrono::steady_clock::time_point lastActivity;
+
+        // When the client last read some of the output, or when output
+        // started waiting for it.
+        std::chrono::steady_clock::time_point lastWrite;
+
+        // When the first bytes of the partly received request arrived, and
+        // when its headers were complete. Unset between requests.
+        std::chrono::steady_clock::time_point requestStarted;
+        std::chrono::steady_clock::time_point bodyStarted;
+
+        // Expires when the connection has waited too long for the client.
+        TimerWheel::Timer timer;
+
+        // Set once the connection has switched to HTTP/2, requests are then
+        // numbered by their stream.
+        std::unique_ptr<Http2Session> http2;
+
+        // Frames are being written, further frames are added by the loop
+        // doing so rather than by a nested call.
+        bool sendingFrames = false;
+
+        // Set when the connection is served over TLS, nothing is read from
+        // the connection until its handshake has completed.
+        std::unique_ptr<TlsSession> tls;
+
+        // A WebSocket handshake or event stream request is with a worker, no
+        // further requests are taken from the connection until it has been
+        // answered.
+        bool upgrading = false;
+
+        // Set once the connection has switched to WebSocket. Messages are
+        // handed to the workers one at a time, the next being read once the
+        // handler of the last has returned.
+        std::unique_ptr<WebSocketCodec> webSocketCodec;
+        std::shared_ptr<WebSocket> webSocket;
+        bool handlingMessage = false;
+
+        // A close frame has been queued, nothing more is sent after it.
+        bool closeSent = false;
+
+        // Status the client closed the WebSocket with.
+        uint16_t closeCode = WEBSOCKET_CLOSE_ABNORMAL;
+
+        // Set once the connection has been subscribed to a broadcaster, it
+        // is then only written to.
+        EventBroadcaster *eventStream = nullptr;
+
+        uint64_t Outstanding() const {
+            if (http2) {
+                return http2->ActiveStreams();
+            }
+
+            if (webSocket) {
+                return handlingMessage ? 1 : 0;
+            }
+
+            return nextSequence - nextSequenceToSend;
+        }
+    };
+
+    // Signalled by the workers whenever a response has been completed.
+    int wakeup_fd_;
+
+    // Response bytes held in memory across every connection, shared by
+    // their output queues.
+    size_t buffered_output_;
+
+    TimerWheel timers_;
+
+    // Connections are closed as soon as they are between requests.
+    bool draining_;
+
+    std::unordered_map<ConnectionId, std::unique_ptr<Connection>> connections_;
+
+    void OpenWakeupEvent();
+
+    void CloseWakeupEvent();
+
+    Connection *AddConnection(std::unique_ptr<Connection> connection);
+
+    Connection *FindConnection(ConnectionId id);
+
+    void RemoveConnection(Connection *connection);
+
+    void CloseAllConnections();
+
+    void DrainConnections(std::chrono::steady_clock::time_point deadline);
+
+    virtual bool WriteToConnection(Connection *connection) = 0;
+
+    // Carries on reading from a connection whose reading was paused.
+    virtual void ResumeReading(Connection *connection) = 0;
+
+    virtual void CloseConnection(Connection *connection) = 0;
+
+    bool CloseIfFinished(Connection *connection);
+
+    void UpdateTimer(Connection *connection);
+
+    void ExpireTimers();
+
+    bool BusyPoll(const std::function<bool()> &poll);
+
+    void ResumeHeldConnections();
+
+    bool PauseReading(Connection *connection);
+
+    bool DispatchRequests(Connection *connection);
+
+    bool SendReadyResponses(Connection *connection);
+
+    bool DispatchHttp2Requests(Connection *connection);
+
+    bool SendHttp2Frames(Connection *connection);
+
+    bool OutputDrained(Connection *connection);
+
+    bool DispatchWebSocketMessages(Connection *connection);
+
+    void SendWebSocketClose(Connection *connection, uint16_t code);
+
+    void ProcessCompletedResponses();
+
+ private:
+    struct EventSubscription {
+        uint64_t listener;
+        std::unordered_set<ConnectionId> connections;
+    };
+
+    ConnectionId next_connection_id_;
+
+    // Connections subscribed to each broadcaster, which posts its events to
+    // the reactor through the listener added for them.
+    std::unordered_map<EventBroadcaster *, EventSubscription> subscriptions_;
+
+    // Connections with requests or reading held back by the server wide
+    // output limit or the memory budget.
+    std::vector<ConnectionId> held_connections_;
+
+    // The memory budget was exhausted on the last pass of the reactor.
+    bool memory_exhausted_;
+
+    // Responses handed back from the worker threads to the reactor.
+    std::mutex completed_mutex_;
+    std::vector<CompletedResponse> completed_;
+
+    void HandleRequestOnWorker(ConnectionId connectionId,
+                               uint64_t sequence,
+                               Request *request,
+                               bool keepAlive,
+                               bool http2);
+
+    void ProduceChunksOnWorker(ConnectionId connectionId,
+                               uint64_t sequence,
+                               Response *response,
+                               bool http2);
+
+    ThreadPool *WorkersFor(Request *request);
+
+    ThreadPool *WorkersFor(const Response *response);
+
+    bool UpgradeToHttp2(Connection *connection, Request *request);
+
+    void CompleteHttp2Response(Connection *connection,
+                               CompletedResponse *completed);
+
+    void OpenWebSocketOnWorker(ConnectionId connectionId,
+                               uint64_t sequence,
+                               Request *request,
+                               const WebSocketHandlers *handlers);
+
+    void HandleWebSocketMessageOnWorker(ConnectionId connectionId,
+                                        std::shared_ptr<WebSocket> webSocket,
+                                        WebSocketMessage message);
+
+    void CloseWebSocketOnWorker(std::shared_ptr<WebSocket> webSocket,
+                                uint16_t code);
+
+    void SwitchToWebSocket(Connection *connection,
+                           std::shared_ptr<WebSocket> webSocket);
+
+    void CompleteWebSocketFrames(Connection *connection,
+                                 CompletedResponse *completed);
+
+    void WebSocketGone(std::shared_ptr<WebSocket> webSocket, uint16_t code);
+
+    void OpenEventStreamOnWorker(ConnectionId connectionId,
+                                 uint64_t sequence,
+                                 Request *request,
+                                 const EventStreamFunction *handler);
+
+    void SubscribeToEvents(Connection *connection,
+                           EventBroadcaster *broadcaster);
+
+    void UnsubscribeFromEvents(Connection *connection);
+
+    void BroadcastEvent(EventBroadcaster *broadcaster,
+                        const std::shared_ptr<const std::string> &event);
+
+    bool OutputLimitReached(Connection *connection);
+
+    void ConnectionTimedOut(Connection *connection);
+
+    void PostCompletedResponse(CompletedResponse completed);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_ASYNCSERVERBASE_H_
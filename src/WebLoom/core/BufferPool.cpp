@@ -0,0 +1,133 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <algorithm>
+#include "BufferPool.h"
+
+namespace webloom::core {
+
+// Block sizes of the classes, each four times the previous one.
+constexpr size_t SMALLEST_CLASS_SIZE = 4096;
+constexpr size_t LARGEST_CLASS_SIZE = 1024 * 1024;
+
+// Memory each class may keep for reuse, small classes keep more blocks than
+// large ones but never fewer than MIN_RETAINED_BLOCKS.
+constexpr size_t RETAINED_BYTES_PER_CLASS = 4 * 1024 * 1024;
+constexpr size_t MIN_RETAINED_BLOCKS = 4;
+
+BufferPool::BufferPool() : budget_(nullptr) {
+    for (size_t size = SMALLEST_CLASS_SIZE; size <= LARGEST_CLASS_SIZE;
+         size *= 4) {
+        classes_.push_back({
+            size,
+            std::max(MIN_RETAINED_BLOCKS, RETAINED_BYTES_PER_CLASS / size),
+            {} });
+    }
+}
+
+BufferPool::~BufferPool() {
+    Trim();
+}
+
+/**
+ * @brief Charges the buffers of the pool to a memory budget, which has to
+ *        outlive the pool. Called before any buffer is handed out.
+ */
+void BufferPool::Account(MemoryBudget *budget) {
+    budget_ = budget;
+}
+
+/**
+ * @brief Frees every buffer kept for reuse.
+ */
+void BufferPool::Trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto &sizeClass : classes_) {
+        if (budget_) {
+            budget_->Refund(MemoryBudget::Use::PooledBuffers,
+                            sizeClass.freeBlocks.size() * sizeClass.blockSize);
+        }
+
+        for (char *block : sizeClass.freeBlocks) {
+            delete[] block;
+        }
+        sizeClass.freeBlocks.clear();
+    }
+}
+
+/**
+ * @brief Returns the smallest class whose blocks hold size bytes.
+ *
+ * @return nullptr if the size is larger than every class.
+ */
+BufferPool::SizeClass *BufferPool::FindClass(size_t size) {
+    for (auto &sizeClass : classes_) {
+        if (size <= sizeClass.blockSize) {
+            return &sizeClass;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Hands out a buffer of at least minimumSize bytes.
+ *
+ * The contents of the buffer are not initialised.
+ */
+BufferPool::Block BufferPool::Acquire(size_t minimumSize) {
+    SizeClass *sizeClass = FindClass(minimumSize);
+    size_t size = sizeClass ? sizeClass->blockSize : minimumSize;
+
+    if (budget_) {
+        budget_->Charge(MemoryBudget::Use::ConnectionInput, size);
+
+        // Buffers kept for reuse give way to the ones in use.
+        if (budget_->Exhausted()) {
+            Trim();
+        }
+    }
+
+    if (sizeClass) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!sizeClass->freeBlocks.empty()) {
+            char *data = sizeClass->freeBlocks.back();
+            sizeClass->freeBlocks.pop_back();
+            if (budget_) {
+                budget_->Refund(MemoryBudget::Use::PooledBuffers, size);
+            }
+            return { data, size };
+        }
+    }
+
+    return { new char[size], size };
+}
+
+void BufferPool::Release(Block block) {
+    if (!block.data) {
+        return;
+    }
+
+    if (budget_) {
+        budget_->Refund(MemoryBudget::Use::ConnectionInput, block.capacity);
+    }
+
+    SizeClass *sizeClass = FindClass(block.capacity);
+    if (sizeClass && sizeClass->blockSize == block.capacity &&
+        (!budget_ || budget_->Allows(block.capacity))) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (sizeClass->freeBlocks.size() < sizeClass->maxRetained) {
+            sizeClass->freeBlocks.push_back(block.data);
+            if (budget_) {
+                budget_->Charge(MemoryBudget::Use::PooledBuffers,
+                                block.capacity);
+            }
+            return;
+        }
+    }
+
+    delete[] block.data;
+}
+
+}   // namespace webloom::core
@@ -0,0 +1,66 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_BUFFERPOOL_H_
+#define CORE_BUFFERPOOL_H_
+#include <cstddef>
+#include <mutex>                // NOLINT(build/c++11)
+#include <vector>
+#include "core/MemoryBudget.h"
+
+namespace webloom::core {
+
+/**
+ * @brief Pool of I/O buffers grouped into size classes.
+ *
+ * Buffers released back to the pool are kept for reuse by the next
+ * connection that needs one of the same class, so steady traffic does not
+ * allocate. Requests above the largest class are allocated exactly and freed
+ * on release. The pool may be shared between threads.
+ *
+ * Once accounted to a memory budget, buffers handed out are charged as
+ * connection input and buffers kept for reuse as pooled buffers. Buffers are
+ * only kept whilst they fit within the budget, and are freed once buffers
+ * in use have exhausted it.
+ */
+class BufferPool {
+ public:
+    struct Block {
+        char *data;
+        size_t capacity;
+    };
+
+    BufferPool();
+
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    Block Acquire(size_t minimumSize);
+
+    void Release(Block block);
+
+    void Account(MemoryBudget *budget);
+
+    void Trim();
+
+ private:
+    struct SizeClass {
+        size_t blockSize;
+        size_t maxRetained;
+        std::vector<char *> freeBlocks;
+    };
+
+    std::mutex mutex_;
+    std::vector<SizeClass> classes_;
+
+    // Charged with the buffers handed out and kept, may be null.
+    MemoryBudget *budget_;
+
+    SizeClass *FindClass(size_t size);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_BUFFERPOOL_H_
@@ -0,0 +1,150 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "CpuSet.h"
+
+namespace webloom::core {
+
+constexpr const char* NODE_PREFIX = "node";
+constexpr size_t NODE_PREFIX_LENGTH = 4;
+
+constexpr const char* NODE_CPULIST_DIRECTORY = "/sys/devices/system/node/";
+constexpr const char* NODE_CPULIST_FILE = "/cpulist";
+
+// Highest CPU number accepted, the size of a cpu_set_t.
+constexpr unsigned long MAX_CPU = 1023;
+constexpr size_t MAX_CPU_DIGITS = 4;
+
+static bool IsNumber(const std::string &text, size_t maxDigits) {
+    return !text.empty() && text.size() <= maxDigits &&
+           text.find_first_not_of("0123456789") == std::string::npos;
+}
+
+/**
+ * @throws std::invalid_argument if the list is not valid or names a NUMA
+ *         node that does not exist.
+ */
+CpuSet::CpuSet(const std::string &list) {
+    const bool allowNodes = true;
+    Parse(list, allowNodes);
+
+    if (cpus_.empty()) {
+        throw std::invalid_argument("CPU list '" + list + "' is empty");
+    }
+}
+
+/**
+ * @brief Pins the calling thread to the CPUs of the set, leaving the
+ *        scheduler to choose between them.
+ *
+ * @return false if the thread could not be pinned.
+ */
+bool CpuSet::PinCurrentThread() const {
+    return Pin(cpus_);
+}
+
+/**
+ * @brief Pins the calling thread to one CPU.
+ *
+ * @return false if the thread could not be pinned.
+ */
+bool CpuSet::PinCurrentThread(int cpu) {
+    return Pin({ cpu });
+}
+
+void CpuSet::Parse(const std::string &list, bool allowNodes) {
+    std::istringstream entries(list);
+    std::string entry;
+
+    while (std::getline(entries, entry, ',')) {
+        entry.erase(0, entry.find_first_not_of(" \t\n"));
+        entry.erase(entry.find_last_not_of(" \t\n") + 1);
+
+        if (entry.empty()) {
+            continue;
+        }
+
+        if (allowNodes &&
+            entry.compare(0, NODE_PREFIX_LENGTH, NODE_PREFIX) == 0) {
+            Parse(NodeCpuList(entry.substr(NODE_PREFIX_LENGTH)), false);
+            continue;
+        }
+
+        std::string first = entry;
+        std::string last = entry;
+
+        size_t separator = entry.find('-');
+        if (separator != std::string::npos) {
+            first = entry.substr(0, separator);
+            last = entry.substr(separator + 1);
+        }
+
+        bool valid = IsNumber(first, MAX_CPU_DIGITS) &&
+                     IsNumber(last, MAX_CPU_DIGITS);
+        unsigned long firstCpu = valid ? std::stoul(first) : 0;
+        unsigned long lastCpu = valid ? std::stoul(last) : 0;
+
+        if (!valid || lastCpu > MAX_CPU || firstCpu > lastCpu) {
+            throw std::invalid_argument("Invalid entry '" + entry +
+                                        "' in CPU list");
+        }
+
+        for (auto cpu = firstCpu; cpu <= lastCpu; cpu++) {
+            if (std::find(cpus_.begin(), cpus_.end(),
+                          static_cast<int>(cpu)) == cpus_.end()) {
+                cpus_.push_back(static_cast<int>(cpu));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Reads the CPUs of a NUMA node, in the same form as a CPU list.
+ */
+std::string CpuSet::NodeCpuList(const std::string &node) {
+    std::string cpuList;
+
+    if (IsNumber(node, MAX_CPU_DIGITS)) {
+        std::ifstream file(NODE_CPULIST_DIRECTORY + std::string(NODE_PREFIX) +
+                           node + NODE_CPULIST_FILE);
+        std::getline(file, cpuList);
+    }
+
+    if (cpuList.empty()) {
+        throw std::invalid_argument("Unknown NUMA node '" + node +
+                                    "' in CPU list");
+    }
+
+    return cpuList;
+}
+
+bool CpuSet::Pin(const std::vector<int> &cpus) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+}   // namespace webloom::core
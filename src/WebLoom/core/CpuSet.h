@@ -0,0 +1,52 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_CPUSET_H_
+#define CORE_CPUSET_H_
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace webloom::core {
+
+/**
+ * @brief Set of CPUs that threads are pinned to.
+ *
+ * The set is given as a list of CPUs and ranges, as in "0-3,8,10-11", in
+ * which an entry "nodeN" stands for every CPU of NUMA node N. The CPUs of a
+ * node are read from sysfs, so no NUMA library is needed.
+ *
+ * Memory is placed on the node of the thread that first touches it, so a
+ * thread pinned before it allocates its buffers gets them from its own
+ * node. Pinning is only available on Linux.
+ */
+class CpuSet {
+ public:
+    CpuSet() = default;
+
+    explicit CpuSet(const std::string &list);
+
+    bool Empty() const { return cpus_.empty(); }
+
+    size_t Size() const { return cpus_.size(); }
+
+    // CPU at the position in the set, wrapping round past its end.
+    int Cpu(size_t position) const { return cpus_[position % cpus_.size()]; }
+
+    bool PinCurrentThread() const;
+
+    static bool PinCurrentThread(int cpu);
+
+ private:
+    std::vector<int> cpus_;
+
+    void Parse(const std::string &list, bool allowNodes);
+
+    static std::string NodeCpuList(const std::string &node);
+
+    static bool Pin(const std::vector<int> &cpus);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_CPUSET_H_
@@ -0,0 +1,372 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+#include <sys/epoll.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "EpollServer.h"
+
+namespace webloom::core {
+
+// Identifiers stored in the epoll event data for the non-connection
+// descriptors, connection identifiers are allocated after these. A
+// listening socket is identified by its index with the flag set.
+constexpr ConnectionId WAKEUP_EVENT_ID = 0;
+constexpr ConnectionId FIRST_CONNECTION_ID = 1;
+constexpr ConnectionId LISTENER_EVENT_FLAG = ConnectionId(1) << 63;
+
+constexpr int MAX_EPOLL_EVENTS = 256;
+
+// How long epoll_wait() may block, this bounds how long it takes the
+// reactor to notice that a shutdown has been requested.
+constexpr int EPOLL_WAIT_TIMEOUT_MS = 500;
+
+constexpr size_t READ_CHUNK_SIZE = 16384;
+
+EpollServer::EpollServer(Logger* logger,
+                         WebLoomSettings *settings,
+                         core::FileServer *fileServer)
+    : AsyncServerBase(logger, settings, fileServer, FIRST_CONNECTION_ID),
+      epoll_fd_(-1) {
+}
+
+EpollServer::~EpollServer() {
+}
+
+void EpollServer::InitialiseServerLoop() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1) {
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+
+    OpenWakeupEvent();
+
+    epoll_event event {};
+
+    for (size_t i = 0; i < listeners_.size(); i++) {
+        if (!SetSocketBlocking(listeners_[i].socket, false)) {
+            throw std::runtime_error("Unable to make server socket "
+                                     "non-blocking");
+        }
+
+        // Listening sockets are level-triggered so that connections that
+        // could not be accepted (e.g. out of descriptors) are retried on the
+        // next pass. A socket shared with other worker processes wakes only
+        // one of them for each connection rather than all of them.
+        event.events = EPOLLIN;
+        if (shared_listeners_) {
+            event.events |= EPOLLEXCLUSIVE;
+        }
+        event.data.u64 = LISTENER_EVENT_FLAG | i;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listeners_[i].socket,
+                      &event) == -1) {
+            throw std::runtime_error("Failed to register server socket");
+        }
+    }
+
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = WAKEUP_EVENT_ID;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event) == -1) {
+        throw std::runtime_error("Failed to register reactor wakeup event");
+    }
+
+    logger_->LogInfo("epoll reactor started");
+}
+
+void EpollServer::ServerLoop() {
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int count = 0;
+
+    // Busy polling checks for events without sleeping first, the reactor
+    // then picks them up without waiting to be woken.
+    if (settings_->BusyPollBudget() > 0) {
+        BusyPoll([this, &events, &count]() {
+            count = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, 0);
+            return count != 0;
+        });
+    }
+
+    if (count == 0) {
+        count = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS,
+                           EPOLL_WAIT_TIMEOUT_MS);
+    }
+    if (count == -1) {
+        if (errno == EINTR) {
+            return;
+        }
+        throw std::runtime_error("epoll_wait failed: " +
+                                 std::string(strerror(errno)));
+    }
+
+    for (int i = 0; i < count; i++) {
+        ConnectionId id = events[i].data.u64;
+
+        if (id & LISTENER_EVENT_FLAG) {
+            AcceptConnections(listeners_[id & ~LISTENER_EVENT_FLAG]);
+            continue;
+        }
+
+        if (id == WAKEUP_EVENT_ID) {
+            uint64_t value;
+            while (read(wakeup_fd_, &value, sizeof(value)) > 0) {}
+            ProcessCompletedResponses();
+            continue;
+        }
+
+        // The connection may have been closed by an earlier event in this
+        // batch, so always look it up again.
+        Connection *connection = FindConnection(id);
+        if (!connection) {
+            continue;
+        }
+
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            CloseConnection(connection);
+            continue;
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+            if (!ReadFromConnection(connection)) {
+                continue;
+            }
+        }
+
+        if (events[i].events & EPOLLOUT) {
+            WriteToConnection(connection);
+        }
+    }
+
+    ResumeHeldConnections();
+    ExpireTimers();
+}
+
+void EpollServer::ShutdownServerLoop() {
+    CloseAllConnections();
+    CloseWakeupEvent();
+
+    closesocket(epoll_fd_);
+    epoll_fd_ = -1;
+}
+
+void EpollServer::AcceptConnections(const Listener &listener) {
+    while (true) {
+        SOCKET clientSocket = accept4(listener.socket, nullptr, nullptr,
+                                      SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket == INVALID_SOCKET) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            // EINVAL is a listening socket stopped by RequestShutdown().
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINVAL) {
+                logger_->LogError("Accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+
+        if (ConnectionLimitReached(connections_.size())) {
+            RejectConnection(clientSocket);
+            continue;
+        }
+
+        ConfigureClientSocket(clientSocket, listener);
+
+        auto created = std::make_unique<Connection>(&buffer_pool_,
+                                                    &buffered_output_,
+                                                    memory_budget_);
+        created->socket = clientSocket;
+
+        if (tls_context_) {
+            try {
+                created->tls = std::make_unique<TlsSession>(tls_context_,
+                                                            clientSocket);
+            }
+            catch (std::exception &ex) {
+                logger_->LogError("Dropping connection: %s", ex.what());
+                closesocket(clientSocket);
+                continue;
+            }
+        }
+
+        Connection *connection = AddConnection(std::move(created));
+
+        epoll_event event {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = connection->id;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, clientSocket, &event) == -1) {
+            logger_->LogError("Unable to register connection: %s",
+                              strerror(errno));
+            CloseConnection(connection);
+        }
+    }
+}
+
+/**
+ * @brief Drains the socket of all available data.
+ *
+ * As the connection is edge-triggered the socket has to be read until it
+ * reports EAGAIN, otherwise no further read notifications would be raised.
+ * Reading stops early whilst the memory budget is exhausted, the rest is
+ * read once ResumeReading() is called.
+ *
+ * @param connection Connection to read from.
+ * @return false if the connection was closed, otherwise true.
+ */
+bool EpollServer::ReadFromConnection(Connection *connection) {
+    if (connection->tls && !connection->tls->Established()) {
+        if (!ContinueHandshake(connection)) {
+            return false;
+        }
+
+        if (!connection->tls->Established()) {
+            return true;
+        }
+    }
+
+    if (connection->readPaused) {
+        return true;
+    }
+
+    while (true) {
+        char *space = connection->input.Reserve(READ_CHUNK_SIZE);
+        ssize_t amountRead = connection->tls ?
+            connection->tls->Read(space, connection->input.Available()) :
+            recv(connection->socket, space, connection->input.Available(), 0);
+
+        if (amountRead > 0) {
+            connection->input.Commit(amountRead);
+            if (PauseReading(connection)) {
+                break;
+            }
+            continue;
+        }
+
+        if (amountRead == 0) {
+            // A client that half-closes after sending its requests still
+            // expects the responses.
+            connection->peerClosed = true;
+            break;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+
+        CloseConnection(connection);
+        return false;
+    }
+
+    if (!DispatchRequests(connection)) {
+        return false;
+    }
+
+    return !CloseIfFinished(connection);
+}
+
+void EpollServer::ResumeReading(Connection *connection) {
+    ReadFromConnection(connection);
+}
+
+/**
+ * @brief Writes as much of the pending output as the socket will accept.
+ *
+ * @param connection Connection to write to.
+ * @return false if the connection was closed, otherwise true.
+ */
+bool EpollServer::WriteToConnection(Connection *connection) {
+    // The handshake may be waiting to write, the client's first request is
+    // read as soon as it has completed.
+    if (connection->tls && !connection->tls->Established()) {
+        if (!ContinueHandshake(connection)) {
+            return false;
+        }
+
+        return !connection->tls->Established() ||
+               ReadFromConnection(connection);
+    }
+
+    if (connection->output.Empty()) {
+        return !CloseIfFinished(connection);
+    }
+
+    size_t pending = connection->output.PendingBytes();
+    OutputQueue::WriteResult result = connection->tls ?
+        connection->tls->Write(&connection->output) :
+        connection->output.WriteTo(connection->socket);
+
+    switch (result) {
+        case OutputQueue::WriteResult::Complete:
+            break;
+
+        // Socket buffer is full, wait for the next EPOLLOUT edge.
+        case OutputQueue::WriteResult::WouldBlock:
+            if (connection->output.PendingBytes() < pending) {
+                connection->lastWrite = std::chrono::steady_clock::now();
+                UpdateTimer(connection);
+            }
+            return true;
+
+        case OutputQueue::WriteResult::Failed:
+            CloseConnection(connection);
+            return false;
+    }
+
+    return OutputDrained(connection);
+}
+
+/**
+ * @brief Takes the TLS handshake of the connection as far as the socket
+ *        allows.
+ *
+ * @param connection Connection still in its handshake.
+ * @return false if the handshake failed and the connection was closed,
+ *         otherwise true.
+ */
+bool EpollServer::ContinueHandshake(Connection *connection) {
+    switch (connection->tls->Handshake()) {
+        case TlsSession::Result::Complete:
+            logger_->LogDebug("TLS handshake complete, %s session, kernel "
+                              "encryption %s",
+                              connection->tls->Resumed() ? "resumed" : "new",
+                              connection->tls->KernelSend() ? "on" : "off");
+            return true;
+
+        case TlsSession::Result::WantRead:
+        case TlsSession::Result::WantWrite:
+            return true;
+
+        case TlsSession::Result::Failed:
+            break;
+    }
+
+    logger_->LogDebug("Closing connection, TLS handshake failed");
+    CloseConnection(connection);
+    return false;
+}
+
+void EpollServer::CloseConnection(Connection *connection) {
+    timers_.Cancel(&connection->timer);
+
+    if (connection->tls) {
+        connection->tls->Close();
+    }
+
+    // Closing the descriptor also removes it from the epoll interest list.
+    closesocket(connection->socket);
+    RemoveConnection(connection);
+}
+
+}   // namespace webloom::core
+
+#endif  // WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX
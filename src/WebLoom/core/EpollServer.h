@@ -0,0 +1,57 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_EPOLLSERVER_H_
+#define CORE_EPOLLSERVER_H_
+#include "AsyncServerBase.h"
+
+namespace webloom::core {
+
+/**
+ * @brief Event driven server built around an edge-triggered epoll reactor.
+ *
+ * Every socket is non-blocking and is serviced by the thread that called
+ * Run(). Requests are read and parsed on that thread and only complete
+ * requests are handed to the worker thread pool, so a slow client costs a
+ * connection buffer rather than a blocked worker. Responses produced by the
+ * workers are passed back to the reactor, which writes them out as the
+ * socket becomes writable.
+ *
+ * Connections served over TLS complete their handshake on the reactor as
+ * the socket allows, before anything is read from them.
+ *
+ * This server is only available on Linux.
+ */
+class EpollServer : public AsyncServerBase {
+ public:
+    EpollServer(Logger *logger,
+                WebLoomSettings *settings,
+                core::FileServer *fileServer);
+
+    ~EpollServer();
+
+ private:
+    int epoll_fd_;
+
+    void InitialiseServerLoop();
+
+    void ServerLoop();
+
+    void ShutdownServerLoop();
+
+    void AcceptConnections(const Listener &listener);
+
+    bool ReadFromConnection(Connection *connection);
+
+    void ResumeReading(Connection *connection);
+
+    bool WriteToConnection(Connection *connection);
+
+    bool ContinueHandshake(Connection *connection);
+
+    void CloseConnection(Connection *connection);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_EPOLLSERVER_H_
@@ -1,6 +1,15 @@
 //  WebLoom Framework
 //  Copyright (C) 2024 WebLoom Framework contributors
 //  Released under LGPL 3.0 license (see LICENSE)
+#include "Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include <cerrno>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
@@ -11,7 +20,6 @@
 #include "magic.h"              // NOLINT(build/include_subdir)
 #include "FileServer.h"
 #include "HttpContentType.h"
-#include "Platform.h"
 
 namespace webloom::core {
 
@@ -38,6 +46,14 @@ class FileServer::Implementation {
     bool magic_initialised_;
 };
 
+FileData::~FileData() {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (fileDescriptor != -1) {
+        close(fileDescriptor);
+    }
+#endif
+}
+
 FileServer::FileServer(core::Logger* logger, const char *libmagicFile)
           : implementation_(new Implementation), logger_(logger) {
     // Open a magic cookie (handle) with the option to get MIME type
@@ -117,6 +133,57 @@ std::unique_ptr<FileData> FileServer::ServeFile(const std::string &filename) {
     return fileData;
 }
 
+/**
+ * @brief Opens a file so that it can be sent without reading its contents.
+ *
+ * The returned `FileData` carries the open descriptor and size of the file
+ * rather than its contents, letting the server hand the file to the kernel
+ * with `sendfile()`. On platforms without that the contents are read as by
+ * `ServeFile`.
+ *
+ * @param filename The name of the file to be served.
+ * @return The opened file, or nullptr if it is not a regular file that can
+ *         be read.
+ */
+std::unique_ptr<FileData> FileServer::OpenFile(const std::string &filename) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    auto fileData = std::make_unique<FileData>();
+
+    fileData->fileDescriptor = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fileData->fileDescriptor == -1) {
+        logger_->LogWarn("Unable to serve '%s': %s",
+                         filename.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    struct stat fileStatus;
+    if (fstat(fileData->fileDescriptor, &fileStatus) == -1 ||
+        !S_ISREG(fileStatus.st_mode)) {
+        logger_->LogWarn("Unable to serve '%s' as it is not a regular file",
+                         filename.c_str());
+        return nullptr;
+    }
+    fileData->fileSize = static_cast<size_t>(fileStatus.st_size);
+
+    try {
+        fileData->contentType = HttpContentTypeStringToEnum(
+            DetermineContentType(filename));
+    }
+    catch (std::runtime_error& ex) {
+        logger_->LogError(ex.what());
+        return nullptr;
+    }
+    catch(std::invalid_argument &ex) {
+        logger_->LogError(ex.what());
+        return nullptr;
+    }
+
+    return fileData;
+#else
+    return ServeFile(filename);
+#endif
+}
+
 std::string FileServer::DetermineContentType(const std::string& path) {
     auto extension = GetFileExtension(path);
 
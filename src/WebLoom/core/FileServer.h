@@ -3,6 +3,7 @@
 //  Released under LGPL 3.0 license (see LICENSE)
 #ifndef CORE_FILESERVER_H_
 #define CORE_FILESERVER_H_
+#include <cstddef>
 #include <memory>
 #include <string>
 #include "WebLoomSettings.h"
@@ -12,8 +13,20 @@
 namespace webloom::core {
 
 struct FileData {
+    FileData() = default;
+    ~FileData();
+
+    FileData(const FileData &) = delete;
+    FileData &operator=(const FileData &) = delete;
+
     std::string contents;
     HttpContentType contentType;
+
+    // Set instead of contents when the file has been opened to be sent
+    // without reading it, the descriptor is closed with the FileData unless
+    // ownership is taken by setting it back to -1.
+    int fileDescriptor = -1;
+    size_t fileSize = 0;
 };
 
 class FileServer {
@@ -25,6 +38,8 @@ class FileServer {
 
     std::unique_ptr<FileData> ServeFile(const std::string &filename);
 
+    std::unique_ptr<FileData> OpenFile(const std::string &filename);
+
     std::string DetermineContentType(const std::string& path);
 
  private:
@@ -0,0 +1,487 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "Hpack.h"
+
+namespace webloom::core {
+
+// Octets an entry takes in the dynamic table besides its name and value.
+constexpr size_t ENTRY_OVERHEAD = 32;
+
+// Continuation bytes accepted for an integer, enough for any length or index
+// a peer can legitimately send.
+constexpr unsigned MAX_INTEGER_SHIFT = 28;
+
+constexpr unsigned HUFFMAN_SYMBOLS = 257;
+constexpr unsigned HUFFMAN_EOS = 256;
+constexpr unsigned HUFFMAN_MAX_LENGTH = 30;
+
+struct StaticEntry {
+    const char *name;
+    const char *value;
+};
+
+// RFC 7541 Appendix A, index 1 first.
+constexpr StaticEntry STATIC_TABLE[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+constexpr size_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(StaticEntry);
+
+// Code lengths of RFC 7541 Appendix B. The code is canonical, so the codes
+// themselves follow from the lengths.
+constexpr uint8_t HUFFMAN_CODE_LENGTHS[HUFFMAN_SYMBOLS] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+/**
+ * @brief Canonical Huffman code of HPACK, built once from the code lengths.
+ */
+struct HuffmanCode {
+    // Code of each symbol, right aligned.
+    std::array<uint32_t, HUFFMAN_SYMBOLS> codes;
+
+    // Symbols ordered by code, and for each length the first code of that
+    // length, how many codes have it and where their symbols start.
+    std::array<uint16_t, HUFFMAN_SYMBOLS> symbols;
+    std::array<uint32_t, HUFFMAN_MAX_LENGTH + 1> first_code;
+    std::array<uint32_t, HUFFMAN_MAX_LENGTH + 1> count;
+    std::array<uint32_t, HUFFMAN_MAX_LENGTH + 1> first_symbol;
+
+    HuffmanCode() : codes(), symbols(), first_code(), count(), first_symbol() {
+        for (unsigned symbol = 0; symbol < HUFFMAN_SYMBOLS; symbol++) {
+            symbols[symbol] = static_cast<uint16_t>(symbol);
+            count[HUFFMAN_CODE_LENGTHS[symbol]]++;
+        }
+
+        std::stable_sort(symbols.begin(), symbols.end(),
+                         [](uint16_t a, uint16_t b) {
+            return HUFFMAN_CODE_LENGTHS[a] < HUFFMAN_CODE_LENGTHS[b];
+        });
+
+        uint32_t code = 0;
+        uint32_t position = 0;
+        for (unsigned length = 1; length <= HUFFMAN_MAX_LENGTH; length++) {
+            code = (code + count[length - 1]) << 1;
+            first_code[length] = code;
+            first_symbol[length] = position;
+
+            for (uint32_t i = 0; i < count[length]; i++) {
+                codes[symbols[position + i]] = code + i;
+            }
+            position += count[length];
+        }
+    }
+};
+
+static const HuffmanCode &Huffman() {
+    static const HuffmanCode code;
+    return code;
+}
+
+static void HuffmanDecode(std::string_view input, std::string *output) {
+    const HuffmanCode &huffman = Huffman();
+    uint32_t code = 0;
+    unsigned length = 0;
+
+    for (unsigned char byte : input) {
+        for (int bit = 7; bit >= 0; bit--) {
+            code = (code << 1) | ((byte >> bit) & 1);
+            length++;
+
+            uint32_t rank = code - huffman.first_code[length];
+            if (rank < huffman.count[length]) {
+                uint16_t symbol =
+                    huffman.symbols[huffman.first_symbol[length] + rank];
+                if (symbol == HUFFMAN_EOS) {
+                    throw std::invalid_argument("Huffman string contains EOS");
+                }
+
+                output->push_back(static_cast<char>(symbol));
+                code = 0;
+                length = 0;
+            } else if (length == HUFFMAN_MAX_LENGTH) {
+                throw std::invalid_argument("Invalid Huffman code");
+            }
+        }
+    }
+
+    // Padding is the start of EOS, all ones and shorter than a byte.
+    if (length > 7 || code != (uint32_t(1) << length) - 1) {
+        throw std::invalid_argument("Invalid Huffman padding");
+    }
+}
+
+static size_t HuffmanLength(std::string_view input) {
+    size_t bits = 0;
+    for (unsigned char byte : input) {
+        bits += HUFFMAN_CODE_LENGTHS[byte];
+    }
+
+    return (bits + 7) / 8;
+}
+
+static void HuffmanEncode(std::string_view input, std::string *output) {
+    const HuffmanCode &huffman = Huffman();
+    uint64_t bits = 0;
+    unsigned pending = 0;
+
+    for (unsigned char byte : input) {
+        bits = (bits << HUFFMAN_CODE_LENGTHS[byte]) | huffman.codes[byte];
+        pending += HUFFMAN_CODE_LENGTHS[byte];
+
+        while (pending >= 8) {
+            pending -= 8;
+            output->push_back(static_cast<char>(bits >> pending));
+        }
+    }
+
+    if (pending > 0) {
+        bits = (bits << (8 - pending)) | ((1u << (8 - pending)) - 1);
+        output->push_back(static_cast<char>(bits));
+    }
+}
+
+/**
+ * @brief Reads an integer whose first byte keeps prefixBits low bits.
+ */
+static uint64_t DecodeInteger(std::string_view block, size_t *position,
+                              unsigned prefixBits) {
+    if (*position >= block.size()) {
+        throw std::invalid_argument("Truncated header block");
+    }
+
+    uint64_t limit = (uint64_t(1) << prefixBits) - 1;
+    uint64_t value = static_cast<unsigned char>(block[(*position)++]) & limit;
+    if (value < limit) {
+        return value;
+    }
+
+    for (unsigned shift = 0; ; shift += 7) {
+        if (*position >= block.size()) {
+            throw std::invalid_argument("Truncated header block");
+        }
+        if (shift > MAX_INTEGER_SHIFT) {
+            throw std::invalid_argument("Integer in header block too large");
+        }
+
+        auto byte = static_cast<unsigned char>(block[(*position)++]);
+        value += uint64_t(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+static std::string DecodeString(std::string_view block, size_t *position) {
+    if (*position >= block.size()) {
+        throw std::invalid_argument("Truncated header block");
+    }
+
+    bool huffman = (block[*position] & 0x80) != 0;
+    uint64_t length = DecodeInteger(block, position, 7);
+    if (length > block.size() - *position) {
+        throw std::invalid_argument("Truncated header block");
+    }
+
+    std::string_view data = block.substr(*position, length);
+    *position += length;
+
+    if (!huffman) {
+        return std::string(data);
+    }
+
+    std::string decoded;
+    decoded.reserve(length * 8 / 5);
+    HuffmanDecode(data, &decoded);
+    return decoded;
+}
+
+/**
+ * @brief Adds a response's further header fields to those of an HTTP/2
+ *        response.
+ *
+ * Names are lower cased as HTTP/2 requires. 'Content-Type' has been
+ * added already, and fields about the connection have no meaning once the
+ * protocol frames the response, so neither is added.
+ */
+void AddResponseFields(const Header &header, HeaderList *fields) {
+    static const char *const omitted[] = {
+        "content-type", "content-length", "connection", "keep-alive",
+        "proxy-connection", "transfer-encoding", "upgrade" };
+
+    for (const auto &key : header.AllKeys()) {
+        std::string name = key;
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+
+        if (std::find(std::begin(omitted), std::end(omitted), name) !=
+            std::end(omitted)) {
+            continue;
+        }
+
+        fields->emplace_back(std::move(name), *header.Get(key));
+    }
+}
+
+static void EncodeInteger(uint64_t value, unsigned prefixBits, uint8_t flags,
+                          std::string *block) {
+    uint64_t limit = (uint64_t(1) << prefixBits) - 1;
+    if (value < limit) {
+        block->push_back(static_cast<char>(flags | value));
+        return;
+    }
+
+    block->push_back(static_cast<char>(flags | limit));
+    value -= limit;
+
+    while (value >= 0x80) {
+        block->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    block->push_back(static_cast<char>(value));
+}
+
+static void EncodeString(std::string_view value, std::string *block) {
+    size_t huffmanLength = HuffmanLength(value);
+
+    if (huffmanLength < value.size()) {
+        EncodeInteger(huffmanLength, 7, 0x80, block);
+        HuffmanEncode(value, block);
+    } else {
+        EncodeInteger(value.size(), 7, 0, block);
+        block->append(value);
+    }
+}
+
+/**
+ * @param maxTableSize Dynamic table size the peer's encoder was allowed, the
+ *                     HTTP/2 default is 4096.
+ */
+HpackDecoder::HpackDecoder(size_t maxTableSize)
+    : table_size_(0), table_capacity_(maxTableSize),
+      max_table_size_(maxTableSize) {
+}
+
+/**
+ * @brief Decodes a complete header block, adding its fields to the list.
+ *
+ * @param maxListSize Limit on the decoded size of the fields, counted as
+ *                    SETTINGS_MAX_HEADER_LIST_SIZE counts them.
+ * @throws std::invalid_argument if the block is malformed or too large. The
+ *         dynamic table is then out of step with the peer's, so the
+ *         connection can not continue.
+ */
+void HpackDecoder::Decode(std::string_view block, size_t maxListSize,
+                          HeaderList *fields) {
+    size_t position = 0;
+    size_t listSize = 0;
+    bool fieldSeen = false;
+
+    while (position < block.size()) {
+        auto first = static_cast<unsigned char>(block[position]);
+
+        if ((first & 0xe0) == 0x20) {
+            // Table size updates are only allowed before the first field.
+            uint64_t size = DecodeInteger(block, &position, 5);
+            if (fieldSeen || size > max_table_size_) {
+                throw std::invalid_argument("Invalid table size update");
+            }
+
+            table_capacity_ = size;
+            Evict(table_capacity_);
+            continue;
+        }
+
+        HeaderField field;
+        if (first & 0x80) {
+            field = Lookup(DecodeInteger(block, &position, 7));
+        } else {
+            // Literal with incremental indexing, without indexing or never
+            // indexed, the index of the name being 0 for a literal name.
+            bool indexed = (first & 0xc0) == 0x40;
+            uint64_t nameIndex = DecodeInteger(block, &position,
+                                               indexed ? 6 : 4);
+
+            field.first = nameIndex == 0 ? DecodeString(block, &position) :
+                                           Lookup(nameIndex).first;
+            field.second = DecodeString(block, &position);
+
+            if (indexed) {
+                Insert(field);
+            }
+        }
+
+        listSize += field.first.size() + field.second.size() + ENTRY_OVERHEAD;
+        if (listSize > maxListSize) {
+            throw std::invalid_argument("Header list too large");
+        }
+
+        fields->push_back(std::move(field));
+        fieldSeen = true;
+    }
+}
+
+const HeaderField &HpackDecoder::Lookup(uint64_t index) const {
+    static const std::vector<HeaderField> staticTable = [] {
+        std::vector<HeaderField> table;
+        for (const StaticEntry &entry : STATIC_TABLE) {
+            table.emplace_back(entry.name, entry.value);
+        }
+        return table;
+    }();
+
+    if (index == 0) {
+        throw std::invalid_argument("Invalid header table index");
+    }
+    if (index <= STATIC_TABLE_SIZE) {
+        return staticTable[index - 1];
+    }
+
+    index -= STATIC_TABLE_SIZE + 1;
+    if (index >= dynamic_table_.size()) {
+        throw std::invalid_argument("Invalid header table index");
+    }
+
+    return dynamic_table_[index];
+}
+
+void HpackDecoder::Insert(HeaderField field) {
+    size_t size = field.first.size() + field.second.size() + ENTRY_OVERHEAD;
+
+    // An entry larger than the table empties it and is not added.
+    if (size > table_capacity_) {
+        Evict(0);
+        return;
+    }
+
+    Evict(table_capacity_ - size);
+    table_size_ += size;
+    dynamic_table_.push_front(std::move(field));
+}
+
+void HpackDecoder::Evict(size_t capacity) {
+    while (table_size_ > capacity) {
+        const HeaderField &oldest = dynamic_table_.back();
+        table_size_ -= oldest.first.size() + oldest.second.size() +
+                       ENTRY_OVERHEAD;
+        dynamic_table_.pop_back();
+    }
+}
+
+void HpackEncoder::Encode(const HeaderList &fields, std::string *block) {
+    // Index of each static name, and of each static name with its value.
+    static const auto staticIndex = [] {
+        std::unordered_map<std::string, size_t> index;
+        for (size_t i = STATIC_TABLE_SIZE; i > 0; i--) {
+            const StaticEntry &entry = STATIC_TABLE[i - 1];
+            index[entry.name] = i;
+            index[std::string(entry.name) + '\0' + entry.value] = i;
+        }
+        return index;
+    }();
+
+    for (const HeaderField &field : fields) {
+        auto match = staticIndex.find(field.first + '\0' + field.second);
+        if (match != staticIndex.end()) {
+            EncodeInteger(match->second, 7, 0x80, block);
+            continue;
+        }
+
+        // Literal without indexing.
+        match = staticIndex.find(field.first);
+        if (match != staticIndex.end()) {
+            EncodeInteger(match->second, 4, 0, block);
+        } else {
+            block->push_back(0);
+            EncodeString(field.first, block);
+        }
+
+        EncodeString(field.second, block);
+    }
+}
+
+}   // namespace webloom::core
@@ -0,0 +1,67 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_HPACK_H_
+#define CORE_HPACK_H_
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Header.h"
+
+namespace webloom::core {
+
+using HeaderField = std::pair<std::string, std::string>;
+using HeaderList = std::vector<HeaderField>;
+
+void AddResponseFields(const Header &header, HeaderList *fields);
+
+/**
+ * @brief Decodes HTTP/2 header blocks compressed with HPACK (RFC 7541).
+ *
+ * Each connection has one decoder, and its blocks have to be decoded in the
+ * order they arrived, as they add to and evict from the dynamic table.
+ */
+class HpackDecoder {
+ public:
+    explicit HpackDecoder(size_t maxTableSize);
+
+    void Decode(std::string_view block, size_t maxListSize, HeaderList *fields);
+
+ private:
+    std::deque<HeaderField> dynamic_table_;
+
+    // Octets in the dynamic table, counted the way RFC 7541 counts them.
+    size_t table_size_;
+
+    // Limit set by the encoder's last table size update.
+    size_t table_capacity_;
+
+    // Limit the encoder was given, which updates may not exceed.
+    size_t max_table_size_;
+
+    const HeaderField &Lookup(uint64_t index) const;
+
+    void Insert(HeaderField field);
+
+    void Evict(size_t capacity);
+};
+
+/**
+ * @brief Encodes HTTP/2 header blocks with HPACK.
+ *
+ * Fields are never added to the dynamic table, so the encoder keeps no state
+ * and blocks can be encoded in any order. Fields in the static table are
+ * sent as an index, others as literals that reuse a static name where there
+ * is one, Huffman coded when that is shorter.
+ */
+class HpackEncoder {
+ public:
+    static void Encode(const HeaderList &fields, std::string *block);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_HPACK_H_
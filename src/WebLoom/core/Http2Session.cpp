@@ -0,0 +1,1058 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "Http2Session.h"
+#include "HttpContentType.h"
+
+namespace webloom::core {
+
+constexpr const char* CONNECTION_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+constexpr size_t FRAME_HEADER_LENGTH = 9;
+
+constexpr uint8_t FRAME_DATA = 0x0;
+constexpr uint8_t FRAME_HEADERS = 0x1;
+constexpr uint8_t FRAME_PRIORITY = 0x2;
+constexpr uint8_t FRAME_RST_STREAM = 0x3;
+constexpr uint8_t FRAME_SETTINGS = 0x4;
+constexpr uint8_t FRAME_PUSH_PROMISE = 0x5;
+constexpr uint8_t FRAME_PING = 0x6;
+constexpr uint8_t FRAME_GOAWAY = 0x7;
+constexpr uint8_t FRAME_WINDOW_UPDATE = 0x8;
+constexpr uint8_t FRAME_CONTINUATION = 0x9;
+
+constexpr uint8_t FLAG_END_STREAM = 0x1;
+constexpr uint8_t FLAG_ACK = 0x1;
+constexpr uint8_t FLAG_END_HEADERS = 0x4;
+constexpr uint8_t FLAG_PADDED = 0x8;
+constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+constexpr uint32_t ERROR_NONE = 0x0;
+constexpr uint32_t ERROR_PROTOCOL = 0x1;
+constexpr uint32_t ERROR_INTERNAL = 0x2;
+constexpr uint32_t ERROR_FLOW_CONTROL = 0x3;
+constexpr uint32_t ERROR_STREAM_CLOSED = 0x5;
+constexpr uint32_t ERROR_FRAME_SIZE = 0x6;
+constexpr uint32_t ERROR_REFUSED_STREAM = 0x7;
+constexpr uint32_t ERROR_COMPRESSION = 0x9;
+constexpr uint32_t ERROR_ENHANCE_YOUR_CALM = 0xb;
+
+constexpr size_t PRIORITY_LENGTH = 5;
+constexpr size_t PING_LENGTH = 8;
+constexpr size_t SETTING_LENGTH = 6;
+
+constexpr size_t DEFAULT_MAX_FRAME_SIZE = 16384;
+constexpr size_t LARGEST_MAX_FRAME_SIZE = 16777215;
+constexpr int64_t DEFAULT_WINDOW = 65535;
+constexpr int64_t LARGEST_WINDOW = 0x7fffffff;
+constexpr size_t HEADER_TABLE_SIZE = 4096;
+
+// Window opened to the client for request bodies, on each stream and on the
+// connection. It is topped up once half of it has been used.
+constexpr size_t RECEIVE_WINDOW = 1024 * 1024;
+
+// Streams a client may reset before resets are checked against the streams
+// it opens. Past it, a client resetting more than half of its streams ends
+// the connection, as opening streams only to reset them costs the client
+// next to nothing and the server a worker's time for each.
+constexpr size_t MAX_CLIENT_RESETS = 100;
+
+/**
+ * @brief An error that ends the connection (RFC 9113 section 5.4.1).
+ */
+class ConnectionError : public std::runtime_error {
+ public:
+    ConnectionError(uint32_t code, const char *reason)
+        : std::runtime_error(reason), code_(code) {}
+
+    uint32_t Code() const { return code_; }
+
+ private:
+    uint32_t code_;
+};
+
+static uint32_t ReadUint32(std::string_view data, size_t offset) {
+    auto byte = [&](size_t i) {
+        return static_cast<uint32_t>(static_cast<unsigned char>(data[i]));
+    };
+
+    return byte(offset) << 24 | byte(offset + 1) << 16 |
+           byte(offset + 2) << 8 | byte(offset + 3);
+}
+
+static void AppendUint32(std::string *data, uint32_t value) {
+    data->push_back(static_cast<char>(value >> 24));
+    data->push_back(static_cast<char>(value >> 16));
+    data->push_back(static_cast<char>(value >> 8));
+    data->push_back(static_cast<char>(value));
+}
+
+static void AppendFrameHeader(std::string *frames,
+                              size_t length,
+                              uint8_t type,
+                              uint8_t flags,
+                              uint32_t streamId) {
+    frames->push_back(static_cast<char>(length >> 16));
+    frames->push_back(static_cast<char>(length >> 8));
+    frames->push_back(static_cast<char>(length));
+    frames->push_back(static_cast<char>(type));
+    frames->push_back(static_cast<char>(flags));
+    AppendUint32(frames, streamId);
+}
+
+static void AppendSetting(std::string *payload, uint16_t id, uint32_t value) {
+    payload->push_back(static_cast<char>(id >> 8));
+    payload->push_back(static_cast<char>(id));
+    AppendUint32(payload, value);
+}
+
+static void AppendReset(std::string *frames,
+                        uint32_t streamId,
+                        uint32_t errorCode) {
+    AppendFrameHeader(frames, 4, FRAME_RST_STREAM, 0, streamId);
+    AppendUint32(frames, errorCode);
+}
+
+static std::string_view RemovePadding(uint8_t flags, std::string_view payload) {
+    if ((flags & FLAG_PADDED) == 0) {
+        return payload;
+    }
+
+    if (payload.empty() ||
+        static_cast<unsigned char>(payload[0]) >= payload.size()) {
+        throw ConnectionError(ERROR_PROTOCOL, "Invalid frame padding");
+    }
+
+    size_t padding = static_cast<unsigned char>(payload[0]);
+    return payload.substr(1, payload.size() - 1 - padding);
+}
+
+/**
+ * @brief Decodes base64url without padding, as used by HTTP2-Settings.
+ */
+static bool DecodeBase64Url(const std::string &text, std::string *decoded) {
+    uint32_t bits = 0;
+    unsigned pending = 0;
+
+    for (char c : text) {
+        uint32_t value;
+        if (c >= 'A' && c <= 'Z') {
+            value = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            value = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            value = c - '0' + 52;
+        } else if (c == '-') {
+            value = 62;
+        } else if (c == '_') {
+            value = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+
+        bits = (bits << 6) | value;
+        pending += 6;
+        if (pending >= 8) {
+            pending -= 8;
+            decoded->push_back(static_cast<char>(bits >> pending));
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @param budget Memory budget request bodies are charged to as they arrive.
+ *               May be null.
+ */
+Http2Session::Http2Session(WebLoomSettings *settings, MemoryBudget *budget)
+    : max_header_list_size_(settings->MaxRequestHeaderSize()),
+      max_body_size_(settings->MaxRequestBodySize()),
+      max_concurrent_streams_(settings->MaxConcurrentStreams()),
+      budget_(budget),
+      awaiting_preface_(true), settings_received_(false),
+      decoder_(HEADER_TABLE_SIZE), active_streams_(0), last_stream_id_(0),
+      goaway_stream_id_(0), goaway_sent_(false), streams_opened_(0),
+      client_resets_(0), header_stream_id_(0),
+      header_end_stream_(false), initial_window_(DEFAULT_WINDOW),
+      max_frame_size_(DEFAULT_MAX_FRAME_SIZE),
+      connection_window_(DEFAULT_WINDOW), connection_unacknowledged_(0) {
+}
+
+Http2Session::~Http2Session() {
+    for (auto &entry : streams_) {
+        ReleaseBody(&entry.second);
+    }
+}
+
+/**
+ * @brief Checks whether input received so far could be the start of the
+ *        connection preface.
+ */
+bool Http2Session::MatchesPreface(std::string_view input) {
+    size_t length = std::min(input.size(), PREFACE_LENGTH);
+    return input.substr(0, length) ==
+           std::string_view(CONNECTION_PREFACE, length);
+}
+
+/**
+ * @brief Queues the server's SETTINGS frame, which opens the windows for
+ *        request bodies wider than the protocol's default.
+ */
+void Http2Session::Start() {
+    std::string settings;
+    AppendSetting(&settings, SETTINGS_MAX_CONCURRENT_STREAMS,
+                  static_cast<uint32_t>(max_concurrent_streams_));
+    AppendSetting(&settings, SETTINGS_INITIAL_WINDOW_SIZE, RECEIVE_WINDOW);
+    AppendSetting(&settings, SETTINGS_MAX_HEADER_LIST_SIZE,
+                  static_cast<uint32_t>(max_header_list_size_));
+
+    AppendFrameHeader(&control_, settings.size(), FRAME_SETTINGS, 0, 0);
+    control_ += settings;
+
+    // The connection's window can only be opened with WINDOW_UPDATE.
+    AppendFrameHeader(&control_, 4, FRAME_WINDOW_UPDATE, 0, 0);
+    AppendUint32(&control_, RECEIVE_WINDOW - DEFAULT_WINDOW);
+}
+
+/**
+ * @brief Starts the session on a connection upgraded from HTTP/1.1, the
+ *        request that asked for the upgrade becoming stream 1.
+ *
+ * The request itself is answered by the caller, the session only keeps
+ * track of its stream.
+ *
+ * @param settings The request's HTTP2-Settings header, the client's SETTINGS
+ *                 payload in base64url.
+ * @throws std::invalid_argument if the settings are not valid, the
+ *         connection then has to stay with HTTP/1.1.
+ */
+void Http2Session::StartUpgraded(const std::string &settings) {
+    std::string payload;
+    if (!DecodeBase64Url(settings, &payload)) {
+        throw std::invalid_argument("Invalid HTTP2-Settings header");
+    }
+
+    try {
+        ApplySettings(payload);
+    }
+    catch (ConnectionError &ex) {
+        throw std::invalid_argument(ex.what());
+    }
+
+    Start();
+
+    Stream stream(initial_window_);
+    stream.remoteClosed = true;
+    stream.dispatched = true;
+    stream.withWorker = true;
+    streams_.emplace(1, std::move(stream));
+    active_streams_ = 1;
+    last_stream_id_ = 1;
+    streams_opened_ = 1;
+}
+
+/**
+ * @brief Processes the frames at the start of the input, consuming them.
+ *
+ * A frame that has only partly arrived is left in the input until the rest
+ * of it has been received.
+ *
+ * @param room How many bytes of frames may be queued in reply, to pings
+ *             and settings for example. Once they go past it the remaining
+ *             frames are left in the input, to be processed once the output
+ *             has drained.
+ * @param requests Has the requests whose streams are now complete added.
+ * @return false if the connection has failed. A GOAWAY frame is then
+ *         queued, and the connection is to be closed once it has been sent.
+ */
+bool Http2Session::Receive(ReadBuffer *input,
+                           size_t room,
+                           std::vector<ReceivedRequest> *requests) {
+    size_t queued = control_.size();
+
+    try {
+        if (awaiting_preface_) {
+            if (!MatchesPreface(input->View())) {
+                throw ConnectionError(ERROR_PROTOCOL,
+                                      "Invalid connection preface");
+            }
+            if (input->Size() < PREFACE_LENGTH) {
+                return true;
+            }
+
+            input->Consume(PREFACE_LENGTH);
+            awaiting_preface_ = false;
+        }
+
+        while (input->Size() >= FRAME_HEADER_LENGTH &&
+               control_.size() - queued < room) {
+            std::string_view view = input->View();
+            size_t length = ReadUint32(view, 0) >> 8;
+            auto type = static_cast<uint8_t>(view[3]);
+            auto flags = static_cast<uint8_t>(view[4]);
+            uint32_t streamId = ReadUint32(view, 5) & 0x7fffffff;
+
+            if (length > DEFAULT_MAX_FRAME_SIZE) {
+                throw ConnectionError(ERROR_FRAME_SIZE, "Frame too large");
+            }
+            if (view.size() < FRAME_HEADER_LENGTH + length) {
+                break;
+            }
+
+            ProcessFrame(type, flags, streamId,
+                         view.substr(FRAME_HEADER_LENGTH, length), requests);
+            input->Consume(FRAME_HEADER_LENGTH + length);
+        }
+    }
+    catch (ConnectionError &ex) {
+        error_reason_ = ex.what();
+        QueueGoAway(ex.Code());
+
+        // Nothing more is sent on any of the streams.
+        for (auto &entry : streams_) {
+            ReleaseBody(&entry.second);
+        }
+        streams_.clear();
+        active_streams_ = 0;
+        requests->clear();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Sets the response for a stream, to be framed by Flush().
+ *
+ * Responses for streams the client has reset meanwhile are dropped.
+ *
+ * @param firstChunks The first chunks of a streamed response.
+ * @param moreChunks A streamed response has further chunks to produce.
+ */
+void Http2Session::SubmitResponse(uint32_t streamId,
+                                  std::unique_ptr<Response> response,
+                                  std::string firstChunks,
+                                  bool moreChunks) {
+    auto it = Returned(streamId);
+    if (it == streams_.end()) {
+        return;
+    }
+
+    Stream &stream = it->second;
+    HeaderList fields {
+        { ":status",
+          std::to_string(static_cast<int>(response->StatusCode())) },
+        { "content-type", response->ContentTypeString() }
+    };
+
+    if (!response->Streamed() && !response->BodyOmitted()) {
+        fields.emplace_back("content-length",
+                            std::to_string(response->BodyLength()));
+    } else if (response->StreamLength()) {
+        fields.emplace_back("content-length",
+                            std::to_string(*response->StreamLength()));
+    }
+
+    AddResponseFields(response->ResponseHeader(), &fields);
+
+    HpackEncoder::Encode(fields, &stream.headers);
+    stream.responding = true;
+
+    if (response->Streamed()) {
+        stream.streamed = true;
+        stream.chunks = std::move(firstChunks);
+        stream.moreChunks = moreChunks;
+        if (moreChunks) {
+            stream.response = std::move(response);
+        }
+    } else {
+        stream.response = std::move(response);
+    }
+}
+
+/**
+ * @brief Adds the next chunks of a streamed response.
+ *
+ * @param stream The response, if it has further chunks to produce.
+ */
+void Http2Session::SubmitChunks(uint32_t streamId,
+                                std::string chunks,
+                                std::unique_ptr<Response> stream) {
+    auto it = Returned(streamId);
+    if (it == streams_.end()) {
+        return;
+    }
+
+    Stream &entry = it->second;
+    entry.chunks = std::move(chunks);
+    entry.chunksOffset = 0;
+    entry.moreChunks = static_cast<bool>(stream);
+    entry.response = std::move(stream);
+}
+
+/**
+ * @brief Abandons a stream whose response failed part way.
+ */
+void Http2Session::ResetStream(uint32_t streamId) {
+    auto it = Returned(streamId);
+    if (it != streams_.end()) {
+        QueueReset(streamId, ERROR_INTERNAL);
+        EraseStream(it);
+    }
+}
+
+/**
+ * @brief Frames as much of the responses as flow control and the output
+ *        limit allow, adding the frames to the output.
+ *
+ * Frames that need to be sent for the protocol go first, then the streams
+ * take turns a frame at a time. Nothing is framed for the streams until the
+ * client's SETTINGS have arrived.
+ *
+ * @param room How many bytes of frames may be added, the last frame can go
+ *             past it.
+ * @param wanted Has the streamed responses added whose chunks have all been
+ *               framed, their next chunks are to be produced.
+ */
+void Http2Session::Flush(OutputQueue *output,
+                         size_t room,
+                         ChunkRequests *wanted) {
+    std::string frames;
+    frames.swap(control_);
+
+    // An upgraded connection's first response waits for the client's
+    // SETTINGS, which can change how it may be framed.
+    bool progress = settings_received_;
+    while (progress && frames.size() < room) {
+        progress = false;
+
+        auto it = streams_.begin();
+        while (it != streams_.end() && frames.size() < room) {
+            if (FrameNext(&it, &frames, wanted)) {
+                progress = true;
+            }
+        }
+    }
+
+    if (!frames.empty()) {
+        output->Append(std::move(frames));
+    }
+}
+
+/**
+ * @brief Tells the client that no further streams will be taken on, those
+ *        already open are still answered.
+ */
+void Http2Session::GoAway() {
+    if (!goaway_sent_) {
+        QueueGoAway(ERROR_NONE);
+    }
+}
+
+void Http2Session::ProcessFrame(uint8_t type,
+                                uint8_t flags,
+                                uint32_t streamId,
+                                std::string_view payload,
+                                std::vector<ReceivedRequest> *requests) {
+    // A header block has to be completed before any other frame.
+    if (header_stream_id_ != 0 &&
+        (type != FRAME_CONTINUATION || streamId != header_stream_id_)) {
+        throw ConnectionError(ERROR_PROTOCOL, "Header block interrupted");
+    }
+
+    if (!settings_received_ && type != FRAME_SETTINGS) {
+        throw ConnectionError(ERROR_PROTOCOL, "Preface not followed by "
+                                              "SETTINGS");
+    }
+
+    switch (type) {
+    case FRAME_DATA:
+        ProcessData(flags, streamId, payload, requests);
+        break;
+
+    case FRAME_HEADERS:
+        ProcessHeaders(flags, streamId, payload, requests);
+        break;
+
+    case FRAME_PRIORITY:
+        // Responses are sent in turns, priorities are not used.
+        if (streamId == 0) {
+            throw ConnectionError(ERROR_PROTOCOL, "PRIORITY on stream 0");
+        }
+        if (payload.size() != PRIORITY_LENGTH) {
+            QueueReset(streamId, ERROR_FRAME_SIZE);
+        }
+        break;
+
+    case FRAME_RST_STREAM: {
+        if (streamId == 0 || streamId > last_stream_id_) {
+            throw ConnectionError(ERROR_PROTOCOL, "RST_STREAM on idle "
+                                                  "stream");
+        }
+        if (payload.size() != 4) {
+            throw ConnectionError(ERROR_FRAME_SIZE, "Invalid RST_STREAM");
+        }
+
+        client_resets_++;
+        if (client_resets_ > MAX_CLIENT_RESETS &&
+            client_resets_ * 2 > streams_opened_) {
+            throw ConnectionError(ERROR_ENHANCE_YOUR_CALM, "Too many streams "
+                                                           "reset");
+        }
+
+        auto it = streams_.find(streamId);
+        if (it != streams_.end()) {
+            EraseStream(it);
+        }
+        break;
+    }
+
+    case FRAME_SETTINGS:
+        if (streamId != 0) {
+            throw ConnectionError(ERROR_PROTOCOL, "SETTINGS on a stream");
+        }
+        ProcessSettings(flags, payload);
+        break;
+
+    case FRAME_PUSH_PROMISE:
+        throw ConnectionError(ERROR_PROTOCOL, "PUSH_PROMISE from client");
+
+    case FRAME_PING:
+        if (streamId != 0) {
+            throw ConnectionError(ERROR_PROTOCOL, "PING on a stream");
+        }
+        if (payload.size() != PING_LENGTH) {
+            throw ConnectionError(ERROR_FRAME_SIZE, "Invalid PING");
+        }
+
+        if ((flags & FLAG_ACK) == 0) {
+            AppendFrameHeader(&control_, PING_LENGTH, FRAME_PING, FLAG_ACK, 0);
+            control_.append(payload);
+        }
+        break;
+
+    case FRAME_GOAWAY:
+        // The client opens no more streams and closes the connection once
+        // it has its responses.
+        if (streamId != 0) {
+            throw ConnectionError(ERROR_PROTOCOL, "GOAWAY on a stream");
+        }
+        break;
+
+    case FRAME_WINDOW_UPDATE:
+        ProcessWindowUpdate(streamId, payload);
+        break;
+
+    case FRAME_CONTINUATION:
+        if (header_stream_id_ == 0) {
+            throw ConnectionError(ERROR_PROTOCOL, "CONTINUATION without "
+                                                  "HEADERS");
+        }
+
+        header_block_.append(payload);
+        if (header_block_.size() > max_header_list_size_) {
+            throw ConnectionError(ERROR_ENHANCE_YOUR_CALM, "Header block "
+                                                           "too large");
+        }
+
+        if (flags & FLAG_END_HEADERS) {
+            ProcessHeaderBlock(requests);
+        }
+        break;
+
+    default:
+        // Unknown frame types are ignored.
+        break;
+    }
+}
+
+void Http2Session::ProcessData(uint8_t flags,
+                               uint32_t streamId,
+                               std::string_view payload,
+                               std::vector<ReceivedRequest> *requests) {
+    if (streamId == 0) {
+        throw ConnectionError(ERROR_PROTOCOL, "DATA on stream 0");
+    }
+
+    // Flow control counts the whole payload, padding included.
+    connection_unacknowledged_ += payload.size();
+    Acknowledge(0, &connection_unacknowledged_);
+
+    std::string_view data = RemovePadding(flags, payload);
+
+    auto it = streams_.find(streamId);
+    if (it == streams_.end() || it->second.remoteClosed) {
+        if (streamId > last_stream_id_) {
+            throw ConnectionError(ERROR_PROTOCOL, "DATA on idle stream");
+        }
+
+        QueueReset(streamId, ERROR_STREAM_CLOSED);
+        if (it != streams_.end()) {
+            EraseStream(it);
+        }
+        return;
+    }
+
+    Stream &stream = it->second;
+
+    // A body over the limit is answered straight away, the rest of it is
+    // discarded as it arrives.
+    if (!stream.bodyTooLarge) {
+        if (stream.body.size() + data.size() > max_body_size_) {
+            stream.bodyTooLarge = true;
+            ReleaseBody(&stream);
+            HandOut(streamId, &stream, requests);
+        } else {
+            stream.body.append(data);
+            if (budget_) {
+                budget_->Charge(MemoryBudget::Use::RequestBodies,
+                                data.size());
+            }
+        }
+    }
+
+    if (flags & FLAG_END_STREAM) {
+        stream.remoteClosed = true;
+        HandOut(streamId, &stream, requests);
+    } else {
+        stream.unacknowledged += payload.size();
+        Acknowledge(streamId, &stream.unacknowledged);
+    }
+}
+
+void Http2Session::ProcessHeaders(uint8_t flags,
+                                  uint32_t streamId,
+                                  std::string_view payload,
+                                  std::vector<ReceivedRequest> *requests) {
+    if (streamId == 0 || streamId % 2 == 0) {
+        throw ConnectionError(ERROR_PROTOCOL, "HEADERS on a server stream");
+    }
+
+    std::string_view block = RemovePadding(flags, payload);
+
+    if (flags & FLAG_PRIORITY) {
+        if (block.size() < PRIORITY_LENGTH) {
+            throw ConnectionError(ERROR_FRAME_SIZE, "Invalid HEADERS");
+        }
+        block.remove_prefix(PRIORITY_LENGTH);
+    }
+
+    if (block.size() > max_header_list_size_) {
+        throw ConnectionError(ERROR_ENHANCE_YOUR_CALM, "Header block too "
+                                                       "large");
+    }
+
+    header_block_.assign(block);
+    header_stream_id_ = streamId;
+    header_end_stream_ = (flags & FLAG_END_STREAM) != 0;
+
+    if (flags & FLAG_END_HEADERS) {
+        ProcessHeaderBlock(requests);
+    }
+}
+
+/**
+ * @brief Opens a stream with the header block just received, or ends one
+ *        with its trailers.
+ *
+ * Every block has to be decoded, even for a stream that is then refused,
+ * for the decoder to stay in step with the client's encoder.
+ */
+void Http2Session::ProcessHeaderBlock(std::vector<ReceivedRequest> *requests) {
+    uint32_t streamId = header_stream_id_;
+    header_stream_id_ = 0;
+
+    HeaderList fields;
+    try {
+        decoder_.Decode(header_block_, max_header_list_size_, &fields);
+    }
+    catch (std::invalid_argument &ex) {
+        throw ConnectionError(ERROR_COMPRESSION, ex.what());
+    }
+    header_block_.clear();
+
+    auto it = streams_.find(streamId);
+    if (it != streams_.end()) {
+        // Trailers, which end the request. Their fields are not used.
+        Stream &stream = it->second;
+        if (stream.remoteClosed) {
+            throw ConnectionError(ERROR_STREAM_CLOSED, "HEADERS on closed "
+                                                       "stream");
+        }
+        if (!header_end_stream_) {
+            throw ConnectionError(ERROR_PROTOCOL, "Trailers without "
+                                                  "END_STREAM");
+        }
+
+        stream.remoteClosed = true;
+        HandOut(streamId, &stream, requests);
+        return;
+    }
+
+    if (streamId <= last_stream_id_) {
+        throw ConnectionError(ERROR_STREAM_CLOSED, "HEADERS on closed "
+                                                   "stream");
+    }
+    last_stream_id_ = streamId;
+    streams_opened_++;
+
+    if ((goaway_sent_ && streamId > goaway_stream_id_) ||
+        streams_.size() >= max_concurrent_streams_) {
+        QueueReset(streamId, ERROR_REFUSED_STREAM);
+        return;
+    }
+
+    Stream &stream = streams_.emplace(streamId, Stream(initial_window_))
+                         .first->second;
+    stream.fields = std::move(fields);
+
+    if (header_end_stream_) {
+        stream.remoteClosed = true;
+        HandOut(streamId, &stream, requests);
+    }
+}
+
+void Http2Session::ProcessSettings(uint8_t flags, std::string_view payload) {
+    if (flags & FLAG_ACK) {
+        if (!payload.empty()) {
+            throw ConnectionError(ERROR_FRAME_SIZE, "Invalid SETTINGS ACK");
+        }
+        return;
+    }
+
+    ApplySettings(payload);
+    settings_received_ = true;
+
+    AppendFrameHeader(&control_, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+}
+
+void Http2Session::ApplySettings(std::string_view payload) {
+    if (payload.size() % SETTING_LENGTH != 0) {
+        throw ConnectionError(ERROR_FRAME_SIZE, "Invalid SETTINGS");
+    }
+
+    for (size_t i = 0; i < payload.size(); i += SETTING_LENGTH) {
+        auto id = static_cast<uint16_t>(ReadUint32(payload, i) >> 16);
+        uint32_t value = ReadUint32(payload, i + 2);
+
+        switch (id) {
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1) {
+                throw ConnectionError(ERROR_PROTOCOL, "Invalid "
+                                                      "SETTINGS_ENABLE_PUSH");
+            }
+            break;
+
+        case SETTINGS_INITIAL_WINDOW_SIZE: {
+            if (value > LARGEST_WINDOW) {
+                throw ConnectionError(ERROR_FLOW_CONTROL, "Invalid "
+                                      "SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+
+            // Applies to the streams already open as well, none of whose
+            // windows may go past the largest.
+            int64_t delta = static_cast<int64_t>(value) - initial_window_;
+            for (auto &entry : streams_) {
+                entry.second.sendWindow += delta;
+                if (entry.second.sendWindow > LARGEST_WINDOW) {
+                    throw ConnectionError(ERROR_FLOW_CONTROL, "Stream window "
+                                                              "too large");
+                }
+            }
+            initial_window_ = value;
+            break;
+        }
+
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < DEFAULT_MAX_FRAME_SIZE ||
+                value > LARGEST_MAX_FRAME_SIZE) {
+                throw ConnectionError(ERROR_PROTOCOL, "Invalid "
+                                      "SETTINGS_MAX_FRAME_SIZE");
+            }
+            max_frame_size_ = value;
+            break;
+
+        default:
+            // The header table size does not matter as responses are
+            // encoded without the dynamic table, the other settings only
+            // restrict what a client may send.
+            break;
+        }
+    }
+}
+
+void Http2Session::ProcessWindowUpdate(uint32_t streamId,
+                                       std::string_view payload) {
+    if (payload.size() != 4) {
+        throw ConnectionError(ERROR_FRAME_SIZE, "Invalid WINDOW_UPDATE");
+    }
+
+    int64_t increment = ReadUint32(payload, 0) & 0x7fffffff;
+
+    if (streamId == 0) {
+        connection_window_ += increment;
+        if (increment == 0 || connection_window_ > LARGEST_WINDOW) {
+            throw ConnectionError(ERROR_FLOW_CONTROL, "Invalid connection "
+                                                      "WINDOW_UPDATE");
+        }
+        return;
+    }
+
+    // The server opens no streams of its own.
+    if (streamId > last_stream_id_ || streamId % 2 == 0) {
+        throw ConnectionError(ERROR_PROTOCOL, "WINDOW_UPDATE on idle stream");
+    }
+
+    // Updates may still arrive for streams that have just been closed.
+    auto it = streams_.find(streamId);
+    if (it == streams_.end()) {
+        return;
+    }
+
+    it->second.sendWindow += increment;
+    if (increment == 0 || it->second.sendWindow > LARGEST_WINDOW) {
+        QueueReset(streamId, ERROR_FLOW_CONTROL);
+        EraseStream(it);
+    }
+}
+
+/**
+ * @brief Hands out the request of a stream, if it has not been already.
+ */
+void Http2Session::HandOut(uint32_t streamId,
+                           Stream *stream,
+                           std::vector<ReceivedRequest> *requests) {
+    if (stream->dispatched) {
+        return;
+    }
+
+    stream->dispatched = true;
+    stream->withWorker = true;
+    active_streams_++;
+
+    // From here on the body is charged by whoever handles the request.
+    if (budget_) {
+        budget_->Refund(MemoryBudget::Use::RequestBodies,
+                        stream->body.size());
+    }
+
+    requests->push_back({ streamId,
+                          std::move(stream->fields),
+                          std::move(stream->body),
+                          stream->bodyTooLarge });
+    stream->body.clear();
+}
+
+/**
+ * @brief Drops the part of a request body received so far.
+ */
+void Http2Session::ReleaseBody(Stream *stream) {
+    if (budget_) {
+        budget_->Refund(MemoryBudget::Use::RequestBodies,
+                        stream->body.size());
+    }
+    stream->body.clear();
+}
+
+/**
+ * @brief Finds a stream that a worker is done with, dropping it if it was
+ *        reset meanwhile.
+ *
+ * @return The stream, or the end of the streams if it is gone.
+ */
+std::map<uint32_t, Http2Session::Stream>::iterator Http2Session::Returned(
+    uint32_t streamId) {
+    auto it = streams_.find(streamId);
+    if (it == streams_.end()) {
+        return it;
+    }
+
+    it->second.withWorker = false;
+    if (it->second.reset) {
+        EraseStream(it);
+        return streams_.end();
+    }
+
+    return it;
+}
+
+/**
+ * @brief Opens the client's window again once half of it has been used.
+ */
+void Http2Session::Acknowledge(uint32_t streamId, size_t *unacknowledged) {
+    if (*unacknowledged < RECEIVE_WINDOW / 2) {
+        return;
+    }
+
+    AppendFrameHeader(&control_, 4, FRAME_WINDOW_UPDATE, 0, streamId);
+    AppendUint32(&control_, static_cast<uint32_t>(*unacknowledged));
+    *unacknowledged = 0;
+}
+
+/**
+ * @brief Frames the next part of a stream's response, if it has one ready
+ *        and may send it, and moves on to the next stream.
+ *
+ * @return true if a frame was added.
+ */
+bool Http2Session::FrameNext(std::map<uint32_t, Stream>::iterator *it,
+                             std::string *frames,
+                             ChunkRequests *wanted) {
+    uint32_t streamId = (*it)->first;
+    Stream &stream = (*it)->second;
+
+    if (!stream.responding) {
+        ++*it;
+        return false;
+    }
+
+    size_t remaining = stream.streamed ?
+        stream.chunks.size() - stream.chunksOffset :
+        stream.response->BodyLength() - stream.bodyOffset;
+    bool last = !stream.moreChunks;
+
+    if (!stream.headers.empty()) {
+        bool end = remaining == 0 && last;
+        AppendFrameHeader(frames, stream.headers.size(), FRAME_HEADERS,
+                          FLAG_END_HEADERS | (end ? FLAG_END_STREAM : 0),
+                          streamId);
+        frames->append(stream.headers);
+        stream.headers.clear();
+
+        *it = end ? FinishStream(*it, frames) : std::next(*it);
+        return true;
+    }
+
+    // A streamed response can end without a final chunk.
+    if (remaining == 0 && last) {
+        AppendFrameHeader(frames, 0, FRAME_DATA, FLAG_END_STREAM, streamId);
+        *it = FinishStream(*it, frames);
+        return true;
+    }
+
+    int64_t window = std::max<int64_t>(
+        std::min(connection_window_, stream.sendWindow), 0);
+    size_t length = std::min({ remaining, max_frame_size_,
+                               static_cast<size_t>(window) });
+
+    if (length == 0) {
+        if (remaining == 0 && !stream.withWorker) {
+            stream.withWorker = true;
+            wanted->emplace_back(streamId, std::move(stream.response));
+        }
+
+        ++*it;
+        return false;
+    }
+
+    bool end = length == remaining && last;
+    size_t frameStart = frames->size();
+    AppendFrameHeader(frames, length, FRAME_DATA,
+                      end ? FLAG_END_STREAM : 0, streamId);
+
+    if (stream.streamed) {
+        frames->append(stream.chunks, stream.chunksOffset, length);
+        stream.chunksOffset += length;
+    } else if (stream.response->FileDescriptor() == -1) {
+        frames->append(stream.response->Body(), stream.bodyOffset, length);
+        stream.bodyOffset += length;
+    } else {
+        // Each frame needs its header in front of the data, so unlike with
+        // HTTP/1.x the file is read rather than sent from the page cache.
+        frames->resize(frameStart + FRAME_HEADER_LENGTH + length);
+        ssize_t result = pread(stream.response->FileDescriptor(),
+                               &(*frames)[frameStart + FRAME_HEADER_LENGTH],
+                               length, stream.bodyOffset);
+
+        if (result != static_cast<ssize_t>(length)) {
+            frames->resize(frameStart);
+            AppendReset(frames, streamId, ERROR_INTERNAL);
+            *it = EraseStream(*it);
+            return true;
+        }
+        stream.bodyOffset += length;
+    }
+
+    connection_window_ -= length;
+    stream.sendWindow -= length;
+
+    *it = end ? FinishStream(*it, frames) : std::next(*it);
+    return true;
+}
+
+/**
+ * @brief Closes a stream whose response has been framed in full.
+ *
+ * A client still sending the request, answered early, is told to stop.
+ */
+std::map<uint32_t, Http2Session::Stream>::iterator Http2Session::FinishStream(
+    std::map<uint32_t, Stream>::iterator it,
+    std::string *frames) {
+    if (!it->second.remoteClosed) {
+        AppendReset(frames, it->first, ERROR_NONE);
+    }
+
+    return EraseStream(it);
+}
+
+/**
+ * @brief Closes a stream. A stream still with a worker is only reset, and
+ *        dropped once the worker is done with it.
+ *
+ * @return The next stream.
+ */
+std::map<uint32_t, Http2Session::Stream>::iterator Http2Session::EraseStream(
+    std::map<uint32_t, Stream>::iterator it) {
+    Stream &stream = it->second;
+    if (stream.withWorker) {
+        stream.reset = true;
+        stream.remoteClosed = true;
+        stream.responding = false;
+        ReleaseBody(&stream);
+        stream.headers.clear();
+        stream.chunks.clear();
+        stream.response.reset();
+        return std::next(it);
+    }
+
+    if (stream.dispatched) {
+        active_streams_--;
+    }
+
+    ReleaseBody(&stream);
+    return streams_.erase(it);
+}
+
+void Http2Session::QueueReset(uint32_t streamId, uint32_t errorCode) {
+    AppendReset(&control_, streamId, errorCode);
+}
+
+void Http2Session::QueueGoAway(uint32_t errorCode) {
+    AppendFrameHeader(&control_, 8, FRAME_GOAWAY, 0, 0);
+    AppendUint32(&control_, last_stream_id_);
+    AppendUint32(&control_, errorCode);
+
+    goaway_sent_ = true;
+    goaway_stream_id_ = last_stream_id_;
+}
+
+}   // namespace webloom::core
+
+#endif  // WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX
@@ -0,0 +1,236 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_HTTP2SESSION_H_
+#define CORE_HTTP2SESSION_H_
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Response.h"
+#include "WebLoomSettings.h"
+#include "core/Hpack.h"
+#include "core/MemoryBudget.h"
+#include "core/OutputQueue.h"
+#include "core/ReadBuffer.h"
+
+namespace webloom::core {
+
+/**
+ * @brief Server side of one HTTP/2 connection (RFC 9113), without the I/O.
+ *
+ * The session is fed the bytes received from the client and hands out each
+ * request once its stream has arrived in full. Responses are submitted by
+ * stream and framed as flow control allows, with the DATA frames of every
+ * stream interleaved so that a large or slow response does not hold back
+ * the others. Streamed responses have their next chunks asked for once the
+ * previous ones have been framed.
+ *
+ * Request bodies are charged to the memory budget, if there is one, until
+ * they are handed out. Errors that end the connection queue a GOAWAY
+ * frame. The session belongs
+ * to the reactor thread and is not thread safe.
+ */
+class Http2Session {
+ public:
+    // Length of the connection preface a client starts with.
+    static constexpr size_t PREFACE_LENGTH = 24;
+
+    struct ReceivedRequest {
+        uint32_t streamId;
+        HeaderList fields;
+        std::string body;
+
+        // The body went over the size limit and was dropped, the request
+        // is to be answered with 413 Payload Too Large.
+        bool bodyTooLarge;
+    };
+
+    // Streamed responses whose next chunks are to be produced, by stream.
+    using ChunkRequests =
+        std::vector<std::pair<uint32_t, std::unique_ptr<Response>>>;
+
+    explicit Http2Session(WebLoomSettings *settings,
+                          MemoryBudget *budget = nullptr);
+
+    ~Http2Session();
+
+    Http2Session(const Http2Session &) = delete;
+    Http2Session &operator=(const Http2Session &) = delete;
+
+    static bool MatchesPreface(std::string_view input);
+
+    void Start();
+
+    void StartUpgraded(const std::string &settings);
+
+    bool Receive(ReadBuffer *input,
+                 size_t room,
+                 std::vector<ReceivedRequest> *requests);
+
+    void SubmitResponse(uint32_t streamId,
+                        std::unique_ptr<Response> response,
+                        std::string firstChunks,
+                        bool moreChunks);
+
+    void SubmitChunks(uint32_t streamId,
+                      std::string chunks,
+                      std::unique_ptr<Response> stream);
+
+    void ResetStream(uint32_t streamId);
+
+    void Flush(OutputQueue *output, size_t room, ChunkRequests *wanted);
+
+    void GoAway();
+
+    // Requests handed out whose responses have not been sent in full.
+    size_t ActiveStreams() const { return active_streams_; }
+
+    // Bytes of frames queued ahead of the responses, not yet flushed.
+    size_t PendingFrames() const { return control_.size(); }
+
+    const std::string &ErrorReason() const { return error_reason_; }
+
+ private:
+    struct Stream {
+        explicit Stream(int64_t window) : sendWindow(window) {}
+
+        HeaderList fields;
+        std::string body;
+
+        // The client has sent all of the request.
+        bool remoteClosed = false;
+
+        // The request has been handed out.
+        bool dispatched = false;
+
+        // The request or the next chunks of its response are with a worker.
+        // The stream stays open until the worker is done, even once it has
+        // been reset, so that it still counts against the stream limit.
+        bool withWorker = false;
+
+        // The stream has been reset whilst with a worker, nothing more is
+        // sent on it.
+        bool reset = false;
+
+        bool bodyTooLarge = false;
+
+        // Request bytes received since the stream's window was last opened.
+        size_t unacknowledged = 0;
+
+        // How much more the client lets the stream send.
+        int64_t sendWindow;
+
+        // Header block of the response, until its HEADERS frame is sent.
+        std::string headers;
+        bool responding = false;
+
+        // Response whose body is sent from memory or a file, or a streamed
+        // response whilst it is not with a worker.
+        std::unique_ptr<Response> response;
+        size_t bodyOffset = 0;
+
+        // Chunks of a streamed response not yet framed.
+        bool streamed = false;
+        std::string chunks;
+        size_t chunksOffset = 0;
+        bool moreChunks = false;
+    };
+
+    size_t max_header_list_size_;
+    size_t max_body_size_;
+    size_t max_concurrent_streams_;
+
+    MemoryBudget *budget_;
+
+    bool awaiting_preface_;
+    bool settings_received_;
+
+    HpackDecoder decoder_;
+
+    std::map<uint32_t, Stream> streams_;
+    size_t active_streams_;
+
+    // Highest stream the client has opened, and the last one taken on once
+    // GOAWAY has been sent.
+    uint32_t last_stream_id_;
+    uint32_t goaway_stream_id_;
+    bool goaway_sent_;
+
+    // Streams opened and reset by the client.
+    size_t streams_opened_;
+    size_t client_resets_;
+
+    // Header block being received over HEADERS and CONTINUATION frames.
+    std::string header_block_;
+    uint32_t header_stream_id_;
+    bool header_end_stream_;
+
+    // Settings of the client.
+    int64_t initial_window_;
+    size_t max_frame_size_;
+
+    int64_t connection_window_;
+    size_t connection_unacknowledged_;
+
+    // Frames that go out ahead of any response data.
+    std::string control_;
+
+    std::string error_reason_;
+
+    void ProcessFrame(uint8_t type,
+                      uint8_t flags,
+                      uint32_t streamId,
+                      std::string_view payload,
+                      std::vector<ReceivedRequest> *requests);
+
+    void ProcessData(uint8_t flags,
+                     uint32_t streamId,
+                     std::string_view payload,
+                     std::vector<ReceivedRequest> *requests);
+
+    void ProcessHeaders(uint8_t flags,
+                        uint32_t streamId,
+                        std::string_view payload,
+                        std::vector<ReceivedRequest> *requests);
+
+    void ProcessHeaderBlock(std::vector<ReceivedRequest> *requests);
+
+    void ProcessSettings(uint8_t flags, std::string_view payload);
+
+    void ApplySettings(std::string_view payload);
+
+    void ProcessWindowUpdate(uint32_t streamId, std::string_view payload);
+
+    void HandOut(uint32_t streamId,
+                 Stream *stream,
+                 std::vector<ReceivedRequest> *requests);
+
+    void ReleaseBody(Stream *stream);
+
+    void Acknowledge(uint32_t streamId, size_t *unacknowledged);
+
+    std::map<uint32_t, Stream>::iterator Returned(uint32_t streamId);
+
+    bool FrameNext(std::map<uint32_t, Stream>::iterator *it,
+                   std::string *frames,
+                   ChunkRequests *wanted);
+
+    std::map<uint32_t, Stream>::iterator FinishStream(
+        std::map<uint32_t, Stream>::iterator it,
+        std::string *frames);
+
+    std::map<uint32_t, Stream>::iterator EraseStream(
+        std::map<uint32_t, Stream>::iterator it);
+
+    void QueueReset(uint32_t streamId, uint32_t errorCode);
+
+    void QueueGoAway(uint32_t errorCode);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_HTTP2SESSION_H_
@@ -1,144 +1,491 @@
 //  WebLoom Framework
 //  Copyright (C) 2024 WebLoom Framework contributors
 //  Released under LGPL 3.0 license (see LICENSE)
+#include <algorithm>
+#include <cerrno>
+#include <chrono>               // NOLINT(build/c++11)
+#include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>               // NOLINT(build/c++11)
 #include <utility>
-#include <vector>
 #include "HttpServer.h"
-#include "core/ThreadPool.h"
-#include "Response.h"
 #include "core/HttpStatus.h"
+#include "core/OutputQueue.h"
+#include "core/ReadBuffer.h"
+#include "core/RequestParser.h"
+#include "core/ThreadPool.h"
 #include "HttpContentType.h"
-#include "RouteHandler.h"
+#include "Response.h"
+#include "WebLoomExceptions.h"
 
 namespace webloom::core {
 
-constexpr unsigned int MAX_REQUEST_BUFFER_SIZE = 30000;
+// Minimum space offered to each recv(), the read buffer grows past this
+// when a request needs more.
+constexpr size_t READ_CHUNK_SIZE = 16384;
+
+// How long the accept loop waits for a connection, this bounds how long it
+// takes the server to notice that a shutdown has been requested.
+constexpr int ACCEPT_WAIT_TIMEOUT_MS = 500;
+
+// Longest a worker waits on its client before checking whether the server
+// has started draining.
+constexpr int DRAIN_CHECK_INTERVAL_MS = 250;
+
+// How often a drain checks whether every connection has finished.
+constexpr auto DRAIN_POLL_INTERVAL = std::chrono::milliseconds(50);
 
 HttpServer::HttpServer(Logger* logger,
                        WebLoomSettings *settings,
                        core::FileServer *fileServer)
-    : ServerBase(logger, settings, fileServer) {
+    : ServerBase(logger, settings, fileServer), open_connections_(0) {
+}
+
+void HttpServer::InitialiseServerLoop() {
+    for (const auto &listener : listeners_) {
+        // Accepting from a non-blocking socket lets each wakeup take every
+        // pending connection without the last accept() blocking the loop.
+        if (!SetSocketBlocking(listener.socket, false)) {
+            throw std::runtime_error("Unable to make server socket "
+                                     "non-blocking");
+        }
+
+        pollfd pollFd {};
+        pollFd.fd = listener.socket;
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+        pollFd.events = POLLRDNORM;
+#else
+        pollFd.events = POLLIN;
+#endif
+        listener_poll_.push_back(pollFd);
+    }
 }
 
 void HttpServer::ServerLoop() {
-    socklen_t addrLength = sizeof(socket_address_);
+    // Waking periodically lets the loop notice a shutdown request.
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+    int ready = WSAPoll(listener_poll_.data(),
+                        static_cast<ULONG>(listener_poll_.size()),
+                        ACCEPT_WAIT_TIMEOUT_MS);
+#else
+    int ready = poll(listener_poll_.data(), listener_poll_.size(),
+                     ACCEPT_WAIT_TIMEOUT_MS);
+#endif
+    if (ready <= 0) {
+        return;
+    }
 
-    SOCKET newSocket = accept(server_socket_,
-                              (struct sockaddr*)&socket_address_,
-                              &addrLength);
+    for (size_t i = 0; i < listener_poll_.size(); i++) {
+        if (listener_poll_[i].revents != 0) {
+            AcceptConnections(listeners_[i]);
+        }
+    }
+}
 
-    if (newSocket == INVALID_SOCKET) {
-        closesocket(server_socket_);
-        CleanupSocketSystem();
-        throw std::runtime_error("Accept failed");
+/**
+ * @brief Waits for the workers to finish with their connections.
+ *
+ * The workers close connections that are between requests themselves and
+ * give the others until the drain timeout.
+ */
+void HttpServer::DrainConnections(
+    std::chrono::steady_clock::time_point deadline) {
+    // Each worker starts its own drain timeout when it notices the drain.
+    deadline += std::chrono::milliseconds(DRAIN_CHECK_INTERVAL_MS);
+
+    while (open_connections_ > 0 &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(DRAIN_POLL_INTERVAL);
     }
 
-    logger_->LogDebug("Assigning connection to thread pool...");
-    threadpool_->enqueue(std::bind(
-                         &HttpServer::HandleClientRequest,
-                         this,
-                         std::move(newSocket)));
+    if (open_connections_ > 0) {
+        logger_->LogWarn("%u connections were still open after the drain "
+                         "timeout", open_connections_.load());
+    }
 }
 
+/**
+ * @brief Hands every connection waiting in the listen backlog to the
+ *        thread pool.
+ */
+void HttpServer::AcceptConnections(const Listener &listener) {
+    while (true) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+        // The workers use blocking I/O, so only close-on-exec is requested.
+        SOCKET newSocket = accept4(listener.socket, nullptr, nullptr,
+                                   SOCK_CLOEXEC);
+#else
+        SOCKET newSocket = accept(listener.socket, nullptr, nullptr);
+#endif
+
+        if (newSocket == INVALID_SOCKET) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+            int errorCode = WSAGetLastError();
+            if (errorCode != WSAEWOULDBLOCK) {
+                logger_->LogError("Accept failed with error code: %d",
+                                  errorCode);
+            }
+#else
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            // EINVAL is a listening socket stopped by RequestShutdown().
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINVAL) {
+                logger_->LogError("Accept failed: %s", strerror(errno));
+            }
+#endif
+            return;
+        }
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+        // Accepted sockets inherit non-blocking mode from the listener.
+        SetSocketBlocking(newSocket, true);
+#endif
+
+        if (ConnectionLimitReached(open_connections_)) {
+            RejectConnection(newSocket);
+            continue;
+        }
+
+        ConfigureClientSocket(newSocket, listener);
+        SetSocketTimeout(newSocket, SO_SNDTIMEO,
+                         settings_->WriteTimeout() * 1000);
+
+        // A TLS record may arrive in pieces, reads wait for the rest no
+        // longer than the timeouts are checked.
+        if (tls_context_) {
+            SetSocketTimeout(newSocket, SO_RCVTIMEO, DRAIN_CHECK_INTERVAL_MS);
+        }
+
+        open_connections_++;
+        logger_->LogDebug("Assigning connection to thread pool...");
+        threadpool_->enqueue(std::bind(
+                             &HttpServer::HandleClientRequest,
+                             this,
+                             std::move(newSocket)));
+    }
+}
+
+/**
+ * @brief Bounds how long a blocking send or receive may wait for the
+ *        client.
+ *
+ * @param option SO_SNDTIMEO or SO_RCVTIMEO.
+ */
+void HttpServer::SetSocketTimeout(SOCKET socket,
+                                  int option,
+                                  unsigned int milliseconds) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+    DWORD timeout = milliseconds;
+#else
+    timeval timeout {};
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif
+
+    if (setsockopt(socket, SOL_SOCKET, option,
+                   reinterpret_cast<const char *>(&timeout),
+                   sizeof(timeout)) == SOCKET_ERROR) {
+        logger_->LogDebug("Unable to set %s on client socket",
+                          option == SO_SNDTIMEO ? "SO_SNDTIMEO" :
+                                                  "SO_RCVTIMEO");
+    }
+}
+
+/**
+ * @brief Serves requests on a client connection until it is closed.
+ *
+ * The connection is kept open between requests when the client asks for it
+ * (HTTP/1.1 by default, HTTP/1.0 with 'Connection: keep-alive'). It is closed
+ * once the keep-alive request limit is reached, the client closes it or no
+ * new request arrives within the keep-alive timeout.
+ *
+ * Clients may pipeline requests, every complete request received is answered
+ * in the order it arrived before reading from the socket again.
+ *
+ * A request has to arrive within the header and body timeouts, however
+ * slowly its bytes trickle in, otherwise it is answered with 408 Request
+ * Timeout.
+ *
+ * Once the server is draining, a connection between requests is closed and
+ * a request still arriving has until the drain timeout.
+ *
+ * Over TLS the handshake counts towards the header timeout of the first
+ * request.
+ */
 void HttpServer::HandleClientRequest(SOCKET clientSocket) {
-    std::vector<char> buffer(MAX_REQUEST_BUFFER_SIZE, 0);
-    int amountRead = recv(clientSocket,
-        buffer.data(),
-        MAX_REQUEST_BUFFER_SIZE,
-        0);
-
-    if (amountRead > 0) {
-        std::string request_str(buffer.data());
-        Request *request = ProcessRequest(buffer);
-
-        logger_->LogDebug("Request Information:");
-        logger_->LogDebug("=> Method          : %d",
-            request->Method());
-        logger_->LogDebug("=> Path            : %s",
-            request->Path().c_str());
-        logger_->LogDebug("=> HTTP Version    : %d",
-            request->HttpRequestVersion());
-        logger_->LogDebug("=> Remote Host     : %s",
-            request->RemoteHost().c_str());
-        logger_->LogDebug("=> Client Platform : %d",
-            static_cast<int>(request->ClientPlatform()));
-        logger_->LogDebug("=> User-Agent      : %s",
-            request->UserAgent().c_str());
-
-        // Print the header key/values
-        logger_->LogDebug("|= Header key/value pairs:");
-        auto keys = request->Headers().AllKeys();
-        for (const auto& key : keys) {
-            logger_->LogDebug("    %s : %s",
-                key.c_str(),
-                request->Headers().Get(key)->c_str());
-        }
-
-        auto staticWebDir = settings_->StaticWebsiteDir();
-        auto route = staticWebDir + request->Path();
-
-        std::optional<Response *> response = nullptr;
-
-        if (RouteHandler::Instance().IsValidRoute(request->Path(),
-                                                  request->Method())) {
-            response = RouteHandler::Instance().HandleRequest(request->Path(),
-                                                              request->Method(),
-                                                              request);
+    using std::chrono::seconds;
+    using std::chrono::steady_clock;
+
+    std::unique_ptr<TlsSession> tls;
+    if (tls_context_) {
+        try {
+            tls = std::make_unique<TlsSession>(tls_context_, clientSocket);
+        }
+        catch (std::exception &ex) {
+            logger_->LogError("Dropping connection: %s", ex.what());
+            closesocket(clientSocket);
+            open_connections_--;
+            return;
+        }
+    }
+
+    ReadBuffer input(&buffer_pool_);
+    RequestParser parser;
+    unsigned int requestsServed = 0;
+    bool keepAlive = true;
+
+    const steady_clock::time_point unset;
+    steady_clock::time_point lastActivity = steady_clock::now();
+    steady_clock::time_point requestStarted;
+    steady_clock::time_point bodyStarted;
+    steady_clock::time_point drainDeadline;
+
+    while (keepAlive) {
+        steady_clock::time_point deadline;
+        if (bodyStarted != unset) {
+            deadline = bodyStarted + seconds(settings_->BodyTimeout());
+        } else if (requestStarted != unset) {
+            deadline = requestStarted + seconds(settings_->HeaderTimeout());
+        } else if (requestsServed == 0) {
+            deadline = lastActivity + seconds(settings_->HeaderTimeout());
         } else {
-            auto httpStatus = core::HttpStatus::OK;
-            auto contentType = HttpContentType::TextPlain;
-            std::string body = "";
+            deadline = lastActivity + seconds(settings_->KeepAliveTimeout());
+        }
 
-            // Remove any leading '/' from the route as
-            if (!route.empty() && route.front() == '/') {
-                route.erase(0, 1);
+        if (shutdown_requested_) {
+            if (input.Empty() && !WaitForSocketReadable(clientSocket, 0)) {
+                break;
             }
 
-            auto servedFileDetails = file_server_->ServeFile(route);
-            if (!servedFileDetails) {
-                body = "<html><body><h1>404 Page Not Found</h1></body></html>";
-                httpStatus = core::HttpStatus::NotFound;
+            if (drainDeadline == unset) {
+                drainDeadline = steady_clock::now() +
+                                seconds(settings_->DrainTimeout());
+            }
+            deadline = std::min(deadline, drainDeadline);
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - steady_clock::now());
+
+        if (remaining.count() <= 0) {
+            if (input.Empty()) {
+                logger_->LogDebug("Closing idle connection");
             } else {
-                body = servedFileDetails->contents;
-                contentType = servedFileDetails->contentType;
+                logger_->LogDebug("Request timed out");
+                SendErrorResponse(clientSocket, tls.get(),
+                                  HttpStatus::RequestTimeout);
+            }
+            break;
+        }
+
+        // The wait is broken up so that a drain is noticed. Input the TLS
+        // session has already decrypted is not announced by the socket.
+        int waitMs = static_cast<int>(
+            std::min<int64_t>(remaining.count(), DRAIN_CHECK_INTERVAL_MS));
+        if (!(tls && tls->Pending()) &&
+            !WaitForSocketReadable(clientSocket, waitMs)) {
+            continue;
+        }
+
+        if (tls && !tls->Established()) {
+            TlsSession::Result result = tls->Handshake();
+            if (result == TlsSession::Result::WantRead) {
+                continue;
+            }
+
+            if (result != TlsSession::Result::Complete) {
+                logger_->LogDebug("Closing connection, TLS handshake failed");
+                break;
+            }
+
+            logger_->LogDebug("TLS handshake complete, %s session, kernel "
+                              "encryption %s",
+                              tls->Resumed() ? "resumed" : "new",
+                              tls->KernelSend() ? "on" : "off");
+        }
+
+        // A request may arrive split over any number of segments, data is
+        // accumulated until at least one complete request has been received.
+        char *space = input.Reserve(READ_CHUNK_SIZE);
+        int amountRead = tls ?
+            tls->Read(space, input.Available()) :
+            recv(clientSocket, space, static_cast<int>(input.Available()), 0);
+
+        // The rest of a TLS record is still to arrive.
+        if (amountRead < 0 && tls && errno == EAGAIN) {
+            continue;
+        }
+
+        if (amountRead <= 0) {
+            break;
+        }
+        input.Commit(amountRead);
+
+        try {
+            size_t frameLength;
+
+            while (keepAlive &&
+                   (frameLength = RequestFrameLength(&parser,
+                                                     input.View())) > 0) {
+                std::unique_ptr<Request> owner(ProcessRequest(parser));
+                Request *request = owner.get();
+                input.Consume(frameLength);
+                parser.Reset();
+                requestStarted = unset;
+                bodyStarted = unset;
+
+                LogRequest(request);
+
+                requestsServed++;
+                keepAlive = request->KeepAlive() && !shutdown_requested_ &&
+                            requestsServed < settings_->KeepAliveMaxRequests();
+
+                // A failing handler costs its own request a 500 Internal
+                // Server Error, not the connection or the worker.
+                std::unique_ptr<Response> response;
+                try {
+                    response.reset(DispatchRequest(request));
+                }
+                catch (std::exception &ex) {
+                    logger_->LogError("Route handler for '%s' failed: %s",
+                                      request->Path().c_str(), ex.what());
+                }
+
+                if (!response) {
+                    response.reset(
+                        CreateErrorResponse(HttpStatus::InternalServerError));
+                }
+
+                if (!SendResponse(clientSocket, tls.get(),
+                                  std::move(response), keepAlive)) {
+                    keepAlive = false;
+                }
             }
+        }
+        catch (std::invalid_argument &ex) {
+            logger_->LogWarn("Rejecting malformed request: %s", ex.what());
+            SendErrorResponse(clientSocket, tls.get(),
+                              HttpStatus::BadRequest);
+            break;
+        }
+        catch (RequestRejected &ex) {
+            logger_->LogWarn("Rejecting request: %s", ex.what());
+            SendErrorResponse(clientSocket, tls.get(), ex.Status());
+            break;
+        }
+        catch (std::exception &ex) {
+            logger_->LogError("Closing connection, request failed: %s",
+                              ex.what());
+            break;
+        }
 
-            response = new Response(httpStatus,
-                                    body,
-                                    contentType);
+        if (input.Size() > MaxPendingInput()) {
+            logger_->LogWarn("Closing connection, too much pending input");
+            break;
+        }
+
+        lastActivity = steady_clock::now();
+        if (!input.Empty()) {
+            if (requestStarted == unset) {
+                requestStarted = lastActivity;
+            }
+            if (bodyStarted == unset && parser.HeadersComplete()) {
+                bodyStarted = lastActivity;
+            }
         }
+    }
 
-        SendResponse(clientSocket, response.value());
-        closesocket(clientSocket);
+    if (tls) {
+        tls->Close();
     }
+
+    closesocket(clientSocket);
+    open_connections_--;
 }
 
-std::string HttpServer::GenerateResponseHeader(Response *response) {
-    size_t bodyLength = response->Body().size();
-    int statusCode = static_cast<int>(response->StatusCode());
+/**
+ * @brief Writes a response to the client, releasing it once written.
+ *
+ * The header and body are sent with one vectored write rather than being
+ * joined first, and the write is repeated until all of it has been sent.
+ * A streamed response has each part of its body written before the next
+ * part is produced.
+ *
+ * @param tls TLS session of the connection, null for plain TCP.
+ * @return false if the connection failed.
+ */
+bool HttpServer::SendResponse(SOCKET socket,
+                              TlsSession *tls,
+                              std::unique_ptr<Response> response,
+                              bool keepAlive) {
+    OutputQueue output(nullptr, memory_budget_);
+    std::string header = GenerateResponseHeader(response.get(), keepAlive);
+
+    if (!response->Streamed()) {
+        output.Append(std::move(header), std::move(response));
+        return WriteOutput(socket, tls, &output);
+    }
+
+    bool started = false;
+    bool more = true;
 
-    std::string headerStr =
-        "HTTP/1.1 " + std::to_string(statusCode) + " " +
-        HttpStatusString(response->StatusCode()) + "\r\n"
-        "Content-Type: " +
-        HttpContentTypeString(response->ContentType()) + "\r\n"
-        "Content-Length: " + std::to_string(bodyLength) + "\r\n"
-        "\r\n";
+    while (more) {
+        std::string frames;
+        SplicedData spliced;
+
+        try {
+            more = response->NextChunks(&frames, true, &spliced);
+        }
+        catch (std::exception &ex) {
+            logger_->LogError("Streamed response failed: %s", ex.what());
+
+            // Until the header has gone the client can still be told, after
+            // that the connection is ended before the terminating chunk.
+            if (!started) {
+                SendErrorResponse(socket, tls,
+                                  HttpStatus::InternalServerError);
+            }
+            return false;
+        }
+
+        // The first chunks go out together with the header.
+        if (!started) {
+            output.Append(std::move(header));
+            started = true;
+        }
+
+        output.Append(std::move(frames));
+        output.Append(std::move(spliced));
+        if (!WriteOutput(socket, tls, &output)) {
+            return false;
+        }
+    }
+
+    return true;
+}
 
-    return headerStr;
+void HttpServer::SendErrorResponse(SOCKET socket,
+                                   TlsSession *tls,
+                                   HttpStatus status) {
+    OutputQueue output(nullptr, memory_budget_);
+    output.Append(GenerateErrorResponse(status));
+    WriteOutput(socket, tls, &output);
 }
 
-int HttpServer::SendResponse(SOCKET socket, Response *response) {
-    std::string responseStr = GenerateResponseHeader(response) +
-                              response->Body();
+/**
+ * @return false unless everything queued was written.
+ */
+bool HttpServer::WriteOutput(SOCKET socket,
+                             TlsSession *tls,
+                             OutputQueue *output) {
+    OutputQueue::WriteResult result = tls ? tls->Write(output) :
+                                            output->WriteTo(socket);
 
-    int bytesSent = send(socket,
-                         responseStr.c_str(),
-                         static_cast<int>(responseStr.length()),
-                         0);
-    return bytesSent;
+    return result == OutputQueue::WriteResult::Complete;
 }
 
 }   // namespace webloom::core
@@ -3,9 +3,15 @@
 //  Released under LGPL 3.0 license (see LICENSE)
 #ifndef CORE_HTTPSERVER_H_
 #define CORE_HTTPSERVER_H_
+#include <atomic>
+#include <chrono>               // NOLINT(build/c++11)
+#include <memory>
 #include <string>
+#include <vector>
 #include "Response.h"
 #include "ServerBase.h"
+#include "core/OutputQueue.h"
+#include "core/TlsSession.h"
 
 namespace webloom::core {
 
@@ -16,13 +22,36 @@ class HttpServer : public ServerBase {
                 core::FileServer *fileServer);
 
  private:
+    // Connections being served or waiting for a worker.
+    std::atomic<unsigned int> open_connections_;
+
+    // Read readiness of each listening socket, in the order of listeners_.
+    std::vector<pollfd> listener_poll_;
+
+    void InitialiseServerLoop();
+
     void ServerLoop();
 
+    void DrainConnections(std::chrono::steady_clock::time_point deadline);
+
+    void AcceptConnections(const Listener &listener);
+
+    void SetSocketTimeout(SOCKET socket,
+                          int option,
+                          unsigned int milliseconds);
+
     void HandleClientRequest(SOCKET clientSocket);
 
-    std::string GenerateResponseHeader(Response *response);
+    bool SendResponse(SOCKET socket,
+                      TlsSession *tls,
+                      std::unique_ptr<Response> response,
+                      bool keepAlive);
+
+    void SendErrorResponse(SOCKET socket,
+                           TlsSession *tls,
+                           HttpStatus status);
 
-    int SendResponse(SOCKET socket, Response *response);
+    bool WriteOutput(SOCKET socket, TlsSession *tls, OutputQueue *output);
 };
 
 }   // namespace webloom::core
@@ -11,6 +11,8 @@ using NetworkPort = unsigned int;
 
 class IServer {
  public:
+    virtual ~IServer() = default;
+
     virtual void Run() = 0;
 
     virtual void RequestShutdown() = 0;
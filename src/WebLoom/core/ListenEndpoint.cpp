@@ -0,0 +1,134 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "ListenEndpoint.h"
+
+namespace webloom::core {
+
+constexpr const char* UNIX_SOCKET_PREFIX = "unix:";
+constexpr size_t UNIX_SOCKET_PREFIX_LENGTH = 5;
+
+// Marks a Unix domain socket name in the abstract namespace.
+constexpr char ABSTRACT_SOCKET_MARKER = '@';
+
+constexpr const char* ANY_ADDRESS = "*";
+constexpr unsigned long MAX_PORT = 65535;
+constexpr size_t MAX_PORT_DIGITS = 5;
+
+/**
+ * @throws std::invalid_argument if the endpoint is not valid.
+ */
+ListenEndpoint::ListenEndpoint(const std::string &endpoint)
+    : text_(endpoint), address_length_(0) {
+    memset(&address_, 0, sizeof(address_));
+
+    if (endpoint.compare(0, UNIX_SOCKET_PREFIX_LENGTH,
+                         UNIX_SOCKET_PREFIX) == 0) {
+        ParseUnixSocket(endpoint.substr(UNIX_SOCKET_PREFIX_LENGTH));
+    } else {
+        ParseInternetAddress(endpoint);
+    }
+}
+
+bool ListenEndpoint::IsUnixSocket() const {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    return address_.ss_family == AF_UNIX;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Removes the file of a Unix domain socket, other endpoints have
+ *        nothing to remove.
+ */
+void ListenEndpoint::RemoveSocketFile() const {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (!socket_path_.empty()) {
+        unlink(socket_path_.c_str());
+    }
+#endif
+}
+
+void ListenEndpoint::ParseInternetAddress(const std::string &endpoint) {
+    std::string host;
+    std::string port = endpoint;
+
+    size_t separator = endpoint.rfind(':');
+    if (separator != std::string::npos) {
+        host = endpoint.substr(0, separator);
+        port = endpoint.substr(separator + 1);
+    }
+
+    bool digitsOnly = !port.empty() && port.size() <= MAX_PORT_DIGITS &&
+        port.find_first_not_of("0123456789") == std::string::npos;
+    unsigned long portValue = digitsOnly ? std::stoul(port) : 0;
+
+    if (portValue == 0 || portValue > MAX_PORT) {
+        throw std::invalid_argument("Invalid port in listen endpoint '" +
+                                    endpoint + "'");
+    }
+    auto portNumber = htons(static_cast<uint16_t>(portValue));
+
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        auto address = reinterpret_cast<sockaddr_in6 *>(&address_);
+        address->sin6_family = AF_INET6;
+        address->sin6_port = portNumber;
+
+        if (inet_pton(AF_INET6, host.substr(1, host.size() - 2).c_str(),
+                      &address->sin6_addr) != 1) {
+            throw std::invalid_argument("Invalid IPv6 address in listen "
+                                        "endpoint '" + endpoint + "'");
+        }
+
+        address_length_ = sizeof(sockaddr_in6);
+        return;
+    }
+
+    auto address = reinterpret_cast<sockaddr_in *>(&address_);
+    address->sin_family = AF_INET;
+    address->sin_port = portNumber;
+    address->sin_addr.s_addr = INADDR_ANY;
+
+    if (!host.empty() && host != ANY_ADDRESS &&
+        inet_pton(AF_INET, host.c_str(), &address->sin_addr) != 1) {
+        throw std::invalid_argument("Invalid IPv4 address in listen "
+                                    "endpoint '" + endpoint + "'");
+    }
+
+    address_length_ = sizeof(sockaddr_in);
+}
+
+void ListenEndpoint::ParseUnixSocket(const std::string &path) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    auto address = reinterpret_cast<sockaddr_un *>(&address_);
+    address->sun_family = AF_UNIX;
+
+    // The path has to fit with its terminator, an abstract name starts with
+    // a zero byte in place of the marker and has no terminator.
+    if (path.empty() || path.size() >= sizeof(address->sun_path)) {
+        throw std::invalid_argument("Invalid Unix domain socket path in "
+                                    "listen endpoint '" + text_ + "'");
+    }
+
+    memcpy(address->sun_path, path.data(), path.size());
+    address_length_ = static_cast<socklen_t>(
+        offsetof(sockaddr_un, sun_path) + path.size());
+
+    if (path.front() == ABSTRACT_SOCKET_MARKER) {
+        address->sun_path[0] = '\0';
+    } else {
+        address_length_++;
+        socket_path_ = path;
+    }
+#else
+    throw std::invalid_argument("Unix domain socket listeners are only "
+                                "available on Linux");
+#endif
+}
+
+}   // namespace webloom::core
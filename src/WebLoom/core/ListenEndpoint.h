@@ -0,0 +1,57 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_LISTENENDPOINT_H_
+#define CORE_LISTENENDPOINT_H_
+#include <string>
+#include "SocketDefinitions.h"
+
+namespace webloom::core {
+
+/**
+ * @brief An address a server listens on, parsed from its text form.
+ *
+ * Endpoints are written as:
+ *   - "8080" or "*:8080", every IPv4 address.
+ *   - "127.0.0.1:8080", a single IPv4 address.
+ *   - "[::]:8080" or "[::1]:8080", an IPv6 address. IPv6 listeners only
+ *     accept IPv6 connections, so that an IPv4 listener can share the port.
+ *   - "unix:/run/webloom.sock", a Unix domain socket (Linux only).
+ *   - "unix:@webloom", a Unix domain socket in the abstract namespace,
+ *     which has no file and goes away with the last process using it.
+ */
+class ListenEndpoint {
+ public:
+    explicit ListenEndpoint(const std::string &endpoint);
+
+    int Family() const { return address_.ss_family; }
+
+    bool IsUnixSocket() const;
+
+    const sockaddr *Address() const {
+        return reinterpret_cast<const sockaddr *>(&address_);
+    }
+
+    socklen_t AddressLength() const { return address_length_; }
+
+    // File of a Unix domain socket, empty for any other endpoint.
+    const std::string &SocketPath() const { return socket_path_; }
+
+    const std::string &Text() const { return text_; }
+
+    void RemoveSocketFile() const;
+
+ private:
+    std::string text_;
+    sockaddr_storage address_;
+    socklen_t address_length_;
+    std::string socket_path_;
+
+    void ParseInternetAddress(const std::string &endpoint);
+
+    void ParseUnixSocket(const std::string &path);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_LISTENENDPOINT_H_
@@ -10,15 +10,43 @@
 #include "spdlog/sinks/basic_file_sink.h"
 #include "spdlog/sinks/rotating_file_sink.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
+#include "CpuSet.h"
 #include "Logger.h"
 
 namespace webloom::core {
 
 static constexpr const char* LOGGER_NAME = "WebLoom";
 
-Logger::Logger(const LoggerSettings& settings) : settings_(settings) {
-    spdlog::init_thread_pool(settings_.ThreadSize(),
-                             settings_.ThreadCount());
+/**
+ * @param synchronous Messages are written by the thread logging them rather
+ *                    than by a logging thread, so that a process that has no
+ *                    other threads can fork safely.
+ */
+Logger::Logger(const LoggerSettings& settings, bool synchronous)
+    : settings_(settings) {
+    const bool truncate = true;
+    Open(synchronous, truncate);
+}
+
+/**
+ * @brief Replaces the sinks and the logging thread in a forked process,
+ *        whose parent logged synchronously.
+ *
+ * The new sinks append to their files, as they may be reopened after the
+ * previous process using them has failed.
+ */
+void Logger::Reopen(const LoggerSettings& settings) {
+    settings_ = settings;
+
+    const bool synchronous = false;
+    const bool truncate = false;
+    Open(synchronous, truncate);
+}
+
+void Logger::Open(bool synchronous, bool truncate) {
+    // Every Logger writes through the one registered logger, this one
+    // replaces any registered before it.
+    spdlog::drop(LOGGER_NAME);
 
     std::vector<spdlog::sink_ptr> sinks;
 
@@ -48,7 +76,6 @@ Logger::Logger(const LoggerSettings& settings) : settings_(settings) {
             }
         } else {
             try {
-                const bool truncate = true;
                 auto sink = std::make_shared<
                     spdlog::sinks::basic_file_sink_mt> (
                         settings_.LogFilename().c_str(),
@@ -66,12 +93,33 @@ Logger::Logger(const LoggerSettings& settings) : settings_(settings) {
         }
     }
 
-    auto logger = std::make_shared<spdlog::async_logger> (
-        LOGGER_NAME,
-        sinks.begin(),
-        sinks.end(),
-        spdlog::thread_pool(),
-        spdlog::async_overflow_policy::block);
+    std::shared_ptr<spdlog::logger> logger;
+
+    if (synchronous) {
+        logger = std::make_shared<spdlog::logger>(LOGGER_NAME,
+                                                  sinks.begin(),
+                                                  sinks.end());
+    } else {
+        CpuSet cpus;
+        if (!settings_.ThreadCpus().empty()) {
+            cpus = CpuSet(settings_.ThreadCpus());
+        }
+
+        spdlog::init_thread_pool(settings_.ThreadSize(),
+                                 settings_.ThreadCount(),
+                                 [cpus]() {
+                                     if (!cpus.Empty()) {
+                                         cpus.PinCurrentThread();
+                                     }
+                                 });
+
+        logger = std::make_shared<spdlog::async_logger> (
+            LOGGER_NAME,
+            sinks.begin(),
+            sinks.end(),
+            spdlog::thread_pool(),
+            spdlog::async_overflow_policy::block);
+    }
 
     logger->set_level(spdlog::level::debug);
 
@@ -147,4 +195,12 @@ void Logger::LogWarn(const char* format, ...) {
     spdlog::get(LOGGER_NAME)->warn(buffer);
 }
 
+/**
+ * @brief Flushes the sinks once every message already logged has been
+ *        written, the flush is queued behind them on the logger thread.
+ */
+void Logger::Flush() {
+    spdlog::get(LOGGER_NAME)->flush();
+}
+
 }   // namespace webloom::core
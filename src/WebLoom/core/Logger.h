@@ -9,7 +9,9 @@ namespace webloom::core {
 
 class Logger {
  public:
-    explicit Logger(const LoggerSettings& settings);
+    explicit Logger(const LoggerSettings& settings, bool synchronous = false);
+
+    void Reopen(const LoggerSettings& settings);
 
     void LogDebug(const char* format, ...);
 
@@ -21,8 +23,12 @@ class Logger {
 
     void LogWarn(const char* format, ...);
 
+    void Flush();
+
  private:
     LoggerSettings settings_;
+
+    void Open(bool synchronous, bool truncate);
 };
 
 }   // namespace webloom::core
@@ -158,6 +158,27 @@ class LoggerSettings {
         thread_size_ = thread_size;
     }
 
+    /**
+     * @brief Retrieves the CPUs the logging threads are pinned to.
+     *
+     * @return const std::string& A CPU list such as "0-3,8" or "node0",
+     *         empty when the threads are not pinned.
+     */
+    const std::string &ThreadCpus() const {
+        return thread_cpus_;
+    }
+
+    /**
+     * @brief Sets the CPUs the logging threads are pinned to (Linux only).
+     *
+     * @param thread_cpus A list of CPUs and ranges, in which "nodeN" stands
+     *                    for the CPUs of NUMA node N. Empty leaves the
+     *                    threads unpinned.
+     */
+    void ThreadCpus(const std::string& thread_cpus) {
+        thread_cpus_ = thread_cpus;
+    }
+
     std::string LogFormat() const {
         return log_format_;
     }
@@ -174,6 +195,7 @@ class LoggerSettings {
     unsigned int max_file_size_;
     unsigned int thread_count_;
     unsigned int thread_size_;
+    std::string thread_cpus_;
     std::string log_format_;
 
     static constexpr unsigned int DEFAULT_LOGGER_THREAD_SIZE = 8192;
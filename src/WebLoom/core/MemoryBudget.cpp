@@ -0,0 +1,62 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "MemoryBudget.h"
+
+namespace webloom::core {
+
+/**
+ * @param budget Bytes the process may hold, 0 for no limit.
+ */
+MemoryBudget::MemoryBudget(size_t budget)
+    : budget_(budget), used_{}, total_(0) {
+}
+
+void MemoryBudget::Charge(Use use, size_t bytes) {
+    used_[static_cast<size_t>(use)].fetch_add(bytes,
+                                              std::memory_order_relaxed);
+    total_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::Refund(Use use, size_t bytes) {
+    used_[static_cast<size_t>(use)].fetch_sub(bytes,
+                                              std::memory_order_relaxed);
+    total_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Checks whether the process holds as much memory as its budget
+ *        allows, nothing more should then be taken on until some of it has
+ *        been released.
+ */
+bool MemoryBudget::Exhausted() const {
+    return budget_ != 0 && Used() >= budget_;
+}
+
+/**
+ * @brief Checks whether the given number of bytes could be held as well
+ *        without exhausting the budget.
+ */
+bool MemoryBudget::Allows(size_t bytes) const {
+    return budget_ == 0 || Used() + bytes < budget_;
+}
+
+/**
+ * @brief Reads the counters, each of which may be moving whilst they are
+ *        read so they only add up to the total when the process is idle.
+ */
+MemoryBudget::Usage MemoryBudget::Snapshot() const {
+    Usage usage;
+    usage.connectionInput =
+        used_[static_cast<size_t>(Use::ConnectionInput)].load();
+    usage.queuedOutput = used_[static_cast<size_t>(Use::QueuedOutput)].load();
+    usage.pooledBuffers =
+        used_[static_cast<size_t>(Use::PooledBuffers)].load();
+    usage.requestBodies =
+        used_[static_cast<size_t>(Use::RequestBodies)].load();
+    usage.total = Used();
+    usage.budget = budget_;
+    return usage;
+}
+
+}   // namespace webloom::core
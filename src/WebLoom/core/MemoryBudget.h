@@ -0,0 +1,79 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_MEMORYBUDGET_H_
+#define CORE_MEMORYBUDGET_H_
+#include <atomic>
+#include <cstddef>
+
+namespace webloom::core {
+
+/**
+ * @brief Memory held by the servers of a process, by what holds it, against
+ *        a budget for the whole process.
+ *
+ * Buffers are charged as they are taken and refunded as they are released,
+ * so the totals are always current. The counters are lock-free atomics, one
+ * budget being shared by every server of the process and their worker
+ * threads. A budget of 0 leaves memory unlimited, it is still counted.
+ *
+ * Only the buffers the servers hold per connection and per request are
+ * counted. The TLS session cache is bounded by its number of entries
+ * instead, and whatever route handlers allocate is left to them.
+ */
+class MemoryBudget {
+ public:
+    enum class Use {
+        // Read buffers holding partly received requests.
+        ConnectionInput,
+
+        // Responses and events held in memory until clients have read them.
+        QueuedOutput,
+
+        // Buffers kept by the buffer pools for reuse.
+        PooledBuffers,
+
+        // Bodies of HTTP/2 requests and WebSocket messages as they arrive,
+        // and of requests and messages until their handlers have returned.
+        RequestBodies
+    };
+
+    struct Usage {
+        size_t connectionInput;
+        size_t queuedOutput;
+        size_t pooledBuffers;
+        size_t requestBodies;
+        size_t total;
+        size_t budget;
+    };
+
+    explicit MemoryBudget(size_t budget);
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    void Charge(Use use, size_t bytes);
+
+    void Refund(Use use, size_t bytes);
+
+    size_t Used() const { return total_.load(std::memory_order_relaxed); }
+
+    size_t Budget() const { return budget_; }
+
+    bool Exhausted() const;
+
+    bool Allows(size_t bytes) const;
+
+    Usage Snapshot() const;
+
+ private:
+    static constexpr size_t USE_COUNT = 4;
+
+    size_t budget_;
+    std::atomic<size_t> used_[USE_COUNT];
+    std::atomic<size_t> total_;
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_MEMORYBUDGET_H_
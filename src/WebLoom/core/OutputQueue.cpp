@@ -0,0 +1,380 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+# include <fcntl.h>
+# include <sys/sendfile.h>
+#endif
+
+#include <cerrno>
+#include <utility>
+#include "OutputQueue.h"
+#include "core/SplicePipe.h"
+
+namespace webloom::core {
+
+// Number of buffers handed to one vectored send, two per response.
+constexpr size_t MAX_WRITE_VECTORS = 64;
+
+/**
+ * @param bufferedTotal Running total that the bytes buffered by this queue
+ *                      are added to, letting a server track the output held
+ *                      for all of its connections. May be null.
+ * @param budget Memory budget the same bytes are charged to as queued
+ *               output, which has to outlive the queue. May be null.
+ */
+OutputQueue::OutputQueue(size_t *bufferedTotal, MemoryBudget *budget)
+    : offset_(0), pending_bytes_(0), buffered_bytes_(0),
+      buffered_total_(bufferedTotal), budget_(budget), corked_(false) {
+}
+
+OutputQueue::~OutputQueue() {
+    Clear();
+}
+
+/**
+ * @brief Exchanges the contents of two queues sharing a running total and
+ *        memory budget.
+ */
+void OutputQueue::Swap(OutputQueue &other) {
+    segments_.swap(other.segments_);
+    std::swap(offset_, other.offset_);
+    std::swap(pending_bytes_, other.pending_bytes_);
+    std::swap(buffered_bytes_, other.buffered_bytes_);
+    std::swap(corked_, other.corked_);
+}
+
+/**
+ * @brief Queues data that has already been serialised in full.
+ */
+void OutputQueue::Append(std::string data) {
+    Append(std::move(data), nullptr);
+}
+
+/**
+ * @brief Queues a response header followed by the body of the response.
+ *
+ * @param header Serialised status line and headers.
+ * @param response Response whose body follows the header, released once it
+ *                 has been written. May be null.
+ */
+void OutputQueue::Append(std::string header,
+                         std::unique_ptr<Response> response) {
+    Push({ std::move(header), std::move(response), nullptr, {} });
+}
+
+/**
+ * @brief Queues data that other queues may be holding as well, without
+ *        copying it.
+ */
+void OutputQueue::Append(std::shared_ptr<const std::string> shared) {
+    Push({ "", nullptr, std::move(shared), {} });
+}
+
+/**
+ * @brief Queues data waiting in a pipe, which is spliced into the socket
+ *        once everything before it has been written.
+ */
+void OutputQueue::Append(SplicedData spliced) {
+    Push({ "", nullptr, nullptr, std::move(spliced) });
+}
+
+void OutputQueue::Push(Segment segment) {
+    size_t length = SegmentLength(segment);
+    if (length == 0) {
+        return;
+    }
+
+    size_t memory = SegmentMemory(segment);
+    buffered_bytes_ += memory + (segment.shared ? segment.shared->size() : 0);
+    if (buffered_total_) {
+        *buffered_total_ += memory;
+    }
+    if (budget_) {
+        budget_->Charge(MemoryBudget::Use::QueuedOutput, memory);
+    }
+
+    pending_bytes_ += length;
+    segments_.push_back(std::move(segment));
+}
+
+size_t OutputQueue::SegmentLength(const Segment &segment) {
+    return segment.header.size() +
+           (segment.response ? segment.response->BodyLength() : 0) +
+           (segment.shared ? segment.shared->size() : 0) +
+           segment.spliced.length;
+}
+
+size_t OutputQueue::SegmentMemory(const Segment &segment) {
+    bool bodyInMemory = segment.response &&
+                        segment.response->FileDescriptor() == -1;
+
+    return segment.header.size() +
+           (bodyInMemory ? segment.response->Body().size() : 0);
+}
+
+void OutputQueue::Release(const Segment &segment) {
+    size_t memory = SegmentMemory(segment);
+    buffered_bytes_ -= memory + (segment.shared ? segment.shared->size() : 0);
+    if (buffered_total_) {
+        *buffered_total_ -= memory;
+    }
+    if (budget_) {
+        budget_->Refund(MemoryBudget::Use::QueuedOutput, memory);
+    }
+}
+
+/**
+ * @brief Writes as much of the queue as the socket accepts.
+ *
+ * Blocking sockets are written until everything has been sent. When a
+ * write has to be spread over several sends the socket is corked so that
+ * the pieces leave as full segments, it is uncorked once the queue has
+ * drained. File bodies are passed to the socket with `sendfile()` and
+ * spliced data with `splice()`.
+ */
+OutputQueue::WriteResult OutputQueue::WriteTo(SOCKET socket) {
+    while (!Empty()) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+        WSABUF buffers[MAX_WRITE_VECTORS];
+        DWORD count = 0;
+        size_t skip = offset_;
+
+        for (auto &segment : segments_) {
+            if (count == MAX_WRITE_VECTORS) {
+                break;
+            }
+
+            const std::string *parts[] = {
+                &segment.header,
+                segment.response ? &segment.response->Body() : nullptr,
+                segment.shared.get() };
+
+            for (const std::string *part : parts) {
+                if (!part || count == MAX_WRITE_VECTORS) {
+                    continue;
+                }
+
+                if (skip >= part->size()) {
+                    skip -= part->size();
+                    continue;
+                }
+
+                buffers[count].buf = const_cast<char *>(part->data()) + skip;
+                buffers[count].len = static_cast<ULONG>(part->size() - skip);
+                skip = 0;
+                count++;
+            }
+        }
+
+        DWORD sent = 0;
+        if (WSASend(socket, buffers, count, &sent, 0, nullptr, nullptr) ==
+            SOCKET_ERROR) {
+            return WSAGetLastError() == WSAEWOULDBLOCK ?
+                WriteResult::WouldBlock : WriteResult::Failed;
+        }
+#else
+        int file;
+        off_t fileOffset;
+        size_t fileLength;
+        int pipe;
+        size_t splicedLength;
+        ssize_t sent;
+
+        if (NextFile(&file, &fileOffset, &fileLength)) {
+            sent = sendfile(socket, file, &fileOffset, fileLength);
+
+            // The file has been truncated since it was opened, the length
+            // promised in the header can no longer be met.
+            if (sent == 0) {
+                return WriteResult::Failed;
+            }
+        } else if (NextSpliced(&pipe, &splicedLength)) {
+            sent = splice(pipe, nullptr, socket, nullptr, splicedLength,
+                          SPLICE_F_MOVE);
+        } else {
+            iovec vectors[MAX_WRITE_VECTORS];
+            msghdr message {};
+            message.msg_iov = vectors;
+            message.msg_iovlen = Gather(vectors, MAX_WRITE_VECTORS);
+
+            sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+        }
+
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                SetCork(socket, true);
+                return WriteResult::WouldBlock;
+            }
+
+            return WriteResult::Failed;
+        }
+#endif
+
+        Consume(sent);
+
+        if (!Empty()) {
+            SetCork(socket, true);
+        }
+    }
+
+    SetCork(socket, false);
+    return WriteResult::Complete;
+}
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+/**
+ * @brief Describes the unwritten part of the queue as buffers for a
+ *        vectored send.
+ *
+ * Gathering stops at the first file body or spliced data, which has to be
+ * written by itself. Nothing is gathered when the queue starts with one.
+ *
+ * @return The number of vectors filled in.
+ */
+size_t OutputQueue::Gather(iovec *vectors, size_t maxVectors) const {
+    size_t count = 0;
+    size_t skip = offset_;
+
+    for (auto &segment : segments_) {
+        bool fileBody = segment.response &&
+                        segment.response->FileDescriptor() != -1;
+
+        const std::string *parts[] = {
+            &segment.header,
+            segment.response && !fileBody ?
+                &segment.response->Body() : nullptr,
+            segment.shared.get() };
+
+        for (const std::string *part : parts) {
+            if (!part || count == maxVectors) {
+                continue;
+            }
+
+            if (skip >= part->size()) {
+                skip -= part->size();
+                continue;
+            }
+
+            vectors[count].iov_base = const_cast<char *>(part->data()) + skip;
+            vectors[count].iov_len = part->size() - skip;
+            skip = 0;
+            count++;
+        }
+
+        if (count == maxVectors || fileBody || segment.spliced.pipe) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Finds whether the unwritten part of the queue starts with a file
+ *        body.
+ *
+ * @param fileDescriptor Set to the file to be written next.
+ * @param fileOffset Set to where in the file writing continues.
+ * @param fileLength Set to the number of bytes of the file still to write.
+ * @return true if the next bytes come from a file.
+ */
+bool OutputQueue::NextFile(int *fileDescriptor,
+                           off_t *fileOffset,
+                           size_t *fileLength) const {
+    if (segments_.empty()) {
+        return false;
+    }
+
+    const Segment &front = segments_.front();
+    if (!front.response || front.response->FileDescriptor() == -1 ||
+        offset_ < front.header.size()) {
+        return false;
+    }
+
+    size_t written = offset_ - front.header.size();
+    *fileDescriptor = front.response->FileDescriptor();
+    *fileOffset = static_cast<off_t>(written);
+    *fileLength = front.response->BodyLength() - written;
+    return true;
+}
+
+/**
+ * @brief Finds whether the unwritten part of the queue starts with data
+ *        waiting in a pipe.
+ *
+ * @param pipe Set to the end of the pipe to splice from.
+ * @param length Set to the number of bytes in the pipe still to write.
+ * @return true if the next bytes come from a pipe.
+ */
+bool OutputQueue::NextSpliced(int *pipe, size_t *length) const {
+    if (segments_.empty()) {
+        return false;
+    }
+
+    const Segment &front = segments_.front();
+    if (!front.spliced.pipe || offset_ < front.header.size()) {
+        return false;
+    }
+
+    *pipe = front.spliced.pipe->ReadEnd();
+    *length = front.spliced.length - (offset_ - front.header.size());
+    return true;
+}
+#endif
+
+/**
+ * @brief Drops bytes that have been written from the front of the queue.
+ *
+ * Responses are released as soon as they have been written in full.
+ */
+void OutputQueue::Consume(size_t amount) {
+    pending_bytes_ -= amount;
+    offset_ += amount;
+
+    while (!segments_.empty()) {
+        Segment &front = segments_.front();
+        size_t length = SegmentLength(front);
+
+        if (offset_ < length) {
+            break;
+        }
+
+        offset_ -= length;
+        Release(front);
+        segments_.pop_front();
+    }
+}
+
+void OutputQueue::Clear() {
+    for (auto &segment : segments_) {
+        Release(segment);
+    }
+
+    segments_.clear();
+    offset_ = 0;
+    pending_bytes_ = 0;
+}
+
+void OutputQueue::SetCork(SOCKET socket, bool corked) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (corked_ == corked) {
+        return;
+    }
+
+    int value = corked ? 1 : 0;
+    setsockopt(socket, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+    corked_ = corked;
+#else
+    (void)socket;
+    (void)corked;
+#endif
+}
+
+}   // namespace webloom::core
@@ -0,0 +1,129 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_OUTPUTQUEUE_H_
+#define CORE_OUTPUTQUEUE_H_
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include "Response.h"
+#include "SocketDefinitions.h"
+#include "core/MemoryBudget.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+# include <sys/types.h>
+# include <sys/uio.h>
+#endif
+
+namespace webloom::core {
+
+/**
+ * @brief Responses waiting to be written to a connection.
+ *
+ * Each entry is a serialised header together with the response that owns
+ * the body, so bodies are written from where the handler left them instead
+ * of being copied behind their header. Everything queued is written with
+ * vectored sends, so a response goes to the kernel in one call however many
+ * parts it has, and partial writes resume where they stopped. Bodies held in
+ * an open file are sent from the page cache without being read, and data
+ * spliced into a pipe is spliced on into the socket. Data shared by many
+ * connections, such as a broadcast event, is queued by reference.
+ */
+class OutputQueue {
+ public:
+    enum class WriteResult {
+        // Everything queued has been written.
+        Complete,
+
+        // The socket buffer is full, the rest has to wait until the socket
+        // is writable again.
+        WouldBlock,
+
+        // The connection has failed.
+        Failed
+    };
+
+    explicit OutputQueue(size_t *bufferedTotal = nullptr,
+                         MemoryBudget *budget = nullptr);
+
+    ~OutputQueue();
+
+    OutputQueue(const OutputQueue &) = delete;
+    OutputQueue &operator=(const OutputQueue &) = delete;
+
+    void Swap(OutputQueue &other);
+
+    void Append(std::string data);
+
+    void Append(std::string header, std::unique_ptr<Response> response);
+
+    void Append(std::shared_ptr<const std::string> shared);
+
+    void Append(SplicedData spliced);
+
+    bool Empty() const { return segments_.empty(); }
+
+    size_t PendingBytes() const { return pending_bytes_; }
+
+    // Queued bytes held in memory, file bodies and spliced data held by the
+    // kernel are not counted. Shared data
+    // counts against every queue holding it, but not towards the running
+    // total, which would otherwise count it once per queue.
+    size_t BufferedBytes() const { return buffered_bytes_; }
+
+    WriteResult WriteTo(SOCKET socket);
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    size_t Gather(iovec *vectors, size_t maxVectors) const;
+
+    bool NextFile(int *fileDescriptor,
+                  off_t *fileOffset,
+                  size_t *fileLength) const;
+
+    bool NextSpliced(int *pipe, size_t *length) const;
+#endif
+
+    void Consume(size_t amount);
+
+    void Clear();
+
+ private:
+    struct Segment {
+        std::string header;
+        std::unique_ptr<Response> response;
+        std::shared_ptr<const std::string> shared;
+        SplicedData spliced;
+    };
+
+    std::deque<Segment> segments_;
+
+    // How much of the front segment has been written already.
+    size_t offset_;
+
+    size_t pending_bytes_;
+    size_t buffered_bytes_;
+
+    // Running total of the bytes buffered by every queue sharing it.
+    size_t *buffered_total_;
+
+    // Charged with the bytes added to the running total, may be null.
+    MemoryBudget *budget_;
+
+    // The socket is corked whilst a write is spread over several sends.
+    bool corked_;
+
+    static size_t SegmentLength(const Segment &segment);
+
+    static size_t SegmentMemory(const Segment &segment);
+
+    void Push(Segment segment);
+
+    void Release(const Segment &segment);
+
+    void SetCork(SOCKET socket, bool corked);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_OUTPUTQUEUE_H_
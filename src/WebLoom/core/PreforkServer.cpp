@@ -0,0 +1,330 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>               // NOLINT(build/c++11)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>               // NOLINT(build/c++11)
+#include "PreforkServer.h"
+
+namespace webloom::core {
+
+// How often the supervisor checks on its workers, this also bounds how
+// quickly a worker that keeps failing is restarted.
+constexpr auto SUPERVISE_INTERVAL = std::chrono::milliseconds(250);
+
+// How often a shutdown checks whether every worker has exited.
+constexpr auto STOP_POLL_INTERVAL = std::chrono::milliseconds(50);
+
+// Time a worker is given beyond the drain timeout to exit before it is
+// killed.
+constexpr auto STOP_GRACE_PERIOD = std::chrono::seconds(5);
+
+// Server of a worker process, for its signal handler.
+static ServerBase *worker_server = nullptr;
+
+static void StopWorkerServer(int) {
+    if (worker_server) {
+        worker_server->RequestShutdown();
+    }
+}
+
+/**
+ * @brief Gives each worker a log file of its own, "server.log" becoming
+ *        "server-worker2.log" for the worker with index 2.
+ */
+static LoggerSettings WorkerLogSettings(const LoggerSettings &settings,
+                                        unsigned int index) {
+    LoggerSettings workerSettings = settings;
+    std::string filename = settings.LogFilename();
+
+    if (!filename.empty()) {
+        size_t extension = filename.rfind('.');
+        size_t directory = filename.rfind('/');
+        if (extension == std::string::npos ||
+            (directory != std::string::npos && extension < directory)) {
+            extension = filename.size();
+        }
+
+        filename.insert(extension, "-worker" + std::to_string(index));
+        workerSettings.LogFilename(filename);
+    }
+
+    return workerSettings;
+}
+
+PreforkServer::PreforkServer(Logger *logger,
+                             WebLoomSettings *settings,
+                             const LoggerSettings &logSettings,
+                             ServerBase *server)
+    : logger_(logger), settings_(settings), log_settings_(logSettings),
+      server_(server), worker_count_(settings->WorkerProcesses()),
+      shutdown_requested_(false), is_worker_(false), supervisor_pid_(-1),
+      restarts_(0), stats_(nullptr) {
+}
+
+PreforkServer::~PreforkServer() {
+    if (stats_) {
+        munmap(stats_, sizeof(ServerStats) * worker_count_);
+    }
+
+    delete server_;
+}
+
+/**
+ * @brief Binds the listening sockets, starts the workers and keeps them
+ *        running until a shutdown is requested.
+ *
+ * @throws std::runtime_error if the sockets can't be set up or the first
+ *         workers can't be started.
+ */
+void PreforkServer::Run() {
+    server_->ShareListeners();
+
+    void *memory = mmap(nullptr, sizeof(ServerStats) * worker_count_,
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                        -1, 0);
+    if (memory == MAP_FAILED) {
+        server_->CloseListeners();
+        throw std::runtime_error("Unable to map worker statistics: " +
+                                 std::string(strerror(errno)));
+    }
+
+    stats_ = static_cast<ServerStats *>(memory);
+    for (unsigned int i = 0; i < worker_count_; i++) {
+        new (&stats_[i]) ServerStats();
+    }
+
+    supervisor_pid_ = getpid();
+    workers_.assign(worker_count_, -1);
+
+    for (unsigned int i = 0; i < worker_count_; i++) {
+        if (!StartWorker(i)) {
+            StopWorkers();
+            server_->CloseListeners();
+            throw std::runtime_error("Unable to start worker processes");
+        }
+    }
+
+    logger_->LogInfo("Started %u worker processes", worker_count_);
+
+    while (!shutdown_requested_) {
+        ServerLoop();
+    }
+
+    StopWorkers();
+    server_->CloseListeners();
+    LogTotals();
+}
+
+/**
+ * @brief Stops the workers, letting their requests in progress finish.
+ *
+ * Called in a worker, only that worker's server is stopped. Safe to call
+ * from a signal handler.
+ */
+void PreforkServer::RequestShutdown() {
+    if (is_worker_) {
+        server_->RequestShutdown();
+        return;
+    }
+
+    shutdown_requested_ = true;
+}
+
+uint64_t PreforkServer::ConnectionsAccepted() const {
+    uint64_t total = 0;
+    for (unsigned int i = 0; stats_ && i < worker_count_; i++) {
+        total += stats_[i].connections.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+uint64_t PreforkServer::RequestsServed() const {
+    uint64_t total = 0;
+    for (unsigned int i = 0; stats_ && i < worker_count_; i++) {
+        total += stats_[i].requests.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+/**
+ * @brief Collects the workers that have exited and replaces them.
+ */
+void PreforkServer::ServerLoop() {
+    std::this_thread::sleep_for(SUPERVISE_INTERVAL);
+
+    for (unsigned int i = 0; i < worker_count_ && !shutdown_requested_; i++) {
+        if (workers_[i] == -1) {
+            StartWorker(i);
+            continue;
+        }
+
+        int status;
+        if (waitpid(workers_[i], &status, WNOHANG) == workers_[i]) {
+            WorkerExited(i, status);
+            restarts_++;
+            StartWorker(i);
+        }
+    }
+}
+
+/**
+ * @return false if the worker could not be forked, it is tried again on
+ *         the next pass.
+ */
+bool PreforkServer::StartWorker(unsigned int index) {
+    // Output the supervisor still has buffered would otherwise be written a
+    // second time by the worker.
+    fflush(nullptr);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        logger_->LogError("Unable to start worker %u: %s",
+                          index, strerror(errno));
+        return false;
+    }
+
+    if (pid == 0) {
+        RunWorker(index);
+    }
+
+    workers_[index] = pid;
+    logger_->LogInfo("Started worker %u as process %d", index, pid);
+    return true;
+}
+
+/**
+ * @brief Serves connections in a newly forked worker process until it is
+ *        told to stop, then ends the process.
+ *
+ * The worker stops on SIGTERM, which it is also sent should the supervisor
+ * die. The process ends with exit() rather than returning, so that nothing
+ * after Run() in the application is repeated by every worker, and so that
+ * the logging thread writes out what is left in its queue.
+ */
+void PreforkServer::RunWorker(unsigned int index) {
+    is_worker_ = true;
+    worker_server = server_;
+
+    struct sigaction action {};
+    action.sa_handler = StopWorkerServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, nullptr);
+
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != supervisor_pid_) {
+        _exit(EXIT_FAILURE);
+    }
+
+    logger_->Reopen(WorkerLogSettings(log_settings_, index));
+    server_->CountInto(&stats_[index]);
+    server_->AssignCpuSlot(index);
+
+    int status = EXIT_SUCCESS;
+
+    try {
+        server_->Run();
+    }
+    catch (std::exception &ex) {
+        logger_->LogCritical("Worker %u failed: %s", index, ex.what());
+        status = EXIT_FAILURE;
+    }
+
+    std::exit(status);
+}
+
+void PreforkServer::WorkerExited(unsigned int index, int status) {
+    if (WIFSIGNALED(status)) {
+        logger_->LogError("Worker %u (process %d) was killed by signal %d "
+                          "(%s)", index, workers_[index], WTERMSIG(status),
+                          strsignal(WTERMSIG(status)));
+    } else if (WEXITSTATUS(status) != EXIT_SUCCESS) {
+        logger_->LogError("Worker %u (process %d) exited with status %d",
+                          index, workers_[index], WEXITSTATUS(status));
+    } else {
+        logger_->LogInfo("Worker %u (process %d) stopped",
+                         index, workers_[index]);
+    }
+
+    workers_[index] = -1;
+}
+
+/**
+ * @brief Tells every worker to shut down and waits for them to drain,
+ *        killing any still running once the drain timeout has passed.
+ */
+void PreforkServer::StopWorkers() {
+    for (pid_t pid : workers_) {
+        if (pid != -1) {
+            kill(pid, SIGTERM);
+        }
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::seconds(settings_->DrainTimeout()) +
+                    STOP_GRACE_PERIOD;
+    bool killed = false;
+
+    while (true) {
+        bool running = false;
+
+        for (pid_t &pid : workers_) {
+            if (pid == -1) {
+                continue;
+            }
+
+            pid_t result = waitpid(pid, nullptr, WNOHANG);
+            if (result == 0 || (result == -1 && errno == EINTR)) {
+                running = true;
+            } else {
+                pid = -1;
+            }
+        }
+
+        if (!running) {
+            break;
+        }
+
+        if (!killed && std::chrono::steady_clock::now() >= deadline) {
+            logger_->LogWarn("Killing worker processes still running after "
+                             "the drain timeout");
+            for (pid_t pid : workers_) {
+                if (pid != -1) {
+                    kill(pid, SIGKILL);
+                }
+            }
+            killed = true;
+        }
+
+        std::this_thread::sleep_for(STOP_POLL_INTERVAL);
+    }
+}
+
+void PreforkServer::LogTotals() {
+    logger_->LogInfo("Workers accepted %llu connections and served %llu "
+                     "requests, with %u restarts",
+                     static_cast<unsigned long long>(ConnectionsAccepted()),
+                     static_cast<unsigned long long>(RequestsServed()),
+                     restarts_);
+}
+
+}   // namespace webloom::core
+
+#endif  // WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX
@@ -0,0 +1,87 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_PREFORKSERVER_H_
+#define CORE_PREFORKSERVER_H_
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "IServer.h"
+#include "Logger.h"
+#include "LoggerSettings.h"
+#include "ServerBase.h"
+#include "ServerStats.h"
+#include "WebLoomSettings.h"
+
+namespace webloom::core {
+
+/**
+ * @brief Supervises worker processes that serve connections from listening
+ *        sockets bound once by the supervisor.
+ *
+ * Each worker is forked from the supervisor and runs its own copy of the
+ * server, which has been set up but not run, so workers share nothing but
+ * the listening sockets: each has its own worker threads, allocator and
+ * logging thread. A worker that exits for any reason other than a shutdown,
+ * such as a crash in a route handler, is replaced by a new one, and the
+ * other workers carry on serving in the meantime.
+ *
+ * The workers count the connections and requests they handle in memory
+ * shared with the supervisor, which reports the totals.
+ *
+ * The supervisor must have no threads of its own when it forks, so its
+ * logger has to be synchronous. This server is only available on Linux.
+ */
+class PreforkServer : public IServer {
+ public:
+    PreforkServer(Logger *logger,
+                  WebLoomSettings *settings,
+                  const LoggerSettings &logSettings,
+                  ServerBase *server);
+
+    ~PreforkServer();
+
+    void Run();
+
+    void RequestShutdown();
+
+    uint64_t ConnectionsAccepted() const;
+
+    uint64_t RequestsServed() const;
+
+ private:
+    Logger *logger_;
+    WebLoomSettings *settings_;
+    LoggerSettings log_settings_;
+    ServerBase *server_;
+    unsigned int worker_count_;
+    std::atomic<bool> shutdown_requested_;
+
+    // Set in a worker, whose shutdown requests go to its server.
+    bool is_worker_;
+    pid_t supervisor_pid_;
+
+    // Process of each worker, -1 whilst it is waiting to be started.
+    std::vector<pid_t> workers_;
+    unsigned int restarts_;
+
+    // Counters of each worker, in memory shared with the workers.
+    ServerStats *stats_;
+
+    void ServerLoop();
+
+    bool StartWorker(unsigned int index);
+
+    [[noreturn]] void RunWorker(unsigned int index);
+
+    void WorkerExited(unsigned int index, int status);
+
+    void StopWorkers();
+
+    void LogTotals();
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_PREFORKSERVER_H_
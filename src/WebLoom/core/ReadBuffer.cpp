@@ -0,0 +1,72 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <cstring>
+#include "ReadBuffer.h"
+
+namespace webloom::core {
+
+ReadBuffer::ReadBuffer(BufferPool *pool)
+    : pool_(pool), block_({ nullptr, 0 }), start_(0), end_(0) {
+}
+
+ReadBuffer::~ReadBuffer() {
+    pool_->Release(block_);
+}
+
+/**
+ * @brief Makes room for at least minimum more bytes.
+ *
+ * Unconsumed data is moved to the front of the buffer first, a larger
+ * buffer is only taken from the pool if that does not free enough space.
+ *
+ * @return Where the next bytes should be written, Available() gives the
+ *         space there.
+ */
+char *ReadBuffer::Reserve(size_t minimum) {
+    if (Available() >= minimum) {
+        return block_.data + end_;
+    }
+
+    size_t size = Size();
+
+    if (start_ > 0 && block_.capacity - size >= minimum) {
+        memmove(block_.data, block_.data + start_, size);
+    } else {
+        BufferPool::Block larger = pool_->Acquire(size + minimum);
+        if (size > 0) {
+            memcpy(larger.data, block_.data + start_, size);
+        }
+        pool_->Release(block_);
+        block_ = larger;
+    }
+
+    start_ = 0;
+    end_ = size;
+    return block_.data + end_;
+}
+
+void ReadBuffer::Append(const char *data, size_t length) {
+    memcpy(Reserve(length), data, length);
+    Commit(length);
+}
+
+/**
+ * @brief Drops bytes from the front of the buffer once they are handled.
+ */
+void ReadBuffer::Consume(size_t amount) {
+    start_ += amount;
+
+    if (start_ >= end_) {
+        Clear();
+    }
+}
+
+void ReadBuffer::Clear() {
+    pool_->Release(block_);
+    block_ = { nullptr, 0 };
+    start_ = 0;
+    end_ = 0;
+}
+
+}   // namespace webloom::core
@@ -0,0 +1,58 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_READBUFFER_H_
+#define CORE_READBUFFER_H_
+#include <cstddef>
+#include <string_view>
+#include "core/BufferPool.h"
+
+namespace webloom::core {
+
+/**
+ * @brief Bytes received on a connection that have not been consumed yet.
+ *
+ * Data is read straight into the buffer and requests are framed from it in
+ * place. Storage is drawn from a BufferPool, moving to a larger size class
+ * only when a request does not fit, and is handed back as soon as the
+ * buffer is empty so that idle connections hold no memory.
+ */
+class ReadBuffer {
+ public:
+    explicit ReadBuffer(BufferPool *pool);
+
+    ~ReadBuffer();
+
+    ReadBuffer(const ReadBuffer&) = delete;
+    ReadBuffer& operator=(const ReadBuffer&) = delete;
+
+    char *Reserve(size_t minimum);
+
+    size_t Available() const { return block_.capacity - end_; }
+
+    void Commit(size_t amount) { end_ += amount; }
+
+    void Append(const char *data, size_t length);
+
+    void Consume(size_t amount);
+
+    void Clear();
+
+    std::string_view View() const {
+        return std::string_view(block_.data + start_, end_ - start_);
+    }
+
+    size_t Size() const { return end_ - start_; }
+
+    bool Empty() const { return start_ == end_; }
+
+ private:
+    BufferPool *pool_;
+    BufferPool::Block block_;
+    size_t start_;
+    size_t end_;
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_READBUFFER_H_
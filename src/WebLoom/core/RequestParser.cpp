@@ -0,0 +1,167 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include "RequestParser.h"
+
+namespace webloom::core {
+
+constexpr std::string_view LINE_TERMINATOR = "\r\n";
+constexpr std::string_view FIELD_WHITESPACE = " \t";
+constexpr std::string_view FIELD_CONTENT_LENGTH = "content-length";
+constexpr std::string_view FIELD_TRANSFER_ENCODING = "transfer-encoding";
+constexpr size_t MAX_CONTENT_LENGTH_DIGITS = 15;
+
+/**
+ * @brief Compares text with a lower case string, ignoring the case of the
+ *        text as header field names and tokens are compared.
+ */
+bool EqualsIgnoringCase(std::string_view text, std::string_view lowerCase) {
+    return text.size() == lowerCase.size() &&
+           std::equal(text.begin(), text.end(), lowerCase.begin(),
+                      [](char a, char b) {
+                          return std::tolower(
+                              static_cast<unsigned char>(a)) == b;
+                      });
+}
+
+RequestParser::RequestParser() {
+    Reset();
+}
+
+/**
+ * @brief Forgets the request parsed, ready for the next one to be parsed
+ *        from the start of the input.
+ */
+void RequestParser::Reset() {
+    buffer_ = {};
+    stage_ = Stage::RequestLine;
+    line_start_ = 0;
+    searched_ = 0;
+    method_ = target_ = version_ = { 0, 0 };
+    fields_.clear();
+    header_length_ = 0;
+    body_length_ = 0;
+    content_length_seen_ = false;
+}
+
+/**
+ * @brief Carries on parsing the request at the start of the input.
+ *
+ * @param buffer The connection's input, starting with the request and
+ *               holding at least what it held on the last call.
+ * @return Whether the whole request has arrived, its slices refer to this
+ *         buffer from now on.
+ * @throws std::invalid_argument if the request is malformed or its body
+ *         length cannot be determined.
+ */
+RequestParser::Result RequestParser::Parse(std::string_view buffer) {
+    buffer_ = buffer;
+
+    while (stage_ != Stage::Body) {
+        size_t lineEnd = buffer.find(LINE_TERMINATOR, searched_);
+        if (lineEnd == std::string_view::npos) {
+            // The next search starts from the last byte, which may be the
+            // first half of the terminator.
+            searched_ = std::max(line_start_,
+                                 buffer.empty() ? 0 : buffer.size() - 1);
+            return Result::Incomplete;
+        }
+
+        std::string_view line = buffer.substr(line_start_,
+                                              lineEnd - line_start_);
+
+        if (stage_ == Stage::RequestLine) {
+            ParseRequestLine(line);
+            stage_ = Stage::Fields;
+        } else if (line.empty()) {
+            header_length_ = lineEnd + LINE_TERMINATOR.size();
+            stage_ = Stage::Body;
+        } else {
+            ParseField(line);
+        }
+
+        line_start_ = lineEnd + LINE_TERMINATOR.size();
+        searched_ = line_start_;
+    }
+
+    return buffer.size() >= FrameLength() ? Result::Complete :
+                                            Result::Incomplete;
+}
+
+/**
+ * @brief Splits the request line into its method, target and version,
+ *        which are separated by single spaces.
+ */
+void RequestParser::ParseRequestLine(std::string_view line) {
+    size_t methodEnd = line.find(' ');
+    size_t targetEnd = methodEnd == std::string_view::npos ?
+        std::string_view::npos : line.find(' ', methodEnd + 1);
+
+    if (methodEnd == 0 || targetEnd == std::string_view::npos ||
+        targetEnd == methodEnd + 1 || targetEnd + 1 == line.size()) {
+        throw std::invalid_argument("Malformed request line");
+    }
+
+    method_ = ToSlice(line.substr(0, methodEnd));
+    target_ = ToSlice(line.substr(methodEnd + 1, targetEnd - methodEnd - 1));
+    version_ = ToSlice(line.substr(targetEnd + 1));
+}
+
+/**
+ * @brief Adds a header field, taking the body length from 'Content-Length'.
+ *
+ * Anything that could be framed differently by another server on the way
+ * is refused rather than guessed at: lines without a colon, names with
+ * white space in them and 'Content-Length' fields that disagree
+ * (RFC 9112 sections 5.1 and 6.3).
+ */
+void RequestParser::ParseField(std::string_view line) {
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) {
+        throw std::invalid_argument("Malformed header field");
+    }
+
+    std::string_view name = line.substr(0, colon);
+    if (name.find_first_of(FIELD_WHITESPACE) != std::string_view::npos) {
+        throw std::invalid_argument("White space in header field name");
+    }
+
+    std::string_view value = line.substr(colon + 1);
+
+    size_t valueStart = value.find_first_not_of(FIELD_WHITESPACE);
+    if (valueStart == std::string_view::npos) {
+        value = value.substr(value.size());
+    } else {
+        value = value.substr(valueStart,
+                             value.find_last_not_of(FIELD_WHITESPACE) -
+                             valueStart + 1);
+    }
+
+    if (EqualsIgnoringCase(name, FIELD_CONTENT_LENGTH)) {
+        if (value.empty() || value.size() > MAX_CONTENT_LENGTH_DIGITS ||
+            value.find_first_not_of("0123456789") != std::string_view::npos) {
+            throw std::invalid_argument("Invalid Content-Length");
+        }
+
+        size_t length = 0;
+        for (char digit : value) {
+            length = length * 10 + (digit - '0');
+        }
+
+        if (content_length_seen_ && length != body_length_) {
+            throw std::invalid_argument("Conflicting Content-Length");
+        }
+        content_length_seen_ = true;
+        body_length_ = length;
+    } else if (EqualsIgnoringCase(name, FIELD_TRANSFER_ENCODING)) {
+        throw std::invalid_argument(
+            "Transfer-Encoding request bodies are not supported");
+    }
+
+    fields_.emplace_back(ToSlice(name), ToSlice(value));
+}
+
+}   // namespace webloom::core
@@ -0,0 +1,121 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_REQUESTPARSER_H_
+#define CORE_REQUESTPARSER_H_
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace webloom::core {
+
+bool EqualsIgnoringCase(std::string_view text, std::string_view lowerCase);
+
+/**
+ * @brief Parses an HTTP/1.x request at the start of a connection's input,
+ *        in a single pass and without copying it.
+ *
+ * The method, target, version and header fields are located as slices of
+ * the input. Each line is parsed once, when its terminator arrives: input
+ * that ends part way through the head leaves the parser waiting for more,
+ * and the next call carries on from the first line not yet parsed. The
+ * slices stay valid until the input is next changed, and the parser has to
+ * be reset once the request has been consumed from the input. Its storage
+ * is kept across requests, so steady traffic does not allocate.
+ *
+ * Size limits are left to the caller, which can check them against the
+ * lengths reported.
+ */
+class RequestParser {
+ public:
+    enum class Result {
+        // The head and the whole body have arrived.
+        Complete,
+
+        // More input is needed.
+        Incomplete
+    };
+
+    RequestParser();
+
+    Result Parse(std::string_view buffer);
+
+    void Reset();
+
+    bool HeadersComplete() const { return stage_ == Stage::Body; }
+
+    // Length of the request line and headers including the blank line
+    // ending them, known once the headers are complete.
+    size_t HeaderLength() const { return header_length_; }
+
+    // Length of the body given by 'Content-Length', 0 without one.
+    size_t BodyLength() const { return body_length_; }
+
+    size_t FrameLength() const { return header_length_ + body_length_; }
+
+    std::string_view Method() const { return View(method_); }
+
+    std::string_view Target() const { return View(target_); }
+
+    std::string_view Version() const { return View(version_); }
+
+    size_t FieldCount() const { return fields_.size(); }
+
+    std::string_view FieldName(size_t index) const {
+        return View(fields_[index].first);
+    }
+
+    // The value without the white space around it.
+    std::string_view FieldValue(size_t index) const {
+        return View(fields_[index].second);
+    }
+
+    std::string_view Body() const {
+        return buffer_.substr(header_length_, body_length_);
+    }
+
+ private:
+    enum class Stage { RequestLine, Fields, Body };
+
+    // Part of the input, kept as an offset as the input may move whilst
+    // more of it arrives.
+    struct Slice {
+        size_t offset;
+        size_t length;
+    };
+
+    std::string_view buffer_;
+    Stage stage_;
+
+    // Start of the first line not yet parsed, and how far it has been
+    // searched for its end.
+    size_t line_start_;
+    size_t searched_;
+
+    Slice method_;
+    Slice target_;
+    Slice version_;
+    std::vector<std::pair<Slice, Slice>> fields_;
+
+    size_t header_length_;
+    size_t body_length_;
+    bool content_length_seen_;
+
+    std::string_view View(Slice slice) const {
+        return buffer_.substr(slice.offset, slice.length);
+    }
+
+    Slice ToSlice(std::string_view part) const {
+        return { static_cast<size_t>(part.data() - buffer_.data()),
+                 part.size() };
+    }
+
+    void ParseRequestLine(std::string_view line);
+
+    void ParseField(std::string_view line);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_REQUESTPARSER_H_
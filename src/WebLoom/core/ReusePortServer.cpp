@@ -0,0 +1,71 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <chrono>               // NOLINT(build/c++11)
+#include <exception>
+#include <utility>
+#include "ReusePortServer.h"
+
+namespace webloom::core {
+
+// How often the supervising thread checks whether a shutdown has been
+// requested, either by the application or by a failed listener.
+constexpr auto SHUTDOWN_POLL_INTERVAL = std::chrono::milliseconds(250);
+
+ReusePortServer::ReusePortServer(Logger *logger,
+                                 unsigned int listenerCount,
+                                 ServerFactory factory)
+    : logger_(logger), listener_count_(listenerCount),
+      factory_(std::move(factory)), shutdown_requested_(false) {
+}
+
+ReusePortServer::~ReusePortServer() {
+    for (auto *listener : listeners_) {
+        delete listener;
+    }
+}
+
+void ReusePortServer::Run() {
+    for (unsigned int i = 0; i < listener_count_; i++) {
+        listeners_.push_back(factory_());
+    }
+
+    for (unsigned int i = 0; i < listener_count_; i++) {
+        IServer *listener = listeners_[i];
+
+        threads_.emplace_back([this, listener, i]() {
+            try {
+                listener->Run();
+            }
+            catch (std::exception &ex) {
+                logger_->LogCritical("Listener %u failed: %s", i, ex.what());
+                shutdown_requested_ = true;
+            }
+        });
+    }
+
+    logger_->LogInfo("Started %u listeners", listener_count_);
+
+    while (!shutdown_requested_) {
+        ServerLoop();
+    }
+
+    for (auto *listener : listeners_) {
+        listener->RequestShutdown();
+    }
+
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+}
+
+void ReusePortServer::RequestShutdown() {
+    shutdown_requested_ = true;
+}
+
+void ReusePortServer::ServerLoop() {
+    std::this_thread::sleep_for(SHUTDOWN_POLL_INTERVAL);
+}
+
+}   // namespace webloom::core
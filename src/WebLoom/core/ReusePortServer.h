@@ -0,0 +1,53 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_REUSEPORTSERVER_H_
+#define CORE_REUSEPORTSERVER_H_
+#include <atomic>
+#include <functional>
+#include <thread>               // NOLINT(build/c++11)
+#include <vector>
+#include "IServer.h"
+#include "Logger.h"
+
+namespace webloom::core {
+
+using ServerFactory = std::function<IServer *()>;
+
+/**
+ * @brief Runs several independent servers on the same port.
+ *
+ * Each listener is a complete server created by the factory, with its own
+ * listening socket bound using SO_REUSEPORT, accept loop, worker threads and
+ * file server, and runs on a thread of its own. The kernel balances incoming
+ * connections across the listening sockets, so nothing is shared between
+ * the listeners on the request path.
+ *
+ * This server is only available on Linux.
+ */
+class ReusePortServer : public IServer {
+ public:
+    ReusePortServer(Logger *logger,
+                    unsigned int listenerCount,
+                    ServerFactory factory);
+
+    ~ReusePortServer();
+
+    void Run();
+
+    void RequestShutdown();
+
+ private:
+    Logger *logger_;
+    unsigned int listener_count_;
+    ServerFactory factory_;
+    std::atomic<bool> shutdown_requested_;
+    std::vector<IServer *> listeners_;
+    std::vector<std::thread> threads_;
+
+    void ServerLoop();
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_REUSEPORTSERVER_H_
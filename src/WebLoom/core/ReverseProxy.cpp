@@ -0,0 +1,790 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ReverseProxy.h"
+#include "HttpContentType.h"
+#include "WebLoomExceptions.h"
+#include "core/HttpStatus.h"
+
+namespace webloom::core {
+
+// Amount read from an upstream socket at a time, and the most of a chunked
+// body passed on in one part.
+constexpr size_t UPSTREAM_READ_SIZE = 16 * 1024;
+
+// Largest response header accepted from upstream.
+constexpr size_t MAX_UPSTREAM_HEADER_SIZE = 64 * 1024;
+
+// Longest chunk size or trailer line accepted in a chunked body.
+constexpr size_t MAX_CHUNK_LINE_LENGTH = 4096;
+
+// Most hex digits in a chunk size, enough for any 64 bit length.
+constexpr size_t MAX_CHUNK_SIZE_DIGITS = 16;
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+constexpr int UPSTREAM_SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int UPSTREAM_SEND_FLAGS = 0;
+#endif
+
+// Fields about one connection rather than the message (RFC 9110 section
+// 7.6.1), which are not passed on in either direction.
+static const char *const HOP_BY_HOP_FIELDS[] = {
+    "connection", "keep-alive", "proxy-connection", "te", "trailer",
+    "transfer-encoding", "upgrade" };
+
+static std::string Lower(std::string_view text) {
+    std::string lower(text);
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return lower;
+}
+
+static std::string_view Trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+
+    return text;
+}
+
+/**
+ * @brief Reads the size at the start of a chunk's size line, which has to be
+ *        hex digits alone, followed by nothing or by chunk extensions.
+ *
+ * @return false if the line is malformed or the size too large.
+ */
+static bool ParseChunkSize(std::string_view line, size_t *size) {
+    size_t digits = line.find_first_not_of("0123456789abcdefABCDEF");
+    if (digits == std::string_view::npos) {
+        digits = line.size();
+    }
+
+    if (digits == 0 || digits > MAX_CHUNK_SIZE_DIGITS ||
+        (digits < line.size() && line[digits] != ';')) {
+        return false;
+    }
+
+    uint64_t value = 0;
+    for (size_t i = 0; i < digits; i++) {
+        char c = line[i];
+        value = (value << 4) |
+                static_cast<uint64_t>(c <= '9' ? c - '0' :
+                                      (c | 0x20) - 'a' + 10);
+    }
+
+    if (value > SIZE_MAX) {
+        return false;
+    }
+
+    *size = static_cast<size_t>(value);
+    return true;
+}
+
+static bool IsHopByHop(const std::string &name) {
+    return std::find(std::begin(HOP_BY_HOP_FIELDS),
+                     std::end(HOP_BY_HOP_FIELDS),
+                     name) != std::end(HOP_BY_HOP_FIELDS);
+}
+
+static const char *MethodName(RequestMethod method) {
+    switch (method) {
+        case RequestMethod::Get: return "GET";
+        case RequestMethod::Post: return "POST";
+        case RequestMethod::Put: return "PUT";
+        case RequestMethod::Patch: return "PATCH";
+        case RequestMethod::Delete: return "DELETE";
+        case RequestMethod::Head: return "HEAD";
+        case RequestMethod::Options: return "OPTIONS";
+    }
+
+    return "GET";
+}
+
+/**
+ * @brief Checks whether a request can be sent again when it may already
+ *        have been handled, its effect being the same (RFC 9110 section
+ *        9.2.2).
+ */
+static bool IsIdempotent(RequestMethod method) {
+    return method == RequestMethod::Get || method == RequestMethod::Head ||
+           method == RequestMethod::Put || method == RequestMethod::Delete ||
+           method == RequestMethod::Options;
+}
+
+static bool SendAll(SOCKET socket, const std::string &data) {
+    size_t sent = 0;
+
+    while (sent < data.size()) {
+        auto amount = send(socket, data.data() + sent,
+                           static_cast<int>(data.size() - sent),
+                           UPSTREAM_SEND_FLAGS);
+        if (amount == SOCKET_ERROR) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        sent += static_cast<size_t>(amount);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads whatever the upstream socket has next onto the end of the
+ *        buffer, waiting for it up to the socket's timeout.
+ *
+ * @return The number of bytes read, 0 if the server closed the connection
+ *         or -1 with errno set.
+ */
+static int Receive(SOCKET socket, std::string *buffer, size_t limit) {
+    size_t used = buffer->size();
+    buffer->resize(used + limit);
+
+    int amount;
+    do {
+        amount = static_cast<int>(recv(socket, &(*buffer)[used],
+                                       static_cast<int>(limit), 0));
+    } while (amount == SOCKET_ERROR && errno == EINTR);
+
+    buffer->resize(used + (amount > 0 ? amount : 0));
+    return amount;
+}
+
+static bool TimedOut(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK;
+}
+
+/**
+ * @brief An upstream connection part way through a response body, which
+ *        goes back to the pool once the body has been read in full.
+ *
+ * The response's chunk source reads the body through it. Should the
+ * response be dropped before then, the connection is closed instead.
+ */
+class UpstreamBody {
+ public:
+    UpstreamBody(UpstreamPool *pool,
+                 SOCKET socket,
+                 size_t maxIdle,
+                 bool reusable,
+                 std::string pending)
+        : pool_(pool), socket_(socket), max_idle_(maxIdle),
+          reusable_(reusable), pending_(std::move(pending)), remaining_(0),
+          chunk_remaining_(0), chunk_ended_(false) {}
+
+    ~UpstreamBody() {
+        if (socket_ != INVALID_SOCKET) {
+            pool_->Discard(socket_);
+        }
+    }
+
+    UpstreamBody(const UpstreamBody &) = delete;
+    UpstreamBody &operator=(const UpstreamBody &) = delete;
+
+    std::string &Pending() { return pending_; }
+
+    // Whether the connection can go back to the pool once the body has
+    // been read, which is only known once the header has been parsed.
+    void Reusable(bool reusable) { reusable_ = reusable; }
+
+    void Finish();
+
+    void ExpectLength(size_t length);
+
+    bool NextWithLength(ChunkWriter &writer);
+
+    bool NextChunked(ChunkWriter &writer);
+
+    bool NextUntilClosed(ChunkWriter &writer);
+
+ private:
+    UpstreamPool *pool_;
+    SOCKET socket_;
+    size_t max_idle_;
+    bool reusable_;
+
+    // Body bytes that have been read but not yet passed on.
+    std::string pending_;
+
+    // Bytes of a body with a known length still to come.
+    size_t remaining_;
+
+    // Bytes of the current chunk still to come, and whether the line break
+    // ending a chunk's data is still to be read.
+    size_t chunk_remaining_;
+    bool chunk_ended_;
+
+    void Fill(size_t limit);
+
+    std::string ReadLine();
+};
+
+/**
+ * @brief Hands the connection back to the pool, or closes it if the server
+ *        won't take further requests on it.
+ */
+void UpstreamBody::Finish() {
+    if (socket_ == INVALID_SOCKET) {
+        return;
+    }
+
+    if (reusable_ && pending_.empty()) {
+        pool_->Release(socket_, max_idle_);
+    } else {
+        pool_->Discard(socket_);
+    }
+    socket_ = INVALID_SOCKET;
+}
+
+void UpstreamBody::ExpectLength(size_t length) {
+    remaining_ = length;
+
+    // Anything after the body is more than was asked for.
+    if (pending_.size() > length) {
+        pending_.resize(length);
+        reusable_ = false;
+    }
+}
+
+/**
+ * @throws std::runtime_error if the server closed the connection or the read
+ *         failed.
+ */
+void UpstreamBody::Fill(size_t limit) {
+    int amount = Receive(socket_, &pending_, limit);
+    if (amount > 0) {
+        return;
+    }
+
+    if (amount == 0) {
+        throw std::runtime_error("Upstream closed the connection before the "
+                                 "end of the body");
+    }
+
+    throw std::runtime_error(TimedOut(errno) ?
+                             "Upstream body timed out" :
+                             "Unable to read upstream body");
+}
+
+std::string UpstreamBody::ReadLine() {
+    size_t end;
+    while ((end = pending_.find("\r\n")) == std::string::npos) {
+        if (pending_.size() > MAX_CHUNK_LINE_LENGTH) {
+            throw std::runtime_error("Upstream chunk line too long");
+        }
+        Fill(UPSTREAM_READ_SIZE);
+    }
+
+    std::string line = pending_.substr(0, end);
+    pending_.erase(0, end + 2);
+    return line;
+}
+
+/**
+ * @brief Passes on the next part of a body with a known length.
+ *
+ * Once what arrived with the header has gone, the body is spliced from the
+ * upstream socket where the client's connection takes spliced data.
+ */
+bool UpstreamBody::NextWithLength(ChunkWriter &writer) {
+    if (!pending_.empty()) {
+        writer.Write(pending_);
+        remaining_ -= pending_.size();
+        pending_.clear();
+    } else if (writer.CanSplice()) {
+        size_t moved = writer.Splice(socket_, remaining_);
+        if (moved == 0) {
+            throw std::runtime_error("Upstream closed the connection before "
+                                     "the end of the body");
+        }
+        remaining_ -= moved;
+    } else {
+        Fill(std::min(remaining_, UPSTREAM_READ_SIZE));
+        writer.Write(pending_);
+        remaining_ -= pending_.size();
+        pending_.clear();
+    }
+
+    if (remaining_ == 0) {
+        Finish();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Decodes the next part of a chunked body, which the response frames
+ *        again as the client's connection needs.
+ *
+ * What has arrived is passed on rather than waiting for more, so that a body
+ * trickling out of the server reaches the client as it comes.
+ */
+bool UpstreamBody::NextChunked(ChunkWriter &writer) {
+    std::string data;
+
+    while (data.size() < UPSTREAM_READ_SIZE) {
+        if (chunk_remaining_ == 0) {
+            size_t from = chunk_ended_ ? 2 : 0;
+            if (!data.empty() && (pending_.size() < from ||
+                pending_.find("\r\n", from) == std::string::npos)) {
+                break;
+            }
+
+            if (chunk_ended_) {
+                if (!ReadLine().empty()) {
+                    throw std::runtime_error("Malformed upstream chunk");
+                }
+                chunk_ended_ = false;
+            }
+
+            size_t size;
+            if (!ParseChunkSize(ReadLine(), &size)) {
+                throw std::runtime_error("Malformed upstream chunk size");
+            }
+
+            if (size == 0) {
+                // Trailer fields are not passed on.
+                while (!ReadLine().empty()) {
+                }
+
+                writer.Write(data);
+                Finish();
+                return false;
+            }
+
+            chunk_remaining_ = size;
+        }
+
+        if (pending_.empty()) {
+            if (!data.empty()) {
+                break;
+            }
+            Fill(UPSTREAM_READ_SIZE);
+        }
+
+        size_t amount = std::min(pending_.size(), chunk_remaining_);
+        data.append(pending_, 0, amount);
+        pending_.erase(0, amount);
+
+        chunk_remaining_ -= amount;
+        chunk_ended_ = chunk_remaining_ == 0;
+    }
+
+    writer.Write(data);
+    return true;
+}
+
+/**
+ * @brief Passes on the next part of a body that ends when the server
+ *        closes the connection.
+ */
+bool UpstreamBody::NextUntilClosed(ChunkWriter &writer) {
+    if (pending_.empty()) {
+        int amount = Receive(socket_, &pending_, UPSTREAM_READ_SIZE);
+        if (amount == 0) {
+            Finish();
+            return false;
+        }
+
+        if (amount < 0) {
+            throw std::runtime_error(TimedOut(errno) ?
+                                     "Upstream body timed out" :
+                                     "Unable to read upstream body");
+        }
+    }
+
+    writer.Write(pending_);
+    pending_.clear();
+    return true;
+}
+
+ReverseProxy::ReverseProxy(Logger *logger, WebLoomSettings *settings)
+    : logger_(logger), settings_(settings) {
+}
+
+/**
+ * @brief Sends a request to the upstream server and returns its answer.
+ *
+ * Interim 1xx answers are skipped. Header fields are passed on both ways
+ * except for those about the connection, repeated response fields being
+ * joined into one with commas.
+ *
+ * @param pool Connections to the upstream server.
+ * @param request The client's request, whose body has been read in full.
+ * @return A dynamically allocated Response, owned by the caller.
+ * @throws RequestRejected with 502 Bad Gateway if the server can't be
+ *         reached or its answer is invalid, or 504 Gateway Timeout if it
+ *         doesn't answer in time.
+ */
+Response *ReverseProxy::Forward(UpstreamPool *pool, Request *request) {
+    std::string header = SerialiseRequest(pool, request);
+
+    SOCKET socket;
+    UpstreamHead head;
+    std::string rest;
+    Exchange(pool, header, request->Body(),
+             IsIdempotent(request->Method()), &socket, &head, &rest);
+
+    // Owns the connection from here on, so that it is closed if the answer
+    // turns out to be invalid.
+    auto body = std::make_shared<UpstreamBody>(
+        pool, socket, settings_->ProxyMaxIdleConnections(), false,
+        std::move(rest));
+
+    Header forwarded;
+    std::vector<std::string> connectionOptions;
+    std::vector<std::pair<std::string, std::string>> fields;
+    bool chunked = false;
+    bool encoded = false;
+    bool hasLength = false;
+    size_t length = 0;
+
+    for (auto &field : head.fields) {
+        std::string name = Lower(field.first);
+
+        if (name == "connection") {
+            size_t start = 0;
+            while (start <= field.second.size()) {
+                size_t end = field.second.find(',', start);
+                connectionOptions.push_back(Lower(Trim(
+                    std::string_view(field.second).substr(start,
+                                                          end - start))));
+                if (end == std::string::npos) {
+                    break;
+                }
+                start = end + 1;
+            }
+        } else if (name == "transfer-encoding") {
+            encoded = true;
+            std::string codings = Lower(field.second);
+            chunked = codings.size() >= 7 &&
+                      codings.compare(codings.size() - 7, 7, "chunked") == 0;
+        } else if (name == "content-length") {
+            char *end = nullptr;
+            errno = 0;
+            unsigned long long value = strtoull(field.second.c_str(), &end,
+                                                10);
+            if (field.second.empty() || *end != '\0' || errno == ERANGE ||
+                !isdigit(static_cast<unsigned char>(field.second[0])) ||
+                (hasLength && value != length)) {
+                throw RequestRejected(HttpStatus::BadGateway,
+                                      "Invalid upstream Content-Length");
+            }
+            hasLength = true;
+            length = static_cast<size_t>(value);
+        }
+    }
+
+    // Repeated fields become one, their values joined in order.
+    for (auto &field : head.fields) {
+        std::string name = Lower(field.first);
+        if (IsHopByHop(name) || name == "content-length" ||
+            std::find(connectionOptions.begin(), connectionOptions.end(),
+                      name) != connectionOptions.end()) {
+            continue;
+        }
+
+        if (name == "content-type") {
+            field.first = HEADER_KEY_CONTENT_TYPE;
+        }
+
+        auto it = std::find_if(fields.begin(), fields.end(),
+                               [&name](const auto &existing) {
+                                   return Lower(existing.first) == name;
+                               });
+        if (it == fields.end()) {
+            fields.emplace_back(std::move(field));
+        } else {
+            it->second += ", " + field.second;
+        }
+    }
+
+    for (auto &field : fields) {
+        forwarded.Add(std::move(field.first), std::move(field.second));
+    }
+
+    // Without a length the body only ends with the connection.
+    bool delimited = chunked || (hasLength && !encoded);
+    bool noBody = request->Method() == RequestMethod::Head ||
+                  head.status == 204 || head.status == 304;
+
+    body->Reusable(head.keepAlive && (delimited || noBody));
+
+    auto status = static_cast<HttpStatus>(head.status);
+    auto contentType = HttpContentType::ApplicationOctetStream;
+
+    Response *response;
+
+    if (noBody) {
+        body->ExpectLength(0);
+        body->Finish();
+        response = new Response(status, "", contentType);
+
+        // The length of what a GET would have had is passed on, a 204 may
+        // not have one at all.
+        bool announcesLength = hasLength && head.status >= 200 &&
+                               head.status != 204;
+        response->OmitBody(announcesLength ? std::optional<size_t>(length) :
+                                             std::nullopt);
+    } else if (chunked) {
+        response = new Response(status, [body](ChunkWriter &writer) {
+            return body->NextChunked(writer);
+        }, contentType);
+    } else if (!delimited) {
+        response = new Response(status, [body](ChunkWriter &writer) {
+            return body->NextUntilClosed(writer);
+        }, contentType);
+    } else if (body->Pending().size() >= length) {
+        // The body arrived along with the header.
+        body->ExpectLength(length);
+        response = new Response(status, std::move(body->Pending()),
+                                contentType);
+        body->Pending().clear();
+        body->Finish();
+    } else {
+        body->ExpectLength(length);
+        response = new Response(status, [body](ChunkWriter &writer) {
+            return body->NextWithLength(writer);
+        }, contentType);
+        response->StreamLength(length);
+    }
+
+    response->ResponseHeader(forwarded);
+    response->FromUpstream(true);
+    return response;
+}
+
+/**
+ * @brief Serialises the request as HTTP/1.1 for the upstream server, asking
+ *        for the connection to be kept open.
+ */
+std::string ReverseProxy::SerialiseRequest(UpstreamPool *pool,
+                                           Request *request) {
+    std::string host = request->RemoteHost();
+    if (host.empty()) {
+        host = pool->Host() + ":" + std::to_string(pool->Port());
+    }
+
+    std::string header = std::string(MethodName(request->Method())) + " " +
+                         request->Path() + " HTTP/1.1\r\n"
+                         "Host: " + host + "\r\n";
+
+    if (!request->UserAgent().empty()) {
+        header += "User-Agent: " + request->UserAgent() + "\r\n";
+    }
+
+    Header fields = request->Headers();
+    for (const auto &key : fields.AllKeys()) {
+        std::string name = Lower(key);
+
+        // The body has been read in full, so it is sent with its length
+        // whatever framing the client used.
+        if (IsHopByHop(name) || name == "host" || name == "user-agent" ||
+            name == "content-length" || name == "expect") {
+            continue;
+        }
+
+        header += key + ": " + *fields.Get(key) + "\r\n";
+    }
+
+    RequestMethod method = request->Method();
+    if (!request->Body().empty() || method == RequestMethod::Post ||
+        method == RequestMethod::Put || method == RequestMethod::Patch) {
+        header += "Content-Length: " +
+                  std::to_string(request->Body().size()) + "\r\n";
+    }
+
+    header += "Connection: keep-alive\r\n\r\n";
+    return header;
+}
+
+/**
+ * @brief Sends the request and reads the header of the final answer.
+ *
+ * A pooled connection may have been closed by the server just as it was
+ * taken, so a request that fails on one before any answer arrives is sent
+ * again on another connection. Only idempotent requests are, the server
+ * may have handled the request before the connection failed.
+ *
+ * @param idempotent The request can safely be sent more than once.
+ * @param socket Set to the connection, which the caller then owns.
+ * @param head Set to the parsed header of the answer.
+ * @param rest Set to whatever arrived after the header.
+ * @throws RequestRejected if the exchange fails.
+ */
+void ReverseProxy::Exchange(UpstreamPool *pool,
+                            const std::string &header,
+                            const std::string &body,
+                            bool idempotent,
+                            SOCKET *socket,
+                            UpstreamHead *head,
+                            std::string *rest) {
+    unsigned int timeout = settings_->ProxyTimeout();
+
+    while (true) {
+        bool reused = false;
+
+        try {
+            *socket = pool->Acquire(timeout, &reused);
+        }
+        catch (std::runtime_error &ex) {
+            throw RequestRejected(HttpStatus::BadGateway, ex.what());
+        }
+
+        std::string received;
+        bool answered = false;
+        int error = 0;
+
+        if (!SendAll(*socket, header) ||
+            (!body.empty() && !SendAll(*socket, body))) {
+            error = errno;
+        }
+
+        while (error == 0) {
+            size_t end = received.find("\r\n\r\n");
+
+            if (end != std::string::npos) {
+                if (!ParseHead(std::string_view(received).substr(0, end + 2),
+                               head)) {
+                    pool->Discard(*socket);
+                    throw RequestRejected(HttpStatus::BadGateway,
+                                          "Invalid upstream response");
+                }
+
+                received.erase(0, end + 4);
+
+                // Interim answers are followed by the final one.
+                if (head->status < 200) {
+                    continue;
+                }
+
+                *rest = std::move(received);
+                return;
+            }
+
+            if (received.size() > MAX_UPSTREAM_HEADER_SIZE) {
+                pool->Discard(*socket);
+                throw RequestRejected(HttpStatus::BadGateway,
+                                      "Upstream response header too large");
+            }
+
+            int amount = Receive(*socket, &received, UPSTREAM_READ_SIZE);
+            if (amount <= 0) {
+                error = amount == 0 ? ECONNRESET : errno;
+                break;
+            }
+            answered = true;
+        }
+
+        pool->Discard(*socket);
+
+        if (reused && idempotent && !answered && !TimedOut(error)) {
+            logger_->LogDebug("Pooled upstream connection to '%s' failed, "
+                              "retrying on another",
+                              pool->Host().c_str());
+            continue;
+        }
+
+        if (TimedOut(error)) {
+            throw RequestRejected(HttpStatus::GatewayTimeout,
+                                  "Upstream '" + pool->Host() +
+                                  "' did not answer in time");
+        }
+
+        throw RequestRejected(HttpStatus::BadGateway,
+                              "Upstream '" + pool->Host() + "' failed: " +
+                              strerror(error));
+    }
+}
+
+/**
+ * @brief Parses the status line and fields of an answer's header.
+ *
+ * @param text The header, without the empty line ending it.
+ * @return false if the header is malformed.
+ */
+bool ReverseProxy::ParseHead(std::string_view text, UpstreamHead *head) {
+    size_t lineEnd = text.find("\r\n");
+    std::string_view statusLine = text.substr(0, lineEnd);
+
+    if (statusLine.size() < 12 || statusLine.substr(0, 5) != "HTTP/" ||
+        statusLine[8] != ' ') {
+        return false;
+    }
+
+    int status = 0;
+    for (size_t i = 9; i < 12; i++) {
+        if (!isdigit(static_cast<unsigned char>(statusLine[i]))) {
+            return false;
+        }
+        status = status * 10 + (statusLine[i] - '0');
+    }
+
+    if (status < 100) {
+        return false;
+    }
+
+    head->status = status;
+    head->keepAlive = statusLine.substr(5, 3) == "1.1";
+    head->fields.clear();
+
+    size_t start = lineEnd + 2;
+    while (start < text.size()) {
+        size_t end = text.find("\r\n", start);
+        std::string_view line = text.substr(start, end - start);
+        start = end == std::string_view::npos ? text.size() : end + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0) {
+            return false;
+        }
+
+        std::string name(line.substr(0, colon));
+        std::string value(Trim(line.substr(colon + 1)));
+
+        if (Lower(name) == "connection") {
+            std::string_view options = value;
+            while (!options.empty()) {
+                size_t comma = options.find(',');
+                std::string option = Lower(Trim(options.substr(0, comma)));
+                options = comma == std::string_view::npos ?
+                    std::string_view() : options.substr(comma + 1);
+
+                if (option == "close") {
+                    head->keepAlive = false;
+                } else if (option == "keep-alive") {
+                    head->keepAlive = true;
+                }
+            }
+        }
+
+        head->fields.emplace_back(std::move(name), std::move(value));
+    }
+
+    return true;
+}
+
+}   // namespace webloom::core
@@ -0,0 +1,65 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_REVERSEPROXY_H_
+#define CORE_REVERSEPROXY_H_
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Logger.h"
+#include "Request.h"
+#include "Response.h"
+#include "WebLoomSettings.h"
+#include "core/UpstreamPool.h"
+
+namespace webloom::core {
+
+/**
+ * @brief Forwards requests to an upstream server and turns its answers into
+ *        responses, for routes that front another server.
+ *
+ * Requests are sent over the pool's keep-alive connections. A response whose
+ * body has not fully arrived with its header is streamed to the client as
+ * it arrives from upstream, a body with a known length being spliced from
+ * the upstream socket straight into the client's where the connection allows
+ * it. The upstream connection goes back to the pool once the body has been
+ * read in full.
+ */
+class ReverseProxy {
+ public:
+    ReverseProxy(Logger *logger, WebLoomSettings *settings);
+
+    Response *Forward(UpstreamPool *pool, Request *request);
+
+ private:
+    // Status line and fields of an upstream answer.
+    struct UpstreamHead {
+        int status = 0;
+
+        // The server takes further requests on the connection.
+        bool keepAlive = false;
+
+        std::vector<std::pair<std::string, std::string>> fields;
+    };
+
+    Logger *logger_;
+    WebLoomSettings *settings_;
+
+    std::string SerialiseRequest(UpstreamPool *pool, Request *request);
+
+    void Exchange(UpstreamPool *pool,
+                  const std::string &header,
+                  const std::string &body,
+                  bool idempotent,
+                  SOCKET *socket,
+                  UpstreamHead *head,
+                  std::string *rest);
+
+    static bool ParseHead(std::string_view text, UpstreamHead *head);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_REVERSEPROXY_H_
@@ -1,15 +1,33 @@
 //  WebLoom Framework
 //  Copyright (C) 2024 WebLoom Framework contributors
 //  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+# include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>               // NOLINT(build/c++11)
 #include <cstring>
-#include <sstream>
+#include <map>
+#include <memory>
 #include <stdexcept>
+#include <string>
 #include <utility>
 #include <vector>
 #include "ServerBase.h"
+#include "core/HttpStatus.h"
+#include "core/ListenEndpoint.h"
+#include "core/ReverseProxy.h"
 #include "core/ThreadPool.h"
 #include "Header.h"
+#include "HttpContentType.h"
 #include "Request.h"
+#include "RouteHandler.h"
+#include "WebLoomExceptions.h"
 
 namespace webloom::core {
 
@@ -39,114 +57,859 @@ constexpr const char* METHOD_TYPE_DELETE = "DELETE";
 constexpr const char* METHOD_TYPE_HEAD = "HEAD";
 constexpr const char* METHOD_TYPE_OPTIONS = "OPTIONS";
 
-constexpr const char* HEADER_KEY_HOST = "Host";
-constexpr const char* HEADER_KEY_USER_AGENT = "User-Agent";
+// Field names are matched whatever their case, so these are lower case.
+constexpr const char* HEADER_KEY_HOST = "host";
+constexpr const char* HEADER_KEY_USER_AGENT = "user-agent";
 constexpr const char* HEADER_KEY_CLIENT_PLATFORM = "sec-ch-ua-platform";
+constexpr const char* HEADER_KEY_CONNECTION = "connection";
+constexpr const char* HEADER_KEY_TRANSFER_ENCODING = "transfer-encoding";
+
+constexpr size_t HEADER_TERMINATOR_LENGTH = 4;
+
+// Field names of an HTTP/2 request, which are always lower case.
+constexpr const char* HTTP2_FIELD_METHOD = ":method";
+constexpr const char* HTTP2_FIELD_PATH = ":path";
+constexpr const char* HTTP2_FIELD_SCHEME = ":scheme";
+constexpr const char* HTTP2_FIELD_AUTHORITY = ":authority";
+constexpr const char* HTTP2_FIELD_HOST = "host";
+constexpr const char* HTTP2_FIELD_USER_AGENT = "user-agent";
+constexpr const char* HTTP2_FIELD_COOKIE = "cookie";
+constexpr const char* HTTP2_FIELD_CONNECTION = "connection";
+
+constexpr const char* CONNECTION_OPTION_CLOSE = "close";
+constexpr const char* CONNECTION_OPTION_KEEP_ALIVE = "keep-alive";
 
 constexpr unsigned int MAX_THREADS = 4;
+constexpr unsigned int MAX_PROXY_THREADS = 8;
 
 ServerBase::ServerBase(Logger* logger,
                        WebLoomSettings *settings,
                        core::FileServer *fileServer)
           : logger_(logger), shutdown_requested_(false),
-            server_socket_(INVALID_SOCKET) {
+            threadpool_(nullptr), proxy_pool_(nullptr), stats_(nullptr),
+            memory_budget_(nullptr),
+            cpu_slot_(0),
+            tls_context_(nullptr), shared_listeners_(false) {
     settings_ = settings;
     file_server_ = std::move(fileServer);
 
-    // Initialize the socket_address_ structure to zero out the structure.
-    memset (&socket_address_, 0, sizeof (socket_address_));
+    if (!settings_->ReactorCpus().empty()) {
+        reactor_cpus_ = CpuSet(settings_->ReactorCpus());
+    }
+
+    if (!settings_->WorkerCpus().empty()) {
+        worker_cpus_ = CpuSet(settings_->WorkerCpus());
+    }
 
     if (!InitialiseSocketSystem()) {
         throw std::runtime_error("Socket initialisation failed!");
     }
-
-    threadpool_ = new ThreadPool(MAX_THREADS);
 }
 
 ServerBase::~ServerBase() {
+    delete proxy_pool_;
+    delete threadpool_;
     CleanupSocketSystem();
     printf("ServerBase::~ServerBase()\n");
 }
 
+/**
+ * @brief Serves connections until a shutdown is requested.
+ *
+ * The worker threads are only started here, so a server that has not been
+ * run yet can be copied into forked processes.
+ *
+ * The calling thread and the workers are pinned to their CPUs before the
+ * server allocates anything, so that their buffers are placed on the NUMA
+ * node they run on.
+ */
 void ServerBase::Run() {
-    // Create the server socket.
-    if ((server_socket_ = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET) {
-        CleanupSocketSystem();
-        throw std::runtime_error("Failed to create server socket");
+    if (listeners_.empty()) {
+        OpenListeners();
     }
 
-    // Bind to a port and IP address
-    socket_address_.sin_family = AF_INET;
-    socket_address_.sin_addr.s_addr = INADDR_ANY;
-    socket_address_.sin_port = htons(settings_->ServerNetworkPort());
+    if (!reactor_cpus_.Empty()) {
+        int cpu = reactor_cpus_.Cpu(cpu_slot_);
+        if (CpuSet::PinCurrentThread(cpu)) {
+            logger_->LogInfo("Server loop is pinned to CPU %d", cpu);
+        } else {
+            logger_->LogWarn("Unable to pin the server loop to CPU %d", cpu);
+        }
+    }
+
+    auto pinWorker = [this]() {
+        if (!worker_cpus_.Empty() && !worker_cpus_.PinCurrentThread()) {
+            logger_->LogWarn("Unable to pin a worker thread to its CPUs");
+        }
+    };
+    threadpool_ = new ThreadPool(MAX_THREADS, pinWorker);
+    proxy_pool_ = new ThreadPool(MAX_PROXY_THREADS, pinWorker);
+
+    InitialiseServerLoop();
 
-    if (bind(server_socket_, (struct sockaddr*)&socket_address_,
-             sizeof(socket_address_)) == SOCKET_ERROR) {
-        closesocket(server_socket_);
+    while (!shutdown_requested_) {
+        ServerLoop();
+    }
+
+    // New connections are refused from here on, so that clients go to
+    // another instance rather than waiting on this one.
+    auto drainStarted = std::chrono::steady_clock::now();
+    CloseListeners();
+
+    DrainConnections(drainStarted +
+                     std::chrono::seconds(settings_->DrainTimeout()));
+
+    ShutdownServerLoop();
+
+    // Waits for any handler still running on a worker.
+    delete proxy_pool_;
+    proxy_pool_ = nullptr;
+    delete threadpool_;
+    threadpool_ = nullptr;
+
+    auto drainTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - drainStarted);
+    logger_->LogInfo("Server stopped, draining took %lld ms",
+                     static_cast<long long>(drainTime.count()));
+    logger_->Flush();
+
+    CleanupSocketSystem();
+}
+
+/**
+ * @brief Opens the listening sockets ahead of Run(), for the worker
+ *        processes forked afterwards to accept connections from together.
+ *
+ * @throws std::runtime_error if a socket can't be set up.
+ */
+void ServerBase::ShareListeners() {
+    OpenListeners();
+    shared_listeners_ = true;
+}
+
+/**
+ * @brief Counts the connections and requests the server handles into stats,
+ *        which has to outlive the server.
+ */
+void ServerBase::CountInto(ServerStats *stats) {
+    stats_ = stats;
+}
+
+/**
+ * @brief Picks the CPU of the reactor CPUs the server loop is pinned to,
+ *        for each of several servers sharing them to take its own.
+ */
+void ServerBase::AssignCpuSlot(unsigned int slot) {
+    cpu_slot_ = slot;
+}
+
+/**
+ * @brief Serves every connection over TLS, with the certificate and session
+ *        caches of the context, which has to outlive the server.
+ */
+void ServerBase::EnableTls(TlsContext *context) {
+    tls_context_ = context;
+}
+
+/**
+ * @brief Charges the connection buffers and queued output of the server to
+ *        a memory budget, which has to outlive the server.
+ *
+ * Whilst the budget is exhausted new connections are turned away and the
+ * reactor based servers stop reading and handling requests, carrying on
+ * once enough memory has been released.
+ */
+void ServerBase::TrackMemory(MemoryBudget *budget) {
+    memory_budget_ = budget;
+    buffer_pool_.Account(budget);
+}
+
+/**
+ * @brief Stops the server, letting the requests in progress finish.
+ *
+ * The server stops accepting straight away and Run() returns once the
+ * connections have drained or the drain timeout has passed. Safe to call
+ * from a signal handler.
+ */
+void ServerBase::RequestShutdown() {
+    if (shutdown_requested_) {
+        return;
+    }
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    // Shutting down the listening sockets wakes whatever is waiting on them,
+    // the server loop would otherwise only notice on its next timeout. This
+    // comes before the flag is set, as the sockets are closed once it is.
+    // Sockets shared with other worker processes are left alone, shutting
+    // them down would stop every worker accepting.
+    for (const auto &listener : listeners_) {
+        if (!shared_listeners_) {
+            shutdown(listener.socket, SHUT_RD);
+        }
+    }
+#endif
+
+    shutdown_requested_ = true;
+}
+
+/**
+ * @brief Opens a listening socket for every endpoint in the settings.
+ *
+ * @throws std::runtime_error if a socket can't be set up, the sockets
+ *         already opened are closed again.
+ */
+void ServerBase::OpenListeners() {
+    std::vector<std::string> endpoints = settings_->ListenEndpoints();
+    if (endpoints.empty()) {
+        endpoints.push_back("*:" +
+                            std::to_string(settings_->ServerNetworkPort()));
+    }
+
+    try {
+        for (const auto &text : endpoints) {
+            ListenEndpoint endpoint(text);
+            listeners_.push_back({ OpenListener(endpoint), endpoint });
+            logger_->LogInfo("Server is listening on %s", text.c_str());
+        }
+    }
+    catch (std::exception &) {
+        CloseListeners();
         CleanupSocketSystem();
-        throw std::runtime_error("Failed to bind server socket");
+        throw;
+    }
+}
+
+/**
+ * @brief Creates a socket listening on the endpoint.
+ *
+ * @throws std::runtime_error if the socket can't be set up, nothing is left
+ *         open when it fails.
+ */
+SOCKET ServerBase::OpenListener(const ListenEndpoint &endpoint) {
+    const std::string &text = endpoint.Text();
+
+    SOCKET listener = socket(endpoint.Family(), SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET) {
+        throw std::runtime_error("Failed to create server socket for " + text);
+    }
+
+    int enable = 1;
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (endpoint.IsUnixSocket()) {
+        // A socket file can't be shared, only one listener could bind it.
+        if (settings_->ListenerCount() > 1) {
+            closesocket(listener);
+            throw std::runtime_error("Unix domain socket " + text + " can't "
+                                     "be used with several listeners");
+        }
+
+        RemoveStaleSocketFile(endpoint);
+    } else {
+        // Allow a restarted server to bind whilst connections from the
+        // previous instance are still in TIME_WAIT.
+        if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR,
+                       &enable, sizeof(enable)) == SOCKET_ERROR) {
+            logger_->LogWarn("Unable to set SO_REUSEADDR on server socket");
+        }
+
+        // With several listeners each one binds its own socket to the port
+        // and the kernel spreads incoming connections across them.
+        if (settings_->ListenerCount() > 1 &&
+            setsockopt(listener, SOL_SOCKET, SO_REUSEPORT,
+                       &enable, sizeof(enable)) == SOCKET_ERROR) {
+            closesocket(listener);
+            throw std::runtime_error("Unable to set SO_REUSEPORT on server "
+                                     "socket");
+        }
+    }
+#endif
+
+    // An IPv6 listener leaves IPv4 to a listener of its own, rather than
+    // taking the port for both.
+    if (endpoint.Family() == AF_INET6 &&
+        setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY,
+                   reinterpret_cast<const char *>(&enable),
+                   sizeof(enable)) == SOCKET_ERROR) {
+        logger_->LogWarn("Unable to set IPV6_V6ONLY on server socket");
+    }
+
+    if (bind(listener, endpoint.Address(),
+             endpoint.AddressLength()) == SOCKET_ERROR) {
+        closesocket(listener);
+        throw std::runtime_error("Failed to bind server socket to " + text);
     }
 
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (!endpoint.IsUnixSocket()) {
+        // Only wake the accept loop once the client has sent its request.
+        int deferAcceptTimeout = settings_->DeferAcceptTimeout();
+        if (deferAcceptTimeout > 0 &&
+            setsockopt(listener, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                       &deferAcceptTimeout,
+                       sizeof(deferAcceptTimeout)) == SOCKET_ERROR) {
+            logger_->LogWarn("Unable to set TCP_DEFER_ACCEPT on server "
+                             "socket");
+        }
+
+        // Let returning clients send their request in the SYN.
+        int fastOpenQueueLength = settings_->FastOpenQueueLength();
+        if (fastOpenQueueLength > 0 &&
+            setsockopt(listener, IPPROTO_TCP, TCP_FASTOPEN,
+                       &fastOpenQueueLength,
+                       sizeof(fastOpenQueueLength)) == SOCKET_ERROR) {
+            logger_->LogWarn("Unable to set TCP_FASTOPEN on server socket");
+        }
+    }
+#endif
+
     // Start listening for connections
-    if (listen(server_socket_, 3) == SOCKET_ERROR) {
+    if (listen(listener, settings_->ListenBacklog()) == SOCKET_ERROR) {
         int errorCode = 0;
 #if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
         errorCode = WSAGetLastError();
 #elif (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
         errorCode = errno;
 #endif
-        closesocket(server_socket_);
-        CleanupSocketSystem();
+        closesocket(listener);
+        endpoint.RemoveSocketFile();
         throw std::runtime_error("Server socket listen failed with error code: "
-            + errorCode);
+            + std::to_string(errorCode));
     }
 
-    logger_->LogInfo("Server is listening on port %d",
-                     settings_->ServerNetworkPort());
+    return listener;
+}
 
-    while (!shutdown_requested_) {
-        ServerLoop();
+/**
+ * @brief Closes every listening socket, removing the files of Unix domain
+ *        sockets.
+ */
+void ServerBase::CloseListeners() {
+    for (const auto &listener : listeners_) {
+        closesocket(listener.socket);
+        listener.endpoint.RemoveSocketFile();
     }
 
-    // Close the server socket
-    closesocket(server_socket_);
-    CleanupSocketSystem();
+    listeners_.clear();
 }
 
-void ServerBase::RequestShutdown() {
-    shutdown_requested_ = true;
+/**
+ * @brief Removes a socket file left behind by a server that is no longer
+ *        running, so that the endpoint can be bound again.
+ *
+ * A socket nothing is listening on refuses connections. The file is left
+ * alone if anything else is there, binding then fails.
+ */
+void ServerBase::RemoveStaleSocketFile(const ListenEndpoint &endpoint) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    const std::string &path = endpoint.SocketPath();
+
+    struct stat status;
+    if (path.empty() || stat(path.c_str(), &status) == -1 ||
+        !S_ISSOCK(status.st_mode)) {
+        return;
+    }
+
+    SOCKET probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe == INVALID_SOCKET) {
+        return;
+    }
+
+    if (connect(probe, endpoint.Address(),
+                endpoint.AddressLength()) == SOCKET_ERROR &&
+        errno == ECONNREFUSED) {
+        logger_->LogInfo("Removing stale socket file %s", path.c_str());
+        endpoint.RemoveSocketFile();
+    }
+
+    closesocket(probe);
+#endif
+}
+
+/**
+ * @brief Applies the options every accepted connection uses, and counts the
+ *        connection.
+ *
+ * Nagle's algorithm is disabled as responses are written in full with a
+ * single vectored send, holding back the last partial segment would only
+ * delay it until the client acknowledges the previous one.
+ */
+void ServerBase::ConfigureClientSocket(SOCKET socket,
+                                       const Listener &listener) {
+    if (stats_) {
+        stats_->connections.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (listener.endpoint.IsUnixSocket()) {
+        return;
+    }
+
+    int enable = 1;
+    if (setsockopt(socket, IPPROTO_TCP, TCP_NODELAY,
+                   reinterpret_cast<const char *>(&enable),
+                   sizeof(enable)) == SOCKET_ERROR) {
+        logger_->LogDebug("Unable to set TCP_NODELAY on client socket");
+    }
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX) && defined(SO_BUSY_POLL)
+    // Raising the budget above net.core.busy_read needs CAP_NET_ADMIN.
+    int busyPollBudget = static_cast<int>(settings_->BusyPollBudget());
+    if (busyPollBudget > 0 &&
+        setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &busyPollBudget,
+                   sizeof(busyPollBudget)) == SOCKET_ERROR) {
+        logger_->LogDebug("Unable to set SO_BUSY_POLL on client socket");
+    }
+
+# ifdef SO_PREFER_BUSY_POLL
+    if (busyPollBudget > 0 &&
+        setsockopt(socket, SOL_SOCKET, SO_PREFER_BUSY_POLL, &enable,
+                   sizeof(enable)) == SOCKET_ERROR) {
+        logger_->LogDebug("Unable to set SO_PREFER_BUSY_POLL on client "
+                          "socket");
+    }
+# endif
+#endif
 }
 
-Request *ServerBase::ProcessRequest(const std::vector<char>& buffer) {
-    std::string request_str(buffer.data());
+/**
+ * @brief Checks whether another connection would exceed the connection
+ *        limit, a limit of 0 allows any number. No connection is taken on
+ *        whilst the memory budget is exhausted either.
+ */
+bool ServerBase::ConnectionLimitReached(size_t openConnections) {
+    unsigned int limit = settings_->MaxConnections();
+    return (limit != 0 && openConnections >= limit) ||
+           MemoryBudgetExhausted();
+}
 
-    // Split the request into headers and body
-    std::string headers;
-    std::string body;
-    SplitRequestIntoHeadersAndBody(request_str, &headers, &body);
+bool ServerBase::MemoryBudgetExhausted() {
+    return memory_budget_ && memory_budget_->Exhausted();
+}
 
-    // Split request into lines (delimited by \r\n)
-    std::istringstream request_stream(buffer.data());
-    std::string line;
+/**
+ * @brief Charges memory to the budget the server is tracked by, if any. Safe
+ *        to call from the worker threads, as is RefundMemory().
+ */
+void ServerBase::ChargeMemory(MemoryBudget::Use use, size_t bytes) {
+    if (memory_budget_) {
+        memory_budget_->Charge(use, bytes);
+    }
+}
+
+void ServerBase::RefundMemory(MemoryBudget::Use use, size_t bytes) {
+    if (memory_budget_) {
+        memory_budget_->Refund(use, bytes);
+    }
+}
 
+/**
+ * @brief Turns away a connection accepted beyond the connection limit, or
+ *        whilst the memory budget is exhausted.
+ *
+ * The client is told the server is busy with a single send that never
+ * blocks, whether or not it arrives the socket is closed straight away. A
+ * TLS client could not read the response before a handshake, so it is just
+ * closed.
+ */
+void ServerBase::RejectConnection(SOCKET socket) {
+    if (tls_context_) {
+        closesocket(socket);
+        return;
+    }
+
+    std::string response = GenerateErrorResponse(
+        HttpStatus::ServiceUnavailable);
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+    SetSocketBlocking(socket, false);
+    send(socket, response.data(), static_cast<int>(response.size()), 0);
+#else
+    send(socket, response.data(), response.size(),
+         MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+
+    closesocket(socket);
+}
+
+/**
+ * @brief Switches a socket between blocking and non-blocking mode.
+ *
+ * @return true on success.
+ */
+bool ServerBase::SetSocketBlocking(SOCKET socket, bool blocking) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+    u_long nonBlocking = blocking ? 0 : 1;
+    return ioctlsocket(socket, FIONBIO, &nonBlocking) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags == -1) {
+        return false;
+    }
+
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    return fcntl(socket, F_SETFL, flags) != -1;
+#endif
+}
+
+/**
+ * @brief Creates a request from one that has been parsed in full.
+ *
+ * The request line and header fields are taken from the parser's slices of
+ * the input, only the parts the request keeps are copied.
+ *
+ * @throws std::invalid_argument if the method or version is invalid.
+ */
+Request *ServerBase::ProcessRequest(const RequestParser &parser) {
+    auto requestTypeEnum = ParseRequestType(parser.Method());
+    auto httpVersionEnum = ParseHttpVersion(parser.Version());
+
+    Request* request = new Request(requestTypeEnum, httpVersionEnum,
+                                   std::string(parser.Target()));
+
+    try {
+        ParseHeaders(parser, request);
+    }
+    catch (...) {
+        delete request;
+        throw;
+    }
+
+    request->Body(std::string(parser.Body()));
+
+    return request;
+}
+
+/**
+ * @brief Creates a request from the header fields and body of an HTTP/2
+ *        stream.
+ *
+ * The pseudo-header fields give the method, path and host, the other fields
+ * are treated as the headers of an HTTP/1.x request are, keeping the lower
+ * case names HTTP/2 uses. A field that is repeated has its values joined
+ * into one, cookies with "; " as RFC 9113 section 8.2.3 asks.
+ *
+ * @throws std::invalid_argument if the method or path is missing or
+ *         invalid, or the request has fields HTTP/2 does not allow.
+ */
+Request *ServerBase::ProcessHttp2Request(const HeaderList &fields,
+                                         std::string body) {
     std::string method;
     std::string path;
-    std::string http_version;
-    request_stream >> method >> path >> http_version;
+    std::string host;
+    std::string userAgent;
+    std::string platform;
+    std::map<std::string, std::string> others;
+
+    for (const HeaderField &field : fields) {
+        const std::string &name = field.first;
+
+        if (name == HTTP2_FIELD_METHOD) {
+            method = field.second;
+        } else if (name == HTTP2_FIELD_PATH) {
+            path = field.second;
+        } else if (name == HTTP2_FIELD_SCHEME) {
+            continue;
+        } else if (name == HTTP2_FIELD_AUTHORITY || name == HTTP2_FIELD_HOST) {
+            host = field.second;
+        } else if (name == HTTP2_FIELD_USER_AGENT) {
+            userAgent = field.second;
+        } else if (name == HEADER_KEY_CLIENT_PLATFORM) {
+            platform = field.second;
+        } else if (name.empty() || name[0] == ':' ||
+                   name == HTTP2_FIELD_CONNECTION ||
+                   name == HEADER_KEY_TRANSFER_ENCODING ||
+                   std::any_of(name.begin(), name.end(), [](char c) {
+                       return std::isupper(static_cast<unsigned char>(c));
+                   })) {
+            throw std::invalid_argument("Invalid HTTP/2 request field '" +
+                                        name + "'");
+        } else {
+            auto inserted = others.emplace(name, field.second);
+            if (!inserted.second) {
+                inserted.first->second +=
+                    (name == HTTP2_FIELD_COOKIE ? "; " : ", ") + field.second;
+            }
+        }
+    }
+
+    if (path.empty() || path[0] != '/') {
+        throw std::invalid_argument("Invalid HTTP/2 request path");
+    }
+
+    // Everything that can fail is parsed before the request is created.
+    auto requestTypeEnum = ParseRequestType(method);
+    auto clientPlatform = UserAgentClientPlatform::Unknown;
+    if (!platform.empty()) {
+        clientPlatform = ParseUserAgentClientPlatform(platform);
+    }
+
+    webloom::Header header;
+    for (auto &entry : others) {
+        header.Add(entry.first, entry.second);
+    }
+
+    Request* request = new Request(requestTypeEnum, HttpVersion::HTTP_2_0,
+                                   path);
+    request->RemoteHost(host);
+    request->UserAgent(userAgent);
+    request->ClientPlatform(clientPlatform);
+    request->AddHeaders(header);
+    request->Body(std::move(body));
+
+    return request;
+}
+
+/**
+ * @brief Determines the length of the first request held in a buffer.
+ *
+ * A request is complete once the blank line terminating its headers has been
+ * received, along with the number of body bytes given by its
+ * 'Content-Length' header. Anything in the buffer after that belongs to the
+ * next (pipelined) request. Requests over the configured size limits are
+ * rejected as soon as that is known, without waiting for the rest of them.
+ *
+ * @param parser Parser of the connection, which carries on from where it
+ *               stopped on the last call. It has to be reset once the
+ *               request has been consumed.
+ * @param buffer Data received from the client.
+ * @return The number of bytes making up the first request, or 0 if the
+ *         request is not yet complete.
+ * @throws std::invalid_argument if the request is malformed or its body
+ *         length cannot be determined.
+ * @throws RequestRejected if the request exceeds the size limits.
+ */
+size_t ServerBase::RequestFrameLength(RequestParser *parser,
+                                      std::string_view buffer) {
+    RequestParser::Result result = parser->Parse(buffer);
+    size_t maxHeaderSize = settings_->MaxRequestHeaderSize();
+
+    if (!parser->HeadersComplete()) {
+        if (buffer.size() > maxHeaderSize) {
+            throw RequestRejected(HttpStatus::RequestHeaderFieldsTooLarge,
+                                  "Request headers too large");
+        }
+        return 0;
+    }
+
+    if (parser->HeaderLength() > maxHeaderSize + HEADER_TERMINATOR_LENGTH) {
+        throw RequestRejected(HttpStatus::RequestHeaderFieldsTooLarge,
+                              "Request headers too large");
+    }
+
+    if (parser->BodyLength() > settings_->MaxRequestBodySize()) {
+        throw RequestRejected(HttpStatus::PayloadTooLarge,
+                              "Request body too large");
+    }
+
+    return result == RequestParser::Result::Complete ?
+        parser->FrameLength() : 0;
+}
+
+/**
+ * @brief Largest amount of unconsumed input a connection may hold, enough
+ *        for one request of the maximum size.
+ */
+size_t ServerBase::MaxPendingInput() {
+    return settings_->MaxRequestHeaderSize() + HEADER_TERMINATOR_LENGTH +
+           settings_->MaxRequestBodySize();
+}
+
+void ServerBase::LogRequest(Request *request) {
+    logger_->LogDebug("Request Information:");
+    logger_->LogDebug("=> Method          : %d",
+        request->Method());
+    logger_->LogDebug("=> Path            : %s",
+        request->Path().c_str());
+    logger_->LogDebug("=> HTTP Version    : %d",
+        request->HttpRequestVersion());
+    logger_->LogDebug("=> Remote Host     : %s",
+        request->RemoteHost().c_str());
+    logger_->LogDebug("=> Client Platform : %d",
+        static_cast<int>(request->ClientPlatform()));
+    logger_->LogDebug("=> User-Agent      : %s",
+        request->UserAgent().c_str());
+
+    // Print the header key/values
+    logger_->LogDebug("|= Header key/value pairs:");
+    auto keys = request->Headers().AllKeys();
+    for (const auto& key : keys) {
+        logger_->LogDebug("    %s : %s",
+            key.c_str(),
+            request->Headers().Get(key)->c_str());
+    }
+}
+
+/**
+ * @brief Produces the response for a parsed request.
+ *
+ * Requests under the prefix of a proxy route are forwarded to its upstream
+ * server. Requests for a registered route are passed to the route handler,
+ * anything else is treated as a request for a file within the static website
+ * directory, '/' standing for '/index.html'. A missing file results in a 404
+ * response.
+ *
+ * @param request The parsed request to respond to.
+ * @return A dynamically allocated Response, owned by the caller.
+ */
+Response *ServerBase::DispatchRequest(Request *request) {
+    if (stats_) {
+        stats_->requests.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    UpstreamPool *upstream =
+        RouteHandler::Instance().FindProxyRoute(request->Path());
+    if (upstream) {
+        try {
+            return ReverseProxy(logger_, settings_).Forward(upstream,
+                                                           request);
+        }
+        catch (RequestRejected &ex) {
+            logger_->LogError("Proxying '%s' failed: %s",
+                              request->Path().c_str(), ex.what());
+            return CreateErrorResponse(ex.Status());
+        }
+    }
+
+    if (RouteHandler::Instance().IsValidRoute(request->Path(),
+                                              request->Method())) {
+        auto response = RouteHandler::Instance().HandleRequest(
+            request->Path(), request->Method(), request);
+        return response.value();
+    }
+
+    auto httpStatus = core::HttpStatus::OK;
+    auto contentType = HttpContentType::TextPlain;
+    std::string body = "";
 
     // Default to index.html if root is requested
+    std::string path = request->Path();
     if (path == "/") {
         logger_->LogDebug("Path is ROOT");
         path = "/index.html";
     }
 
-    auto requestTypeEnum = ParseRequestType(method);
-    auto httpVersionEnum = ParseHttpVersion(http_version);
-    Request* request = new Request(requestTypeEnum, httpVersionEnum, path);
+    auto route = settings_->StaticWebsiteDir() + path;
 
-    ParseHeaders(headers, request);
+    // Remove any leading '/' from the route as
+    if (!route.empty() && route.front() == '/') {
+        route.erase(0, 1);
+    }
 
-    return request;
+    auto servedFileDetails = file_server_->OpenFile(route);
+    if (!servedFileDetails) {
+        body = "<html><body><h1>404 Page Not Found</h1></body></html>";
+        httpStatus = core::HttpStatus::NotFound;
+    } else if (servedFileDetails->fileDescriptor != -1) {
+        // The file is sent from the open descriptor, which now belongs to
+        // the response.
+        auto response = new Response(httpStatus,
+                                     servedFileDetails->fileDescriptor,
+                                     servedFileDetails->fileSize,
+                                     servedFileDetails->contentType);
+        servedFileDetails->fileDescriptor = -1;
+        return response;
+    } else {
+        body = servedFileDetails->contents;
+        contentType = servedFileDetails->contentType;
+    }
+
+    return new Response(httpStatus, body, contentType);
+}
+
+std::string ServerBase::GenerateResponseHeader(Response *response,
+                                               bool keepAlive) {
+    size_t bodyLength = response->BodyLength();
+    int statusCode = static_cast<int>(response->StatusCode());
+
+    std::string headerStr =
+        "HTTP/1.1 " + std::to_string(statusCode) + " " +
+        HttpStatusString(response->StatusCode()) + "\r\n"
+        "Content-Type: " + response->ContentTypeString() + "\r\n";
+
+    const Header &extra = response->ResponseHeader();
+    for (const auto &key : extra.AllKeys()) {
+        if (key != HEADER_KEY_CONTENT_TYPE) {
+            headerStr += key + ": " + *extra.Get(key) + "\r\n";
+        }
+    }
+
+    if (response->Streamed() && response->StreamLength()) {
+        bodyLength = *response->StreamLength();
+    }
+
+    if (response->BodyOmitted()) {
+        if (response->StreamLength()) {
+            headerStr += "Content-Length: " +
+                         std::to_string(*response->StreamLength()) + "\r\n";
+        }
+    } else if (response->Streamed() && !response->StreamLength()) {
+        headerStr += "Transfer-Encoding: chunked\r\n";
+    } else {
+        headerStr += "Content-Length: " + std::to_string(bodyLength) + "\r\n";
+    }
+
+    if (keepAlive) {
+        headerStr += "Connection: keep-alive\r\n"
+                     "Keep-Alive: timeout=" +
+                     std::to_string(settings_->KeepAliveTimeout()) + "\r\n";
+    } else {
+        headerStr += "Connection: close\r\n";
+    }
+
+    headerStr += "\r\n";
+
+    return headerStr;
+}
+
+/**
+ * @brief Generates a complete response rejecting a request, after which the
+ *        connection is closed.
+ */
+std::string ServerBase::GenerateErrorResponse(HttpStatus status) {
+    std::unique_ptr<Response> response(CreateErrorResponse(status));
+
+    return GenerateResponseHeader(response.get(), false) + response->Body();
+}
+
+/**
+ * @brief Creates a response with a short page describing the error status.
+ */
+Response *ServerBase::CreateErrorResponse(HttpStatus status) {
+    std::string title = std::to_string(static_cast<int>(status)) + " " +
+                        HttpStatusString(status);
+
+    return new Response(status,
+                        "<html><body><h1>" + title + "</h1></body></html>",
+                        HttpContentType::TextHTML);
+}
+
+/**
+ * @brief Waits for a socket to have data available to read.
+ *
+ * @param socket The socket to wait on.
+ * @param timeoutMs Maximum time to wait in milliseconds.
+ * @return true if the socket is readable (or has been closed by the peer),
+ *         false if the timeout expired or the wait failed.
+ */
+bool ServerBase::WaitForSocketReadable(SOCKET socket, int timeoutMs) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+    WSAPOLLFD pollFd {};
+    pollFd.fd = socket;
+    pollFd.events = POLLRDNORM;
+
+    return WSAPoll(&pollFd, 1, timeoutMs) > 0;
+#else
+    pollfd pollFd {};
+    pollFd.fd = socket;
+    pollFd.events = POLLIN;
+
+    int result;
+    do {
+        result = poll(&pollFd, 1, timeoutMs);
+    } while (result == -1 && errno == EINTR);
+
+    return result > 0;
+#endif
 }
 
 /**
@@ -236,47 +999,38 @@ std::string ServerBase::CleanHeaderString(std::string src) {
 }
 
 /**
- * @brief Parses the HTTP headers from the input string and updates the request
- *        object accordingly.
+ * @brief Adds the header fields of a parsed request to the request.
  *
- * This function reads a string containing HTTP headers, parses each header
- * line, and updates the Request object with relevant information such as the
- * remote host, user-agent, and client platform. Unrecognized headers are
- * stored in the webloom::Header object, which is then added to the request.
+ * The remote host, user-agent, client platform and connection options are
+ * taken from their fields, whatever the case of the field names. The other
+ * fields are stored in the webloom::Header object, which is then added to
+ * the request.
  *
- * @param headers String containing HTTP headers in key-value format.
- * @param request Reference to the Request object to be updated with parsed
- *        headers.
+ * @param parser Parser holding the request's header fields.
+ * @param request The request to be updated with the parsed headers.
+ * @throws std::invalid_argument if a stored field is repeated.
  */
-void ServerBase::ParseHeaders(const std::string& headers,
-    Request* request) {
-    logger_->LogDebug("Entering RequestProcessor::ParseHeaders()");
-
+void ServerBase::ParseHeaders(const RequestParser &parser, Request* request) {
     webloom::Header header;
-    std::istringstream stream(headers);
-    std::string line;
-    std::string header_key;
-    std::string header_value;
-
-    while (std::getline(stream, line) && line != "\r") {
-        size_t colon_pos = line.find(':');
-        if (colon_pos != std::string::npos) {
-            header_key = line.substr(0, colon_pos);
-            header_value = line.substr(colon_pos + 1);
-
-            // Trim spaces from the header value
-            header_value.erase(0, header_value.find_first_not_of(' '));
-            header_value.erase(header_value.find_last_not_of(' ') + 1);
-
-            if (header_key == HEADER_KEY_HOST) {
-                request->RemoteHost(header_value);
-            } else if (header_key == HEADER_KEY_USER_AGENT) {
-                request->UserAgent(header_value);
-            } else if (header_key == HEADER_KEY_CLIENT_PLATFORM) {
-                auto platform = ParseUserAgentClientPlatform(header_value);
-                request->ClientPlatform(platform);
-            } else {
-                header.Add(header_key, header_value);
+
+    for (size_t i = 0; i < parser.FieldCount(); i++) {
+        std::string_view key = parser.FieldName(i);
+        std::string_view value = parser.FieldValue(i);
+
+        if (EqualsIgnoringCase(key, HEADER_KEY_HOST)) {
+            request->RemoteHost(std::string(value));
+        } else if (EqualsIgnoringCase(key, HEADER_KEY_USER_AGENT)) {
+            request->UserAgent(std::string(value));
+        } else if (EqualsIgnoringCase(key, HEADER_KEY_CLIENT_PLATFORM)) {
+            auto platform = ParseUserAgentClientPlatform(std::string(value));
+            request->ClientPlatform(platform);
+        } else if (EqualsIgnoringCase(key, HEADER_KEY_CONNECTION)) {
+            ParseConnectionHeader(value, request);
+        } else {
+            try {
+                header.Add(std::string(key), std::string(value));
+            } catch (const std::runtime_error &) {
+                throw std::invalid_argument("Repeated header field");
             }
         }
     }
@@ -284,6 +1038,43 @@ void ServerBase::ParseHeaders(const std::string& headers,
     request->AddHeaders(header);
 }
 
+/**
+ * @brief Applies the options of a 'Connection' header to the request.
+ *
+ * The header holds a comma separated, case-insensitive list of options. Only
+ * 'close' and 'keep-alive' affect the request, they override the default
+ * persistence implied by the HTTP version.
+ *
+ * @param value The value of the 'Connection' header.
+ * @param request The request to update.
+ */
+void ServerBase::ParseConnectionHeader(std::string_view value,
+                                       Request* request) {
+    // The value may be quoted.
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+    }
+
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view option = value.substr(0, comma);
+        value = comma == std::string_view::npos ?
+            std::string_view() : value.substr(comma + 1);
+
+        size_t start = option.find_first_not_of(' ');
+        if (start == std::string_view::npos) {
+            continue;
+        }
+        option = option.substr(start, option.find_last_not_of(' ') - start + 1);
+
+        if (EqualsIgnoringCase(option, CONNECTION_OPTION_CLOSE)) {
+            request->KeepAlive(false);
+        } else if (EqualsIgnoringCase(option, CONNECTION_OPTION_KEEP_ALIVE)) {
+            request->KeepAlive(true);
+        }
+    }
+}
+
 /**
  * @brief Parses an HTTP version string and returns the corresponding enum
  *        value.
@@ -304,7 +1095,7 @@ void ServerBase::ParseHeaders(const std::string& headers,
  * @throws std::invalid_argument if the input does not match any valid HTTP
  *         version.
  */
-HttpVersion ServerBase::ParseHttpVersion(std::string version) {
+HttpVersion ServerBase::ParseHttpVersion(std::string_view version) {
     if (version == HTTP_VERSION_1_0) {
         return HttpVersion::HTTP_1_0;
     } else if (version == HTTP_VERSION_1_1) {
@@ -338,7 +1129,7 @@ HttpVersion ServerBase::ParseHttpVersion(std::string version) {
  * @return The corresponding `RequestMethod` enum value.
  * @throws std::invalid_argument if the method is invalid.
  */
-RequestMethod ServerBase::ParseRequestType(std::string method) {
+RequestMethod ServerBase::ParseRequestType(std::string_view method) {
     if (method == METHOD_TYPE_GET) {
         return RequestMethod::Get;
     } else if (method == METHOD_TYPE_POST) {
@@ -403,23 +1194,4 @@ UserAgentClientPlatform ServerBase::ParseUserAgentClientPlatform(
     throw std::invalid_argument("Invalid Agent Client platform");
 }
 
-void ServerBase::SplitRequestIntoHeadersAndBody(
-    const std::string& request,
-    std::string* headers,
-    std::string* body) {
-    // Find the position of the blank line (\r\n\r\n)
-    size_t pos = request.find("\r\n\r\n");
-
-    // If the blank line is not found, return only headers (i.e., no body)
-    if (pos == std::string::npos) {
-        *headers = request;
-        *body = "";
-        return;
-    }
-
-    // Split the request into headers and body
-    *headers = request.substr(0, pos);
-    *body = request.substr(pos + 4);  // Body starts after \r\n\r\n
-}
-
 }   // namespace webloom::core
@@ -4,14 +4,27 @@
 #ifndef CORE_SERVERBASE_H_
 #define CORE_SERVERBASE_H_
 #include <atomic>
+#include <chrono>               // NOLINT(build/c++11)
 #include <string>
+#include <string_view>
 #include <vector>
 #include "IServer.h"
 #include "Logger.h"
 #include "Request.h"
 #include "SocketDefinitions.h"
+#include "Response.h"
 #include "WebLoomSettings.h"
+#include "core/BufferPool.h"
+#include "core/CpuSet.h"
 #include "core/FileServer.h"
+#include "core/Hpack.h"
+#include "core/HttpStatus.h"
+#include "core/ListenEndpoint.h"
+#include "core/MemoryBudget.h"
+#include "core/RequestParser.h"
+#include "core/ServerStats.h"
+#include "core/TlsContext.h"
+#include "core/TlsSession.h"
 
 namespace webloom::core {
 
@@ -29,32 +42,122 @@ class ServerBase : public IServer {
 
     void RequestShutdown();
 
+    void ShareListeners();
+
+    void CloseListeners();
+
+    void CountInto(ServerStats *stats);
+
+    void AssignCpuSlot(unsigned int slot);
+
+    void EnableTls(TlsContext *context);
+
+    void TrackMemory(MemoryBudget *budget);
+
  protected:
+    struct Listener {
+        SOCKET socket;
+        ListenEndpoint endpoint;
+    };
+
     Logger *logger_;
     std::atomic<bool> shutdown_requested_;
     WebLoomSettings *settings_;
     core::FileServer *file_server_;
-    SOCKET server_socket_;
-    sockaddr_in socket_address_;
     ThreadPool* threadpool_;
 
+    // Workers of their own for proxied requests on the reactor based
+    // servers, so that slow upstream servers can't hold up other routes.
+    ThreadPool* proxy_pool_;
+
+    // Storage for the connection read buffers, shared by every connection.
+    BufferPool buffer_pool_;
+
+    // Counters shared with the supervisor of a prefork server, if any.
+    ServerStats *stats_;
+
+    // Shared with every other server of the process, null unless memory is
+    // being tracked.
+    MemoryBudget *memory_budget_;
+
+    // CPUs the server loop and the worker threads are pinned to, and which
+    // of the loop's CPUs this server takes when several share them.
+    CpuSet reactor_cpus_;
+    CpuSet worker_cpus_;
+    unsigned int cpu_slot_;
+
+    // Shared with every other server of the application, null unless
+    // connections are served over TLS.
+    TlsContext *tls_context_;
+
+    // Sockets listening on each of the endpoints, all served by the one loop.
+    std::vector<Listener> listeners_;
+
+    // The listening sockets were opened before worker processes were forked
+    // and every one of them accepts from them.
+    bool shared_listeners_;
+
     std::string CleanHeaderString(std::string src);
 
     bool InitialiseSocketSystem();
 
-    Request *ProcessRequest(const std::vector<char>& buffer);
+    void OpenListeners();
 
-    void ParseHeaders(const std::string& headers, Request* request);
+    SOCKET OpenListener(const ListenEndpoint &endpoint);
 
-    HttpVersion ParseHttpVersion(std::string version);
+    void RemoveStaleSocketFile(const ListenEndpoint &endpoint);
 
-    void CleanupSocketSystem();
+    virtual void InitialiseServerLoop() {}
+
+    virtual void DrainConnections(
+        std::chrono::steady_clock::time_point deadline) = 0;
+
+    virtual void ShutdownServerLoop() {}
+
+    Request *ProcessRequest(const RequestParser &parser);
+
+    Request *ProcessHttp2Request(const HeaderList &fields, std::string body);
 
-    RequestMethod ParseRequestType(std::string method);
+    size_t RequestFrameLength(RequestParser *parser, std::string_view buffer);
+
+    size_t MaxPendingInput();
+
+    void LogRequest(Request *request);
+
+    Response *DispatchRequest(Request *request);
+
+    std::string GenerateResponseHeader(Response *response,
+                                       bool keepAlive = false);
+
+    Response *CreateErrorResponse(HttpStatus status);
+
+    std::string GenerateErrorResponse(HttpStatus status);
+
+    bool WaitForSocketReadable(SOCKET socket, int timeoutMs);
+
+    bool SetSocketBlocking(SOCKET socket, bool blocking);
+
+    void ConfigureClientSocket(SOCKET socket, const Listener &listener);
+
+    bool ConnectionLimitReached(size_t openConnections);
+
+    bool MemoryBudgetExhausted();
+
+    void ChargeMemory(MemoryBudget::Use use, size_t bytes);
+
+    void RefundMemory(MemoryBudget::Use use, size_t bytes);
+
+    void RejectConnection(SOCKET socket);
+
+    void ParseHeaders(const RequestParser &parser, Request* request);
+
+    void ParseConnectionHeader(std::string_view value, Request* request);
+
+    HttpVersion ParseHttpVersion(std::string_view version);
+
+    void CleanupSocketSystem();
 
-    void SplitRequestIntoHeadersAndBody(const std::string& request,
-                                        std::string* headers,
-                                        std::string* body);
+    RequestMethod ParseRequestType(std::string_view method);
 
     UserAgentClientPlatform ParseUserAgentClientPlatform(std::string platform);
 };
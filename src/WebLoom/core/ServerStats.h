@@ -0,0 +1,26 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_SERVERSTATS_H_
+#define CORE_SERVERSTATS_H_
+#include <atomic>
+#include <cstdint>
+
+namespace webloom::core {
+
+/**
+ * @brief Running totals of one server.
+ *
+ * The counters are lock-free atomics so that they can live in memory shared
+ * between processes, with a worker process writing its own and the
+ * supervisor reading them all. Each set has a cache line of its own, so
+ * that workers on different cores don't contend for it.
+ */
+struct alignas(64) ServerStats {
+    std::atomic<uint64_t> connections { 0 };
+    std::atomic<uint64_t> requests { 0 };
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_SERVERSTATS_H_
@@ -0,0 +1,55 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include "SplicePipe.h"
+
+namespace webloom::core {
+
+// Capacity requested for the pipe, the kernel default is 64 KB.
+constexpr int SPLICE_PIPE_SIZE = 256 * 1024;
+
+SplicePipe::SplicePipe() : ends_{ -1, -1 }, capacity_(0) {
+}
+
+SplicePipe::~SplicePipe() {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (ends_[0] != -1) {
+        close(ends_[0]);
+        close(ends_[1]);
+    }
+#endif
+}
+
+/**
+ * @return false if the pipe could not be created.
+ */
+bool SplicePipe::Open() {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+    if (ends_[0] != -1) {
+        return true;
+    }
+
+    if (pipe2(ends_, O_CLOEXEC) == -1) {
+        ends_[0] = ends_[1] = -1;
+        return false;
+    }
+
+    int capacity = fcntl(ends_[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    if (capacity == -1) {
+        capacity = fcntl(ends_[1], F_GETPIPE_SZ);
+    }
+    capacity_ = capacity > 0 ? static_cast<size_t>(capacity) : 4096;
+    return true;
+#else
+    return false;
+#endif
+}
+
+}   // namespace webloom::core
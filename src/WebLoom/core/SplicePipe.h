@@ -0,0 +1,41 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_SPLICEPIPE_H_
+#define CORE_SPLICEPIPE_H_
+#include <cstddef>
+
+namespace webloom::core {
+
+/**
+ * @brief A pipe that body data is spliced into from one socket and out of
+ *        into another, so that it never has to be copied into memory.
+ *
+ * Only available on Linux, Open() fails elsewhere.
+ */
+class SplicePipe {
+ public:
+    SplicePipe();
+
+    ~SplicePipe();
+
+    SplicePipe(const SplicePipe &) = delete;
+    SplicePipe &operator=(const SplicePipe &) = delete;
+
+    bool Open();
+
+    int ReadEnd() const { return ends_[0]; }
+
+    int WriteEnd() const { return ends_[1]; }
+
+    // Most the pipe holds, and so the most spliced into it in one go.
+    size_t Capacity() const { return capacity_; }
+
+ private:
+    int ends_[2];
+    size_t capacity_;
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_SPLICEPIPE_H_
@@ -17,10 +17,17 @@ namespace webloom::core {
 
 class ThreadPool {
  public:
-    // Constructor to create and launch threads
-    explicit ThreadPool(size_t threads) : stop_(false) {
+    // Constructor to create and launch threads, each of which runs
+    // onThreadStart (if set) before taking any task
+    explicit ThreadPool(size_t threads,
+                        std::function<void()> onThreadStart = nullptr)
+        : stop_(false) {
         for (size_t i = 0; i < threads; ++i) {
-            workers_.emplace_back([this] {
+            workers_.emplace_back([this, onThreadStart] {
+                if (onThreadStart) {
+                    onThreadStart();
+                }
+
                 while (true) {
                     std::function<void()> task;
 
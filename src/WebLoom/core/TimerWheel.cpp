@@ -0,0 +1,143 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "TimerWheel.h"
+
+namespace webloom::core {
+
+void TimerWheel::Timer::Unlink() {
+    if (!prev_) {
+        return;
+    }
+
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+    prev_ = nullptr;
+    next_ = nullptr;
+}
+
+/**
+ * @param tick Resolution of the wheel, timers expire up to one tick late.
+ */
+TimerWheel::TimerWheel(std::chrono::milliseconds tick)
+    : tick_(tick), start_(Clock::now()), next_tick_(0) {
+    for (auto &level : slots_) {
+        for (Timer &head : level) {
+            head.prev_ = &head;
+            head.next_ = &head;
+        }
+    }
+}
+
+/**
+ * @brief Sets a timer to expire at the given time, replacing any time it was
+ *        already set for.
+ */
+void TimerWheel::Schedule(Timer *timer, Clock::time_point deadline) {
+    timer->Unlink();
+
+    // Rounded up, so that a timer never expires before its deadline.
+    uint64_t expiry = TickAt(deadline);
+    if (start_ + expiry * tick_ < deadline) {
+        expiry++;
+    }
+
+    timer->expiry_ = expiry;
+    Insert(timer);
+}
+
+/**
+ * @brief Expires every timer whose deadline has been reached.
+ *
+ * The handler may schedule, cancel or destroy timers, including the one it
+ * was called for.
+ */
+void TimerWheel::Advance(Clock::time_point now, const ExpiryHandler &expired) {
+    uint64_t target = TickAt(now);
+
+    while (next_tick_ <= target) {
+        // Each time a level wraps, the next slot of the level above is
+        // spread over the levels below.
+        if ((next_tick_ & (SLOTS - 1)) == 0) {
+            for (unsigned level = 1; level < LEVELS; level++) {
+                Cascade(level);
+
+                if (((next_tick_ >> (SLOT_BITS * level)) & (SLOTS - 1)) != 0) {
+                    break;
+                }
+            }
+        }
+
+        // The slot is detached first, timers the handler sets again for now
+        // land in the next tick rather than in the slot being emptied.
+        Timer due;
+        Timer &head = slots_[0][next_tick_ & (SLOTS - 1)];
+        if (head.next_ != &head) {
+            due.prev_ = head.prev_;
+            due.next_ = head.next_;
+            due.prev_->next_ = &due;
+            due.next_->prev_ = &due;
+            head.prev_ = &head;
+            head.next_ = &head;
+        }
+
+        uint64_t tick = next_tick_++;
+
+        while (due.next_ && due.next_ != &due) {
+            Timer *timer = due.next_;
+            timer->Unlink();
+
+            // Parked beyond the span of the wheel, not due yet.
+            if (timer->expiry_ > tick) {
+                Insert(timer);
+                continue;
+            }
+
+            expired(timer);
+        }
+    }
+}
+
+uint64_t TimerWheel::TickAt(Clock::time_point time) const {
+    if (time <= start_) {
+        return 0;
+    }
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        time - start_) / tick_;
+}
+
+void TimerWheel::Insert(Timer *timer) {
+    uint64_t expiry = timer->expiry_ < next_tick_ ? next_tick_ : timer->expiry_;
+    uint64_t delta = expiry - next_tick_;
+
+    unsigned level = 0;
+    while (level < LEVELS - 1 &&
+           delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+
+    uint64_t span = uint64_t(1) << (SLOT_BITS * LEVELS);
+    if (delta >= span) {
+        expiry = next_tick_ + span - 1;
+    }
+
+    Timer &head = slots_[level][(expiry >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    timer->prev_ = head.prev_;
+    timer->next_ = &head;
+    head.prev_->next_ = timer;
+    head.prev_ = timer;
+}
+
+void TimerWheel::Cascade(unsigned level) {
+    Timer &head = slots_[level][(next_tick_ >> (SLOT_BITS * level)) &
+                                (SLOTS - 1)];
+
+    while (head.next_ != &head) {
+        Timer *timer = head.next_;
+        timer->Unlink();
+        Insert(timer);
+    }
+}
+
+}   // namespace webloom::core
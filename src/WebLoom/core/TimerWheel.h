@@ -0,0 +1,87 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_TIMERWHEEL_H_
+#define CORE_TIMERWHEEL_H_
+#include <chrono>               // NOLINT(build/c++11)
+#include <cstdint>
+#include <functional>
+
+namespace webloom::core {
+
+/**
+ * @brief Hierarchical timer wheel for per-connection timeouts.
+ *
+ * Timers are rounded to the wheel's tick and kept in slots on four levels of
+ * 64, each level covering 64 times the span of the level below. Scheduling
+ * and cancelling a timer links or unlinks it from a slot in constant time
+ * however many timers exist, and advancing the wheel only looks at the slots
+ * whose time has come, moving timers from the coarser levels down as their
+ * expiry approaches. Timers far beyond the span of the wheel are parked on
+ * the top level until they are close enough.
+ *
+ * Timers are embedded in the objects they time and unlink themselves when
+ * destroyed. The wheel is not thread safe.
+ */
+class TimerWheel {
+ public:
+    using Clock = std::chrono::steady_clock;
+
+    class Timer {
+     public:
+        Timer() : owner(0), prev_(nullptr), next_(nullptr), expiry_(0) {}
+
+        ~Timer() { Unlink(); }
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        bool Scheduled() const { return prev_ != nullptr; }
+
+        // Identifies what the timer belongs to when it expires.
+        uint64_t owner;
+
+     private:
+        friend class TimerWheel;
+
+        Timer *prev_;
+        Timer *next_;
+        uint64_t expiry_;
+
+        void Unlink();
+    };
+
+    using ExpiryHandler = std::function<void(Timer *timer)>;
+
+    explicit TimerWheel(std::chrono::milliseconds tick);
+
+    void Schedule(Timer *timer, Clock::time_point deadline);
+
+    void Cancel(Timer *timer) { timer->Unlink(); }
+
+    void Advance(Clock::time_point now, const ExpiryHandler &expired);
+
+ private:
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr unsigned SLOTS = 1 << SLOT_BITS;
+
+    std::chrono::milliseconds tick_;
+    Clock::time_point start_;
+
+    // The tick whose slot is processed next.
+    uint64_t next_tick_;
+
+    // Slot heads, each the sentinel of a circular list of timers.
+    Timer slots_[LEVELS][SLOTS];
+
+    uint64_t TickAt(Clock::time_point time) const;
+
+    void Insert(Timer *timer);
+
+    void Cascade(unsigned level);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_TIMERWHEEL_H_
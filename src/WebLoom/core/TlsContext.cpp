@@ -0,0 +1,184 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <stdexcept>
+#include <string>
+#include "TlsContext.h"
+
+#ifdef WEBLOOM_TLS_AVAILABLE
+# include <openssl/err.h>
+# include <openssl/ssl.h>
+# include <signal.h>
+#endif
+
+namespace webloom::core {
+
+#ifdef WEBLOOM_TLS_AVAILABLE
+
+// Distinguishes the sessions of this server in a shared cache.
+constexpr unsigned char SESSION_ID_CONTEXT[] = "WebLoom";
+
+// Protocols offered through ALPN, in order of preference, each prefixed by
+// its length.
+constexpr unsigned char ALPN_HTTP2_AND_HTTP1[] = "\x02h2\x08http/1.1";
+constexpr unsigned char ALPN_HTTP1[] = "\x08http/1.1";
+
+static std::string LastError() {
+    char message[256];
+    unsigned long error = ERR_get_error();
+    if (error == 0) {
+        return "unknown error";
+    }
+
+    ERR_error_string_n(error, message, sizeof(message));
+    ERR_clear_error();
+    return message;
+}
+
+/**
+ * @brief Picks the first of the server's protocols that the client offers.
+ */
+static int SelectProtocol(SSL *,
+                          const unsigned char **selected,
+                          unsigned char *selectedLength,
+                          const unsigned char *offered,
+                          unsigned int offeredLength,
+                          void *arg) {
+    auto *context = static_cast<TlsContext *>(arg);
+    const unsigned char *supported = context->OfferHttp2() ?
+        ALPN_HTTP2_AND_HTTP1 : ALPN_HTTP1;
+    unsigned int supportedLength = context->OfferHttp2() ?
+        sizeof(ALPN_HTTP2_AND_HTTP1) - 1 : sizeof(ALPN_HTTP1) - 1;
+
+    if (SSL_select_next_proto(const_cast<unsigned char **>(selected),
+                              selectedLength, supported, supportedLength,
+                              offered, offeredLength) !=
+        OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+
+    return SSL_TLSEXT_ERR_OK;
+}
+
+/**
+ * @param offerHttp2 Offer HTTP/2 to clients through ALPN, for the engines
+ *                   that serve it.
+ * @throws std::runtime_error if the certificate or its key can't be loaded.
+ */
+TlsContext::TlsContext(Logger *logger,
+                       WebLoomSettings *settings,
+                       bool offerHttp2)
+    : logger_(logger), context_(SSL_CTX_new(TLS_server_method())),
+      offer_http2_(offerHttp2) {
+    if (!context_) {
+        throw std::runtime_error("Unable to create the TLS context: " +
+                                 LastError());
+    }
+
+    // A client that resets the connection whilst OpenSSL writes to it
+    // would otherwise end the process with SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+
+    SSL_CTX_set_min_proto_version(context_, TLS1_2_VERSION);
+
+    uint64_t options = SSL_OP_NO_RENEGOTIATION |
+                       SSL_OP_CIPHER_SERVER_PREFERENCE |
+                       SSL_OP_IGNORE_UNEXPECTED_EOF;
+    if (settings->TlsKernelOffload()) {
+        options |= SSL_OP_ENABLE_KTLS;
+    }
+    SSL_CTX_set_options(context_, options);
+
+    // Idle connections give their buffers back, and records are encrypted
+    // from a buffer that may move between attempts to write them.
+    SSL_CTX_set_mode(context_, SSL_MODE_RELEASE_BUFFERS |
+                               SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    SSL_CTX_set_alpn_select_cb(context_, SelectProtocol, this);
+
+    try {
+        LoadCertificate(settings);
+    }
+    catch (...) {
+        SSL_CTX_free(context_);
+        throw;
+    }
+
+    ConfigureSessionCache(settings);
+
+    logger_->LogInfo("TLS enabled with certificate '%s'",
+                     settings->TlsCertificateFile().c_str());
+}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(context_);
+}
+
+bool TlsContext::IsAvailable() {
+    return true;
+}
+
+void TlsContext::LoadCertificate(WebLoomSettings *settings) {
+    std::string certificate = settings->TlsCertificateFile();
+    std::string key = settings->TlsPrivateKeyFile();
+
+    if (SSL_CTX_use_certificate_chain_file(context_,
+                                           certificate.c_str()) != 1) {
+        throw std::runtime_error("Unable to load TLS certificate '" +
+                                 certificate + "': " + LastError());
+    }
+
+    if (SSL_CTX_use_PrivateKey_file(context_, key.c_str(),
+                                    SSL_FILETYPE_PEM) != 1) {
+        throw std::runtime_error("Unable to load TLS private key '" + key +
+                                 "': " + LastError());
+    }
+
+    if (SSL_CTX_check_private_key(context_) != 1) {
+        throw std::runtime_error("TLS private key '" + key + "' does not "
+                                 "match the certificate");
+    }
+}
+
+/**
+ * @brief Keeps sessions for clients to resume.
+ *
+ * Sessions resumed by ID come from the cache of this context, whereas
+ * tickets carry the session to the client, encrypted with keys generated
+ * when the context was created.
+ */
+void TlsContext::ConfigureSessionCache(WebLoomSettings *settings) {
+    SSL_CTX_set_session_id_context(context_, SESSION_ID_CONTEXT,
+                                   sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_timeout(context_, settings->TlsSessionLifetime());
+
+    // A size of 0 would leave OpenSSL's cache unbounded.
+    if (settings->TlsSessionCacheSize() == 0) {
+        SSL_CTX_set_session_cache_mode(context_, SSL_SESS_CACHE_OFF);
+        return;
+    }
+
+    SSL_CTX_set_session_cache_mode(context_, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(context_, settings->TlsSessionCacheSize());
+}
+
+#else
+
+TlsContext::TlsContext(Logger *logger,
+                       WebLoomSettings *,
+                       bool offerHttp2)
+    : logger_(logger), context_(nullptr), offer_http2_(offerHttp2) {
+    throw std::runtime_error("TLS is unavailable, the library was built "
+                             "without OpenSSL");
+}
+
+TlsContext::~TlsContext() {
+}
+
+bool TlsContext::IsAvailable() {
+    return false;
+}
+
+#endif  // WEBLOOM_TLS_AVAILABLE
+
+}   // namespace webloom::core
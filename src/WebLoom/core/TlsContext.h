@@ -0,0 +1,69 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_TLSCONTEXT_H_
+#define CORE_TLSCONTEXT_H_
+#include "Logger.h"
+#include "WebLoomSettings.h"
+#include "core/Platform.h"
+
+// TLS is built when the build has found OpenSSL, which only the Linux build
+// looks for.
+#if defined(WEBLOOM_HAVE_OPENSSL) && \
+    (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+# define WEBLOOM_TLS_AVAILABLE
+#endif
+
+// OpenSSL's context, declared here so that only the library itself needs
+// the OpenSSL headers to build.
+struct ssl_ctx_st;
+
+namespace webloom::core {
+
+/**
+ * @brief Certificate and TLS configuration shared by every TLS connection
+ *        of the server.
+ *
+ * One context is created for the whole server before any listener or
+ * worker process starts, so that they resume each other's sessions. Session
+ * IDs are kept in the context's cache, which every listener of a process
+ * shares, and session tickets are encrypted with keys that worker processes
+ * inherit from the supervisor. A resumed handshake skips the key exchange
+ * and the certificate.
+ *
+ * With kernel offload, OpenSSL hands the session keys to the kernel (kTLS)
+ * once the handshake is done, provided the kernel supports the negotiated
+ * cipher. The kernel then encrypts whatever is written to the socket, so
+ * responses go out with the same vectored sends and sendfile() as over
+ * plain TCP.
+ *
+ * TLS is only available when the library has been built with OpenSSL.
+ */
+class TlsContext {
+ public:
+    TlsContext(Logger *logger, WebLoomSettings *settings, bool offerHttp2);
+
+    ~TlsContext();
+
+    TlsContext(const TlsContext &) = delete;
+    TlsContext &operator=(const TlsContext &) = delete;
+
+    ssl_ctx_st *Handle() const { return context_; }
+
+    bool OfferHttp2() const { return offer_http2_; }
+
+    static bool IsAvailable();
+
+ private:
+    Logger *logger_;
+    ssl_ctx_st *context_;
+    bool offer_http2_;
+
+    void LoadCertificate(WebLoomSettings *settings);
+
+    void ConfigureSessionCache(WebLoomSettings *settings);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_TLSCONTEXT_H_
@@ -0,0 +1,272 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <stdexcept>
+#include "TlsSession.h"
+
+#ifdef WEBLOOM_TLS_AVAILABLE
+# include <openssl/err.h>
+# include <openssl/ssl.h>
+# include <sys/uio.h>
+# include <unistd.h>
+# include <algorithm>
+# include <cerrno>
+# include <climits>
+# include <cstring>
+#endif
+
+namespace webloom::core {
+
+#ifdef WEBLOOM_TLS_AVAILABLE
+
+// Largest amount of plaintext that fits in one TLS record.
+constexpr size_t MAX_RECORD_SIZE = 16384;
+
+// Buffers gathered from the output queue into one record.
+constexpr size_t MAX_RECORD_VECTORS = 16;
+
+/**
+ * @throws std::runtime_error if OpenSSL can't set up the session.
+ */
+TlsSession::TlsSession(TlsContext *context, SOCKET socket)
+    : ssl_(SSL_new(context->Handle())), socket_(socket),
+      established_(false), kernel_send_(false), retry_length_(0) {
+    if (!ssl_ || SSL_set_fd(ssl_, socket) != 1) {
+        SSL_free(ssl_);
+        ERR_clear_error();
+        throw std::runtime_error("Unable to create a TLS session");
+    }
+
+    SSL_set_accept_state(ssl_);
+}
+
+TlsSession::~TlsSession() {
+    SSL_free(ssl_);
+}
+
+/**
+ * @brief Takes the handshake as far as the socket allows.
+ *
+ * Once the handshake has completed, the kernel encrypts for the connection
+ * if OpenSSL was able to hand it the session keys.
+ */
+TlsSession::Result TlsSession::Handshake() {
+    // OpenSSL reports the outcome of a call through the thread's error
+    // queue, which must not hold errors left by another connection.
+    ERR_clear_error();
+
+    int result = SSL_do_handshake(ssl_);
+    if (result == 1) {
+        established_ = true;
+        kernel_send_ = BIO_get_ktls_send(SSL_get_wbio(ssl_)) != 0;
+        return Result::Complete;
+    }
+
+    switch (SSL_get_error(ssl_, result)) {
+        case SSL_ERROR_WANT_READ:
+            return Result::WantRead;
+
+        case SSL_ERROR_WANT_WRITE:
+            return Result::WantWrite;
+
+        default:
+            ERR_clear_error();
+            return Result::Failed;
+    }
+}
+
+bool TlsSession::Resumed() const {
+    return SSL_session_reused(ssl_) == 1;
+}
+
+/**
+ * @brief Whether decrypted input is waiting in the session, which the
+ *        socket becoming readable would not announce.
+ */
+bool TlsSession::Pending() const {
+    return SSL_pending(ssl_) > 0;
+}
+
+/**
+ * @brief Reads decrypted input, with the same results as recv().
+ *
+ * @return The number of bytes read, 0 once the client has closed the
+ *         connection or -1 with errno set. EAGAIN means the socket has to
+ *         become ready before reading again.
+ */
+int TlsSession::Read(char *buffer, size_t length) {
+    ERR_clear_error();
+
+    int amount = SSL_read(ssl_, buffer,
+                          static_cast<int>(std::min<size_t>(length, INT_MAX)));
+    if (amount > 0) {
+        return amount;
+    }
+
+    switch (SSL_get_error(ssl_, amount)) {
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+
+        case SSL_ERROR_SYSCALL:
+            if (errno == 0) {
+                errno = ECONNRESET;
+            }
+            return -1;
+
+        default:
+            ERR_clear_error();
+            errno = ECONNRESET;
+            return -1;
+    }
+}
+
+/**
+ * @brief Writes as much of the queue as the socket accepts, as
+ *        OutputQueue::WriteTo() does for a plain socket.
+ */
+OutputQueue::WriteResult TlsSession::Write(OutputQueue *output) {
+    if (kernel_send_) {
+        return output->WriteTo(socket_);
+    }
+
+    while (!output->Empty()) {
+        // A record that could not be written has to be offered again as it
+        // was. It is kept rather than filled again, spliced data has left
+        // its pipe by then.
+        size_t length = retry_length_ ? retry_length_ :
+                                        FillRecord(output, MAX_RECORD_SIZE);
+        if (length == 0) {
+            return OutputQueue::WriteResult::Failed;
+        }
+
+        ERR_clear_error();
+
+        int written = SSL_write(ssl_, record_.get(), static_cast<int>(length));
+        if (written > 0) {
+            output->Consume(written);
+            retry_length_ = 0;
+            continue;
+        }
+
+        switch (SSL_get_error(ssl_, written)) {
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+                retry_length_ = length;
+                return OutputQueue::WriteResult::WouldBlock;
+
+            default:
+                ERR_clear_error();
+                return OutputQueue::WriteResult::Failed;
+        }
+    }
+
+    return OutputQueue::WriteResult::Complete;
+}
+
+/**
+ * @brief Tells the client that no more data follows, if the socket takes
+ *        the alert straight away.
+ */
+void TlsSession::Close() {
+    if (established_) {
+        ERR_clear_error();
+        SSL_shutdown(ssl_);
+        ERR_clear_error();
+    }
+}
+
+/**
+ * @brief Copies the front of the queue into the record buffer.
+ *
+ * @return The number of bytes copied, 0 if a file body or spliced data
+ *         could not be read.
+ */
+size_t TlsSession::FillRecord(OutputQueue *output, size_t length) {
+    if (!record_) {
+        record_ = std::make_unique<char[]>(MAX_RECORD_SIZE);
+    }
+
+    int file;
+    off_t fileOffset;
+    size_t fileLength;
+
+    if (output->NextFile(&file, &fileOffset, &fileLength)) {
+        ssize_t amount;
+        do {
+            amount = pread(file, record_.get(), std::min(length, fileLength),
+                           fileOffset);
+        } while (amount == -1 && errno == EINTR);
+
+        // A truncated file can no longer meet the length promised in the
+        // header.
+        return amount > 0 ? static_cast<size_t>(amount) : 0;
+    }
+
+    int pipe;
+    size_t splicedLength;
+
+    if (output->NextSpliced(&pipe, &splicedLength)) {
+        ssize_t amount;
+        do {
+            amount = read(pipe, record_.get(), std::min(length, splicedLength));
+        } while (amount == -1 && errno == EINTR);
+
+        return amount > 0 ? static_cast<size_t>(amount) : 0;
+    }
+
+    iovec vectors[MAX_RECORD_VECTORS];
+    size_t count = output->Gather(vectors, MAX_RECORD_VECTORS);
+    size_t filled = 0;
+
+    for (size_t i = 0; i < count && filled < length; i++) {
+        size_t amount = std::min(vectors[i].iov_len, length - filled);
+        memcpy(record_.get() + filled, vectors[i].iov_base, amount);
+        filled += amount;
+    }
+
+    return filled;
+}
+
+#else
+
+TlsSession::TlsSession(TlsContext *, SOCKET socket)
+    : ssl_(nullptr), socket_(socket), established_(false),
+      kernel_send_(false), retry_length_(0) {
+    throw std::runtime_error("TLS is unavailable, the library was built "
+                             "without OpenSSL");
+}
+
+TlsSession::~TlsSession() {
+}
+
+TlsSession::Result TlsSession::Handshake() {
+    return Result::Failed;
+}
+
+bool TlsSession::Resumed() const {
+    return false;
+}
+
+bool TlsSession::Pending() const {
+    return false;
+}
+
+int TlsSession::Read(char *, size_t) {
+    return -1;
+}
+
+OutputQueue::WriteResult TlsSession::Write(OutputQueue *) {
+    return OutputQueue::WriteResult::Failed;
+}
+
+void TlsSession::Close() {
+}
+
+#endif  // WEBLOOM_TLS_AVAILABLE
+
+}   // namespace webloom::core
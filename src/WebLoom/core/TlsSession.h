@@ -0,0 +1,88 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_TLSSESSION_H_
+#define CORE_TLSSESSION_H_
+#include <cstddef>
+#include <memory>
+#include "SocketDefinitions.h"
+#include "core/OutputQueue.h"
+#include "core/TlsContext.h"
+
+// OpenSSL's connection, declared here so that only the library itself
+// needs the OpenSSL headers to build.
+struct ssl_st;
+
+namespace webloom::core {
+
+/**
+ * @brief TLS layer of one client connection.
+ *
+ * The session reads and writes the connection's socket itself, so it works
+ * with blocking and non-blocking sockets alike. When the socket would block
+ * the call reports which way the session is waiting, and has to be repeated
+ * once the socket is ready.
+ *
+ * Output is written straight from the output queue. Once the kernel
+ * encrypts for the connection the queue writes to the socket as it would
+ * without TLS, otherwise the queue is encrypted a record at a time, with
+ * file bodies and spliced data read into the record first.
+ */
+class TlsSession {
+ public:
+    enum class Result {
+        Complete,
+
+        // The socket has to become readable before the call can progress.
+        WantRead,
+
+        // The socket has to become writable before the call can progress.
+        WantWrite,
+
+        // The handshake failed or the connection broke.
+        Failed
+    };
+
+    TlsSession(TlsContext *context, SOCKET socket);
+
+    ~TlsSession();
+
+    TlsSession(const TlsSession &) = delete;
+    TlsSession &operator=(const TlsSession &) = delete;
+
+    Result Handshake();
+
+    bool Established() const { return established_; }
+
+    // The client resumed an earlier session rather than starting afresh.
+    bool Resumed() const;
+
+    bool KernelSend() const { return kernel_send_; }
+
+    bool Pending() const;
+
+    int Read(char *buffer, size_t length);
+
+    OutputQueue::WriteResult Write(OutputQueue *output);
+
+    void Close();
+
+ private:
+    ssl_st *ssl_;
+    SOCKET socket_;
+    bool established_;
+
+    // The kernel encrypts what is written to the socket.
+    bool kernel_send_;
+
+    // Record being encrypted, and its length when a write of it has to be
+    // repeated with the same bytes.
+    std::unique_ptr<char[]> record_;
+    size_t retry_length_;
+
+    size_t FillRecord(OutputQueue *output, size_t length);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_TLSSESSION_H_
@@ -0,0 +1,196 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM != WEBLOOM_PLATFORM_WINDOWS_MSVC)
+# include <netdb.h>
+#endif
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "UpstreamPool.h"
+
+namespace webloom::core {
+
+/**
+ * @param host Name or address of the upstream server.
+ * @param port Port the upstream server listens on.
+ */
+UpstreamPool::UpstreamPool(std::string host, unsigned int port)
+    : host_(std::move(host)), port_(port) {
+}
+
+UpstreamPool::~UpstreamPool() {
+    for (SOCKET socket : idle_) {
+        closesocket(socket);
+    }
+}
+
+/**
+ * @brief Takes a connection to the upstream server, reusing an idle one if
+ *        there is one that the server has not closed.
+ *
+ * @param timeoutSeconds How long connecting, and each read and write on the
+ *                       connection, may wait.
+ * @param reused Set to whether the connection has served requests before,
+ *               in which case the server may close it before answering.
+ * @throws std::runtime_error if the server can't be connected to.
+ */
+SOCKET UpstreamPool::Acquire(unsigned int timeoutSeconds, bool *reused) {
+    while (true) {
+        SOCKET socket;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (idle_.empty()) {
+                break;
+            }
+
+            socket = idle_.back();
+            idle_.pop_back();
+        }
+
+        if (StillOpen(socket)) {
+            SetTimeouts(socket, timeoutSeconds);
+            *reused = true;
+            return socket;
+        }
+
+        closesocket(socket);
+    }
+
+    *reused = false;
+    return Connect(timeoutSeconds);
+}
+
+/**
+ * @brief Hands back a connection that has finished a response in full, so
+ *        that the next request can use it.
+ *
+ * @param maxIdle Most connections kept idle, beyond that it is closed.
+ */
+void UpstreamPool::Release(SOCKET socket, size_t maxIdle) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.size() < maxIdle) {
+            idle_.push_back(socket);
+            return;
+        }
+    }
+
+    closesocket(socket);
+}
+
+/**
+ * @brief Closes a connection that can't be reused, having failed or been
+ *        left part way through a response.
+ */
+void UpstreamPool::Discard(SOCKET socket) {
+    closesocket(socket);
+}
+
+size_t UpstreamPool::IdleConnections() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+}
+
+/**
+ * @throws std::runtime_error if no address of the server accepts the
+ *         connection.
+ */
+SOCKET UpstreamPool::Connect(unsigned int timeoutSeconds) {
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses = nullptr;
+    std::string port = std::to_string(port_);
+
+    int result = getaddrinfo(host_.c_str(), port.c_str(), &hints, &addresses);
+    if (result != 0) {
+        throw std::runtime_error("Unable to resolve upstream '" + host_ +
+                                 "': " + gai_strerror(result));
+    }
+
+    SOCKET connected = INVALID_SOCKET;
+
+    for (addrinfo *address = addresses; address; address = address->ai_next) {
+        SOCKET socket = ::socket(address->ai_family, address->ai_socktype,
+                                 address->ai_protocol);
+        if (socket == INVALID_SOCKET) {
+            continue;
+        }
+
+        // The send timeout bounds connect() as well.
+        SetTimeouts(socket, timeoutSeconds);
+
+        if (connect(socket, address->ai_addr,
+                    static_cast<socklen_t>(address->ai_addrlen)) == 0) {
+            connected = socket;
+            break;
+        }
+
+        closesocket(socket);
+    }
+
+    freeaddrinfo(addresses);
+
+    if (connected == INVALID_SOCKET) {
+        throw std::runtime_error("Unable to connect to upstream '" + host_ +
+                                 ":" + port + "'");
+    }
+
+    // Requests are written whole, there is nothing to gain from waiting
+    // to fill segments.
+    int noDelay = 1;
+    setsockopt(connected, IPPROTO_TCP, TCP_NODELAY,
+               reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+
+    return connected;
+}
+
+/**
+ * @brief Whether an idle connection can still be used, which it can't once
+ *        the server has closed it or sent something unasked.
+ */
+bool UpstreamPool::StillOpen(SOCKET socket) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+    u_long nonBlocking = 1;
+    ioctlsocket(socket, FIONBIO, &nonBlocking);
+
+    char byte;
+    int result = recv(socket, &byte, 1, MSG_PEEK);
+    bool open = result == SOCKET_ERROR &&
+                WSAGetLastError() == WSAEWOULDBLOCK;
+
+    nonBlocking = 0;
+    ioctlsocket(socket, FIONBIO, &nonBlocking);
+    return open;
+#else
+    char byte;
+    ssize_t result;
+    do {
+        result = recv(socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    } while (result == -1 && errno == EINTR);
+
+    return result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+}
+
+void UpstreamPool::SetTimeouts(SOCKET socket, unsigned int timeoutSeconds) {
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_WINDOWS_MSVC)
+    DWORD timeout = timeoutSeconds * 1000;
+#else
+    timeval timeout {};
+    timeout.tv_sec = timeoutSeconds;
+#endif
+
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO,
+               reinterpret_cast<const char *>(&timeout), sizeof(timeout));
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO,
+               reinterpret_cast<const char *>(&timeout), sizeof(timeout));
+}
+
+}   // namespace webloom::core
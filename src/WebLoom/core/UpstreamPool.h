@@ -0,0 +1,61 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_UPSTREAMPOOL_H_
+#define CORE_UPSTREAMPOOL_H_
+#include <cstddef>
+#include <mutex>                // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+#include "SocketDefinitions.h"
+
+namespace webloom::core {
+
+/**
+ * @brief Keep-alive connections to one upstream server, shared by the
+ *        worker threads proxying requests to it.
+ *
+ * A connection is taken for one request and its response, then handed back
+ * to be reused by the next request rather than being closed. Connections
+ * are blocking, reads and writes waiting at most the timeout given when the
+ * connection was taken. The pool may be shared between threads.
+ */
+class UpstreamPool {
+ public:
+    UpstreamPool(std::string host, unsigned int port);
+
+    ~UpstreamPool();
+
+    UpstreamPool(const UpstreamPool &) = delete;
+    UpstreamPool &operator=(const UpstreamPool &) = delete;
+
+    const std::string &Host() const { return host_; }
+
+    unsigned int Port() const { return port_; }
+
+    SOCKET Acquire(unsigned int timeoutSeconds, bool *reused);
+
+    void Release(SOCKET socket, size_t maxIdle);
+
+    void Discard(SOCKET socket);
+
+    size_t IdleConnections();
+
+ private:
+    std::string host_;
+    unsigned int port_;
+
+    // Connections waiting to be reused, the most recently used last.
+    std::mutex mutex_;
+    std::vector<SOCKET> idle_;
+
+    SOCKET Connect(unsigned int timeoutSeconds);
+
+    static bool StillOpen(SOCKET socket);
+
+    static void SetTimeouts(SOCKET socket, unsigned int timeoutSeconds);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_UPSTREAMPOOL_H_
@@ -0,0 +1,948 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include "core/Platform.h"
+
+#if (WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>               // NOLINT(build/c++11)
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "UringServer.h"
+
+namespace webloom::core {
+
+constexpr unsigned SUBMISSION_QUEUE_ENTRIES = 256;
+constexpr unsigned COMPLETION_QUEUE_ENTRIES = 4096;
+
+// Receive buffers handed to the kernel, which picks one per completed
+// receive. The count must be a power of two.
+constexpr unsigned RECEIVE_BUFFER_COUNT = 256;
+constexpr unsigned RECEIVE_BUFFER_SIZE = 16384;
+constexpr uint16_t RECEIVE_BUFFER_GROUP = 0;
+
+// Buffers gathered into one send, two per queued response.
+constexpr size_t MAX_SEND_VECTORS = 32;
+
+// Capacity requested for the pipe a connection splices file bodies through.
+constexpr int SPLICE_PIPE_SIZE = 256 * 1024;
+
+// How long the ring may wait for completions, this bounds how long it takes
+// the server to notice that a shutdown has been requested.
+constexpr int WAIT_TIMEOUT_MS = 500;
+
+// How long a shutdown waits for sockets the kernel is still closing.
+constexpr auto SHUTDOWN_DRAIN_TIMEOUT = std::chrono::seconds(1);
+
+// Every submission carries the operation in its top byte and the connection
+// it belongs to in the remaining bits.
+enum class Operation : uint64_t {
+    Accept = 1,
+    Receive,
+    Send,
+    Splice,
+    Shutdown,
+    Close,
+    Wakeup
+};
+
+constexpr int OPERATION_SHIFT = 56;
+constexpr uint64_t CONNECTION_MASK = (1ULL << OPERATION_SHIFT) - 1;
+
+static uint64_t EncodeUserData(Operation operation, ConnectionId id) {
+    return (static_cast<uint64_t>(operation) << OPERATION_SHIFT) | id;
+}
+
+static void PrepareSplice(io_uring_sqe *sqe,
+                          int input,
+                          uint64_t inputOffset,
+                          int output,
+                          size_t length) {
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = input;
+    sqe->splice_off_in = inputOffset;
+    sqe->fd = output;
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->splice_flags = SPLICE_F_MOVE;
+}
+
+/**
+ * @brief The io_uring instance with its mapped queues and the ring of
+ *        provided receive buffers.
+ *
+ * The rings are driven directly through the system calls so that no
+ * additional library is needed.
+ */
+struct UringServer::Ring {
+    int fd = -1;
+
+    void *queueMemory = MAP_FAILED;
+    size_t queueMemorySize = 0;
+    void *completionMemory = MAP_FAILED;
+    size_t completionMemorySize = 0;
+
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    unsigned cqMask = 0;
+
+    io_uring_buf_ring *bufferRing =
+        static_cast<io_uring_buf_ring *>(MAP_FAILED);
+    size_t bufferRingSize = 0;
+    uint16_t bufferTail = 0;
+    std::unique_ptr<char[]> buffers;
+
+    ~Ring() { Close(); }
+
+    void Open();
+
+    void Close();
+
+    unsigned FreeSubmissionSlots() const;
+
+    io_uring_sqe *NextSubmission();
+
+    void Reserve(unsigned count);
+
+    int Enter(unsigned waitFor, int timeoutMs);
+
+    bool NextCompletion(io_uring_cqe *completion);
+
+    bool HasCompletions() const {
+        return *cqHead != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    void ProvideBuffer(uint16_t bufferId);
+
+    const char *Buffer(uint16_t bufferId) const {
+        return buffers.get() + bufferId * RECEIVE_BUFFER_SIZE;
+    }
+};
+
+void UringServer::Ring::Open() {
+    io_uring_params params {};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = COMPLETION_QUEUE_ENTRIES;
+
+    fd = static_cast<int>(syscall(__NR_io_uring_setup,
+                                  SUBMISSION_QUEUE_ENTRIES, &params));
+    if (fd == -1) {
+        throw std::runtime_error("io_uring_setup failed: " +
+                                 std::string(strerror(errno)));
+    }
+
+    // Waiting with a timeout and not losing completions when the queue
+    // overflows are both relied upon.
+    if (!(params.features & IORING_FEAT_EXT_ARG) ||
+        !(params.features & IORING_FEAT_NODROP)) {
+        throw std::runtime_error("io_uring lacks required features");
+    }
+
+    queueMemorySize = params.sq_off.array +
+                      params.sq_entries * sizeof(unsigned);
+    completionMemorySize = params.cq_off.cqes +
+                           params.cq_entries * sizeof(io_uring_cqe);
+
+    bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping) {
+        queueMemorySize = std::max(queueMemorySize, completionMemorySize);
+    }
+
+    queueMemory = mmap(nullptr, queueMemorySize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (queueMemory == MAP_FAILED) {
+        throw std::runtime_error("Unable to map io_uring submission queue");
+    }
+
+    if (singleMapping) {
+        completionMemory = queueMemory;
+    } else {
+        completionMemory = mmap(nullptr, completionMemorySize,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+        if (completionMemory == MAP_FAILED) {
+            throw std::runtime_error(
+                "Unable to map io_uring completion queue");
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(
+        mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) {
+        throw std::runtime_error("Unable to map io_uring submission entries");
+    }
+
+    char *queue = static_cast<char *>(queueMemory);
+    sqHead = reinterpret_cast<unsigned *>(queue + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(queue + params.sq_off.tail);
+    sqArray = reinterpret_cast<unsigned *>(queue + params.sq_off.array);
+    sqMask = *reinterpret_cast<unsigned *>(queue + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+
+    char *completion = static_cast<char *>(completionMemory);
+    cqHead = reinterpret_cast<unsigned *>(completion + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(completion + params.cq_off.tail);
+    cqes = reinterpret_cast<io_uring_cqe *>(completion + params.cq_off.cqes);
+    cqMask = *reinterpret_cast<unsigned *>(completion +
+                                           params.cq_off.ring_mask);
+
+    bufferRingSize = RECEIVE_BUFFER_COUNT * sizeof(io_uring_buf);
+    bufferRing = static_cast<io_uring_buf_ring *>(
+        mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (bufferRing == MAP_FAILED) {
+        throw std::runtime_error("Unable to allocate receive buffer ring");
+    }
+
+    io_uring_buf_reg registration {};
+    registration.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+    registration.ring_entries = RECEIVE_BUFFER_COUNT;
+    registration.bgid = RECEIVE_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING,
+                &registration, 1) == -1) {
+        throw std::runtime_error("Unable to register receive buffers: " +
+                                 std::string(strerror(errno)));
+    }
+
+    buffers.reset(new char[RECEIVE_BUFFER_COUNT * RECEIVE_BUFFER_SIZE]);
+    for (unsigned i = 0; i < RECEIVE_BUFFER_COUNT; i++) {
+        ProvideBuffer(static_cast<uint16_t>(i));
+    }
+}
+
+void UringServer::Ring::Close() {
+    // Closing the ring cancels everything still in flight.
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+
+    if (bufferRing != MAP_FAILED) {
+        munmap(bufferRing, bufferRingSize);
+        bufferRing = static_cast<io_uring_buf_ring *>(MAP_FAILED);
+    }
+
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqesSize);
+        sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    }
+
+    if (completionMemory != MAP_FAILED && completionMemory != queueMemory) {
+        munmap(completionMemory, completionMemorySize);
+    }
+    completionMemory = MAP_FAILED;
+
+    if (queueMemory != MAP_FAILED) {
+        munmap(queueMemory, queueMemorySize);
+        queueMemory = MAP_FAILED;
+    }
+
+    buffers.reset();
+}
+
+unsigned UringServer::Ring::FreeSubmissionSlots() const {
+    return sqEntries - (*sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief Makes sure the next count submissions land in the same batch.
+ *
+ * Linked submissions must reach the kernel together, a chain split across
+ * two io_uring_enter() calls would be broken.
+ */
+void UringServer::Ring::Reserve(unsigned count) {
+    if (FreeSubmissionSlots() < count && Enter(0, 0) == -1 &&
+        errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+        throw std::runtime_error("io_uring_enter failed: " +
+                                 std::string(strerror(errno)));
+    }
+
+    if (FreeSubmissionSlots() < count) {
+        throw std::runtime_error("io_uring submission queue is full");
+    }
+}
+
+/**
+ * @brief Claims a cleared submission entry.
+ *
+ * The kernel only reads the queue from within io_uring_enter(), which is
+ * only ever called from the server thread, so the entry may be filled in
+ * after it has been added to the queue.
+ */
+io_uring_sqe *UringServer::Ring::NextSubmission() {
+    Reserve(1);
+
+    unsigned tail = *sqTail;
+    unsigned index = tail & sqMask;
+
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    return sqe;
+}
+
+/**
+ * @brief Submits everything queued and optionally waits for completions.
+ *
+ * @return The result of io_uring_enter(), -1 with errno set on failure.
+ */
+int UringServer::Ring::Enter(unsigned waitFor, int timeoutMs) {
+    unsigned toSubmit = *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+    if (waitFor == 0) {
+        if (toSubmit == 0) {
+            return 0;
+        }
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit,
+                                        0, 0, nullptr, 0));
+    }
+
+    __kernel_timespec timeout {};
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+
+    io_uring_getevents_arg argument {};
+    argument.ts = reinterpret_cast<uint64_t>(&timeout);
+
+    return static_cast<int>(syscall(
+        __NR_io_uring_enter, fd, toSubmit, waitFor,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+        &argument, sizeof(argument)));
+}
+
+/**
+ * @brief Takes the next completion off the queue.
+ *
+ * @return false if the completion queue is empty.
+ */
+bool UringServer::Ring::NextCompletion(io_uring_cqe *completion) {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    *completion = cqes[head & cqMask];
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void UringServer::Ring::ProvideBuffer(uint16_t bufferId) {
+    // The entries are addressed from the start of the ring rather than
+    // through the bufs member, which the kernel header declares in a way
+    // that gives it a different offset when compiled as C++.
+    io_uring_buf *buffer = reinterpret_cast<io_uring_buf *>(bufferRing) +
+                           (bufferTail & (RECEIVE_BUFFER_COUNT - 1));
+    buffer->addr = reinterpret_cast<uint64_t>(Buffer(bufferId));
+    buffer->len = RECEIVE_BUFFER_SIZE;
+    buffer->bid = bufferId;
+
+    bufferTail++;
+    __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+}
+
+struct UringServer::UringConnection : public Connection {
+    UringConnection(BufferPool *pool,
+                    size_t *bufferedOutput,
+                    MemoryBudget *budget)
+        : Connection(pool, bufferedOutput, budget),
+          sending(bufferedOutput, budget) {}
+
+    size_t BufferedOutput() const {
+        return output.BufferedBytes() + sending.BufferedBytes() +
+               PendingFrames();
+    }
+
+    bool Writing() const { return !output.Empty() || !sending.Empty(); }
+
+    // Output currently owned by the kernel, the buffers and the message
+    // describing them must stay untouched until the send completes.
+    OutputQueue sending;
+    iovec vectors[MAX_SEND_VECTORS];
+    msghdr message {};
+    bool sendInFlight = false;
+
+    // The socket is closed or being closed, nothing more is submitted for
+    // it. The connection is dropped once the kernel is done with it.
+    bool socketClosed = false;
+
+    // The close was linked to the final send and is performed by the kernel.
+    bool closeLinked = false;
+
+    // File bodies are spliced through this pipe into the socket, piped is
+    // how much of the file is waiting in it.
+    int pipe[2] = { -1, -1 };
+    size_t pipeCapacity = 0;
+    size_t piped = 0;
+
+    ~UringConnection() {
+        if (pipe[0] != -1) {
+            close(pipe[0]);
+            close(pipe[1]);
+        }
+    }
+
+    bool OpenPipe() {
+        if (pipe[0] != -1) {
+            return true;
+        }
+
+        if (pipe2(pipe, O_CLOEXEC) == -1) {
+            return false;
+        }
+
+        int capacity = fcntl(pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+        if (capacity == -1) {
+            capacity = fcntl(pipe[1], F_GETPIPE_SZ);
+        }
+        pipeCapacity = capacity > 0 ? static_cast<size_t>(capacity) : 4096;
+        return true;
+    }
+};
+
+UringServer::UringServer(Logger* logger,
+                         WebLoomSettings *settings,
+                         core::FileServer *fileServer)
+    : AsyncServerBase(logger, settings, fileServer, 1), ring_(new Ring),
+      multishot_accept_(true), wakeup_value_(0) {
+}
+
+UringServer::~UringServer() {
+    delete ring_;
+}
+
+/**
+ * @brief Checks that the running kernel supports every io_uring operation
+ *        and feature this server relies on.
+ */
+bool UringServer::IsSupported() {
+    static const bool supported = []() {
+        try {
+            Ring ring;
+            ring.Open();
+
+            constexpr unsigned PROBE_OPERATIONS = 256;
+            size_t probeSize = sizeof(io_uring_probe) +
+                               PROBE_OPERATIONS * sizeof(io_uring_probe_op);
+            std::unique_ptr<char[]> probeMemory(new char[probeSize]());
+            auto probe = reinterpret_cast<io_uring_probe *>(probeMemory.get());
+
+            if (syscall(__NR_io_uring_register, ring.fd,
+                        IORING_REGISTER_PROBE, probe,
+                        PROBE_OPERATIONS) == -1) {
+                return false;
+            }
+
+            for (unsigned operation : { IORING_OP_ACCEPT, IORING_OP_RECV,
+                                        IORING_OP_SENDMSG, IORING_OP_SPLICE,
+                                        IORING_OP_SHUTDOWN, IORING_OP_CLOSE,
+                                        IORING_OP_READ }) {
+                if (operation > probe->last_op ||
+                    !(probe->ops[operation].flags & IO_URING_OP_SUPPORTED)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+        catch (std::runtime_error &) {
+            return false;
+        }
+    }();
+
+    return supported;
+}
+
+void UringServer::InitialiseServerLoop() {
+    ring_->Open();
+    OpenWakeupEvent();
+
+    for (size_t i = 0; i < listeners_.size(); i++) {
+        SubmitAccept(i);
+    }
+    SubmitWakeupRead();
+
+    logger_->LogInfo("io_uring reactor started");
+}
+
+void UringServer::ServerLoop() {
+    unsigned waitFor = 1;
+
+    // Busy polling submits what is queued and then watches the completion
+    // queue without sleeping, completions posted in the meantime are then
+    // taken without waiting in io_uring_enter().
+    if (settings_->BusyPollBudget() > 0) {
+        ring_->Enter(0, 0);
+        if (BusyPoll([this]() { return ring_->HasCompletions(); })) {
+            waitFor = 0;
+        }
+    }
+
+    if (ring_->Enter(waitFor, WAIT_TIMEOUT_MS) == -1 &&
+        errno != EINTR && errno != ETIME &&
+        errno != EBUSY && errno != EAGAIN) {
+        throw std::runtime_error("io_uring_enter failed: " +
+                                 std::string(strerror(errno)));
+    }
+
+    io_uring_cqe completion;
+    while (ring_->NextCompletion(&completion)) {
+        ProcessCompletion(completion.user_data, completion.res,
+                          completion.flags);
+    }
+
+    ResumeHeldConnections();
+    ExpireTimers();
+}
+
+void UringServer::ShutdownServerLoop() {
+    CloseAllConnections();
+    CloseWakeupEvent();
+
+    // Sockets whose close was linked to their final send, or whose send was
+    // still in flight, are finished off by the kernel first.
+    auto deadline = std::chrono::steady_clock::now() + SHUTDOWN_DRAIN_TIMEOUT;
+    while (!connections_.empty() &&
+           std::chrono::steady_clock::now() < deadline) {
+        ring_->Enter(1, 100);
+
+        io_uring_cqe completion;
+        while (ring_->NextCompletion(&completion)) {
+            ProcessCompletion(completion.user_data, completion.res,
+                              completion.flags);
+        }
+    }
+
+    if (!connections_.empty()) {
+        logger_->LogWarn("%zu connections were still closing at shutdown",
+                         connections_.size());
+        connections_.clear();
+    }
+
+    ring_->Close();
+}
+
+/**
+ * @param listener Index of the listening socket in listeners_, carried in
+ *                 place of a connection identifier.
+ */
+void UringServer::SubmitAccept(size_t listener) {
+    io_uring_sqe *sqe = ring_->NextSubmission();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listeners_[listener].socket;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (multishot_accept_) {
+        sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    }
+    sqe->user_data = EncodeUserData(Operation::Accept, listener);
+}
+
+void UringServer::SubmitReceive(Connection *connection) {
+    io_uring_sqe *sqe = ring_->NextSubmission();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->socket;
+    sqe->len = RECEIVE_BUFFER_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECEIVE_BUFFER_GROUP;
+    sqe->user_data = EncodeUserData(Operation::Receive, connection->id);
+}
+
+void UringServer::SubmitWakeupRead() {
+    io_uring_sqe *sqe = ring_->NextSubmission();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeup_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeup_value_);
+    sqe->len = sizeof(wakeup_value_);
+    sqe->user_data = EncodeUserData(Operation::Wakeup, 0);
+}
+
+void UringServer::ProcessCompletion(uint64_t userData,
+                                    int result,
+                                    uint32_t flags) {
+    auto operation = static_cast<Operation>(userData >> OPERATION_SHIFT);
+    Connection *connection = FindConnection(userData & CONNECTION_MASK);
+
+    switch (operation) {
+        case Operation::Accept:
+            HandleAccept(userData & CONNECTION_MASK, result, flags);
+            break;
+
+        case Operation::Receive:
+            HandleReceive(connection, result, flags);
+            break;
+
+        case Operation::Send:
+            if (connection) {
+                HandleSend(connection, result);
+            }
+            break;
+
+        case Operation::Splice:
+            if (connection) {
+                HandleSplice(connection, result);
+            }
+            break;
+
+        case Operation::Shutdown:
+            break;
+
+        case Operation::Close:
+            if (connection) {
+                // The close is cancelled along with the rest of the chain
+                // when the final send fails.
+                if (result == -ECANCELED) {
+                    closesocket(connection->socket);
+                }
+                RemoveConnection(connection);
+            }
+            break;
+
+        case Operation::Wakeup:
+            if (wakeup_fd_ == -1) {
+                break;
+            }
+
+            if (result < 0 && result != -EAGAIN && result != -EINTR) {
+                logger_->LogError("Reading reactor wakeup event failed: %s",
+                                  strerror(-result));
+            }
+
+            ProcessCompletedResponses();
+            SubmitWakeupRead();
+            break;
+    }
+}
+
+void UringServer::HandleAccept(size_t listener, int result, uint32_t flags) {
+    bool rearm = !(flags & IORING_CQE_F_MORE);
+
+    if (result >= 0) {
+        if (shutdown_requested_) {
+            closesocket(result);
+            return;
+        }
+
+        if (ConnectionLimitReached(connections_.size())) {
+            RejectConnection(result);
+        } else {
+            ConfigureClientSocket(result, listeners_[listener]);
+
+            auto created = std::make_unique<UringConnection>(
+                &buffer_pool_, &buffered_output_, memory_budget_);
+            created->socket = result;
+            SubmitReceive(AddConnection(std::move(created)));
+        }
+    } else if (result == -EINVAL && multishot_accept_ &&
+               !shutdown_requested_) {
+        // Unless RequestShutdown() has stopped the listening socket, which
+        // also fails accepts with EINVAL.
+        logger_->LogInfo("Multishot accept unavailable, using single accepts");
+        multishot_accept_ = false;
+    } else if (result != -ECANCELED && result != -EINTR &&
+               result != -ECONNABORTED && result != -EINVAL) {
+        logger_->LogError("Accept failed: %s", strerror(-result));
+    }
+
+    if (rearm && !shutdown_requested_) {
+        SubmitAccept(listener);
+    }
+}
+
+/**
+ * @brief Takes the data the kernel placed in a provided buffer.
+ *
+ * The buffer is returned to the kernel straight away, whether or not the
+ * connection it was received for still exists.
+ */
+void UringServer::HandleReceive(Connection *connection,
+                                int result,
+                                uint32_t flags) {
+    if (flags & IORING_CQE_F_BUFFER) {
+        auto bufferId = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (connection && result > 0) {
+            connection->input.Append(ring_->Buffer(bufferId), result);
+        }
+        ring_->ProvideBuffer(bufferId);
+    }
+
+    if (!connection ||
+        static_cast<UringConnection *>(connection)->socketClosed) {
+        return;
+    }
+
+    if (result == -ENOBUFS) {
+        logger_->LogDebug("Receive buffers exhausted, retrying");
+        SubmitReceive(connection);
+        return;
+    }
+
+    if (result < 0) {
+        CloseConnection(connection);
+        return;
+    }
+
+    if (result == 0) {
+        // A client that half-closes after sending its requests still
+        // expects the responses.
+        connection->peerClosed = true;
+    } else if (!PauseReading(connection)) {
+        SubmitReceive(connection);
+    }
+
+    if (!DispatchRequests(connection)) {
+        return;
+    }
+
+    CloseIfFinished(connection);
+}
+
+/**
+ * @brief Submits the receive left out whilst the memory budget was
+ *        exhausted, and handles whatever was received before then.
+ */
+void UringServer::ResumeReading(Connection *connection) {
+    if (static_cast<UringConnection *>(connection)->socketClosed) {
+        return;
+    }
+
+    SubmitReceive(connection);
+
+    if (DispatchRequests(connection)) {
+        CloseIfFinished(connection);
+    }
+}
+
+void UringServer::HandleSend(Connection *connection, int result) {
+    auto uringConnection = static_cast<UringConnection *>(connection);
+    uringConnection->sendInFlight = false;
+
+    if (uringConnection->closeLinked) {
+        // The linked close completes the connection.
+        return;
+    }
+
+    if (uringConnection->socketClosed) {
+        RemoveConnection(connection);
+        return;
+    }
+
+    if (result < 0) {
+        CloseConnection(connection);
+        return;
+    }
+
+    if (uringConnection->piped > 0) {
+        uringConnection->piped -= result;
+    }
+
+    uringConnection->sending.Consume(result);
+    if (result > 0) {
+        connection->lastWrite = std::chrono::steady_clock::now();
+    }
+
+    if (!uringConnection->sending.Empty()) {
+        if (WriteToConnection(connection)) {
+            UpdateTimer(connection);
+        }
+        return;
+    }
+
+    if (!connection->output.Empty()) {
+        connection->lastActivity = std::chrono::steady_clock::now();
+        WriteToConnection(connection);
+        return;
+    }
+
+    OutputDrained(connection);
+}
+
+/**
+ * @brief Accounts for part of a file body having been moved into the pipe,
+ *        from where it is spliced into the socket.
+ */
+void UringServer::HandleSplice(Connection *connection, int result) {
+    auto uringConnection = static_cast<UringConnection *>(connection);
+    uringConnection->sendInFlight = false;
+
+    if (uringConnection->socketClosed) {
+        RemoveConnection(connection);
+        return;
+    }
+
+    // Nothing read means the file has been truncated since it was opened,
+    // the length promised in the header can no longer be met.
+    if (result <= 0) {
+        CloseConnection(connection);
+        return;
+    }
+
+    uringConnection->piped += result;
+    WriteToConnection(connection);
+}
+
+/**
+ * @brief Submits the pending output unless a send is already in flight.
+ *
+ * When nothing else can follow on the connection the send is linked to the
+ * shutdown and close of the socket, so finishing the connection costs no
+ * further system calls. File bodies are spliced from the file into a pipe
+ * and from there into the socket, so their contents never pass through
+ * user space.
+ *
+ * @return false if the connection was closed, otherwise true.
+ */
+bool UringServer::WriteToConnection(Connection *connection) {
+    auto uringConnection = static_cast<UringConnection *>(connection);
+
+    if (uringConnection->socketClosed) {
+        return false;
+    }
+
+    if (uringConnection->sendInFlight) {
+        return true;
+    }
+
+    OutputQueue &sending = uringConnection->sending;
+    if (sending.Empty()) {
+        if (connection->output.Empty()) {
+            return !CloseIfFinished(connection);
+        }
+        sending.Swap(connection->output);
+    }
+
+    if (uringConnection->piped > 0) {
+        io_uring_sqe *sqe = ring_->NextSubmission();
+        PrepareSplice(sqe, uringConnection->pipe[0], static_cast<uint64_t>(-1),
+                      connection->socket, uringConnection->piped);
+        sqe->user_data = EncodeUserData(Operation::Send, connection->id);
+        uringConnection->sendInFlight = true;
+        return true;
+    }
+
+    // Data a streamed response spliced into its own pipe goes on from there.
+    int pipe;
+    size_t splicedLength;
+    if (sending.NextSpliced(&pipe, &splicedLength)) {
+        io_uring_sqe *sqe = ring_->NextSubmission();
+        PrepareSplice(sqe, pipe, static_cast<uint64_t>(-1),
+                      connection->socket, splicedLength);
+        sqe->user_data = EncodeUserData(Operation::Send, connection->id);
+        uringConnection->sendInFlight = true;
+        return true;
+    }
+
+    int file;
+    off_t fileOffset;
+    size_t fileLength;
+    if (sending.NextFile(&file, &fileOffset, &fileLength)) {
+        if (!uringConnection->OpenPipe()) {
+            logger_->LogError("Failed to create splice pipe: %s",
+                              strerror(errno));
+            CloseConnection(connection);
+            return false;
+        }
+
+        io_uring_sqe *sqe = ring_->NextSubmission();
+        PrepareSplice(sqe, file, static_cast<uint64_t>(fileOffset),
+                      uringConnection->pipe[1],
+                      std::min(fileLength, uringConnection->pipeCapacity));
+        sqe->user_data = EncodeUserData(Operation::Splice, connection->id);
+        uringConnection->sendInFlight = true;
+        return true;
+    }
+
+    msghdr &message = uringConnection->message;
+    message.msg_iov = uringConnection->vectors;
+    message.msg_iovlen = sending.Gather(uringConnection->vectors,
+                                        MAX_SEND_VECTORS);
+
+    size_t messageLength = 0;
+    for (size_t i = 0; i < message.msg_iovlen; i++) {
+        messageLength += message.msg_iov[i].iov_len;
+    }
+
+    // Only a send carrying everything that is left may take the connection
+    // down with it.
+    bool finalSend = (connection->closing || connection->peerClosed) &&
+                     connection->Outstanding() == 0 &&
+                     connection->output.Empty() &&
+                     messageLength == sending.PendingBytes();
+
+    ring_->Reserve(finalSend ? 3 : 1);
+
+    io_uring_sqe *sqe = ring_->NextSubmission();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = connection->socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&message);
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = EncodeUserData(Operation::Send, connection->id);
+    uringConnection->sendInFlight = true;
+
+    if (finalSend) {
+        sqe->flags |= IOSQE_IO_LINK;
+
+        sqe = ring_->NextSubmission();
+        sqe->opcode = IORING_OP_SHUTDOWN;
+        sqe->fd = connection->socket;
+        sqe->len = SHUT_RDWR;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = EncodeUserData(Operation::Shutdown, connection->id);
+
+        sqe = ring_->NextSubmission();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = connection->socket;
+        sqe->user_data = EncodeUserData(Operation::Close, connection->id);
+
+        uringConnection->socketClosed = true;
+        uringConnection->closeLinked = true;
+    }
+
+    return true;
+}
+
+void UringServer::CloseConnection(Connection *connection) {
+    auto uringConnection = static_cast<UringConnection *>(connection);
+
+    if (uringConnection->socketClosed) {
+        return;
+    }
+    uringConnection->socketClosed = true;
+    timers_.Cancel(&connection->timer);
+
+    // Requests in flight hold their own reference to the socket, shutting
+    // it down makes them complete so the socket is released.
+    shutdown(connection->socket, SHUT_RDWR);
+    closesocket(connection->socket);
+
+    if (!uringConnection->sendInFlight) {
+        RemoveConnection(connection);
+    }
+}
+
+}   // namespace webloom::core
+
+#endif  // WEBLOOM_PLATFORM == WEBLOOM_PLATFORM_LINUX
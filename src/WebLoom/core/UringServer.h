@@ -0,0 +1,74 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_URINGSERVER_H_
+#define CORE_URINGSERVER_H_
+#include <cstdint>
+#include "AsyncServerBase.h"
+
+namespace webloom::core {
+
+/**
+ * @brief Completion based server built on an io_uring submission ring.
+ *
+ * Connections are accepted with a multishot accept, received into buffers
+ * the kernel picks from a ring of provided buffers and written with sends
+ * that, for the last response on a connection, are linked to the shutdown
+ * and close of the socket. Network I/O is therefore submitted and reaped in
+ * batches by a single io_uring_enter() per pass of the loop. Request
+ * handling is shared with the epoll server.
+ *
+ * One ring is used per server, so running several listeners gives one ring
+ * per core. This server is only available on Linux, IsSupported() reports
+ * whether the running kernel provides everything it needs.
+ */
+class UringServer : public AsyncServerBase {
+ public:
+    UringServer(Logger *logger,
+                WebLoomSettings *settings,
+                core::FileServer *fileServer);
+
+    ~UringServer();
+
+    static bool IsSupported();
+
+ private:
+    struct Ring;
+    struct UringConnection;
+
+    Ring *ring_;
+    bool multishot_accept_;
+    uint64_t wakeup_value_;
+
+    void InitialiseServerLoop();
+
+    void ServerLoop();
+
+    void ShutdownServerLoop();
+
+    void SubmitAccept(size_t listener);
+
+    void SubmitReceive(Connection *connection);
+
+    void SubmitWakeupRead();
+
+    void ProcessCompletion(uint64_t userData, int result, uint32_t flags);
+
+    void HandleAccept(size_t listener, int result, uint32_t flags);
+
+    void HandleReceive(Connection *connection, int result, uint32_t flags);
+
+    void ResumeReading(Connection *connection);
+
+    void HandleSend(Connection *connection, int result);
+
+    void HandleSplice(Connection *connection, int result);
+
+    bool WriteToConnection(Connection *connection);
+
+    void CloseConnection(Connection *connection);
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_URINGSERVER_H_
@@ -0,0 +1,558 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include "WebSocketCodec.h"
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+
+namespace webloom::core {
+
+constexpr uint8_t FLAG_FINAL = 0x80;
+constexpr uint8_t FLAG_MASKED = 0x80;
+constexpr uint8_t RESERVED_BITS = 0x70;
+constexpr uint8_t OPCODE_MASK = 0x0f;
+constexpr uint8_t CONTROL_OPCODE = 0x08;
+
+constexpr uint8_t LENGTH_16_BIT = 126;
+constexpr uint8_t LENGTH_64_BIT = 127;
+constexpr size_t MAX_CONTROL_PAYLOAD = 125;
+constexpr size_t MASK_LENGTH = 4;
+
+constexpr uint16_t CLOSE_NO_STATUS = 1005;
+constexpr uint16_t CLOSE_ABNORMAL = 1006;
+constexpr uint16_t CLOSE_PROTOCOL_ERROR = 1002;
+constexpr uint16_t CLOSE_INVALID_DATA = 1007;
+constexpr uint16_t CLOSE_TOO_BIG = 1009;
+
+// Appended to the client's key before hashing it, RFC 6455 section 1.3.
+constexpr const char* ACCEPT_KEY_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+constexpr const char* BASE64_ALPHABET =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static uint32_t RotateLeft(uint32_t value, unsigned bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ * @brief SHA-1 of a short message, which the handshake needs and nothing
+ *        else, so that it does not have to depend on a crypto library.
+ */
+static std::array<uint8_t, 20> Sha1(std::string_view message) {
+    uint32_t state[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+
+    std::string padded(message);
+    padded.push_back(static_cast<char>(0x80));
+    while (padded.size() % 64 != 56) {
+        padded.push_back(0);
+    }
+
+    uint64_t bits = static_cast<uint64_t>(message.size()) * 8;
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        padded.push_back(static_cast<char>(bits >> shift));
+    }
+
+    for (size_t block = 0; block < padded.size(); block += 64) {
+        uint32_t words[80];
+        for (size_t i = 0; i < 16; i++) {
+            const auto *bytes = reinterpret_cast<const uint8_t *>(
+                padded.data() + block + i * 4);
+            words[i] = (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) |
+                       (uint32_t(bytes[2]) << 8) | bytes[3];
+        }
+        for (size_t i = 16; i < 80; i++) {
+            words[i] = RotateLeft(words[i - 3] ^ words[i - 8] ^
+                                  words[i - 14] ^ words[i - 16], 1);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4];
+
+        for (size_t i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+
+            uint32_t temp = RotateLeft(a, 5) + f + e + k + words[i];
+            e = d;
+            d = c;
+            c = RotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+
+    std::array<uint8_t, 20> digest;
+    for (size_t i = 0; i < 20; i++) {
+        digest[i] = static_cast<uint8_t>(state[i / 4] >> (24 - (i % 4) * 8));
+    }
+    return digest;
+}
+
+static std::string EncodeBase64(const uint8_t *data, size_t length) {
+    std::string encoded;
+
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t group = uint32_t(data[i]) << 16;
+        if (i + 1 < length) {
+            group |= uint32_t(data[i + 1]) << 8;
+        }
+        if (i + 2 < length) {
+            group |= data[i + 2];
+        }
+
+        encoded.push_back(BASE64_ALPHABET[(group >> 18) & 0x3f]);
+        encoded.push_back(BASE64_ALPHABET[(group >> 12) & 0x3f]);
+        encoded.push_back(i + 1 < length ? BASE64_ALPHABET[(group >> 6) & 0x3f]
+                                         : '=');
+        encoded.push_back(i + 2 < length ? BASE64_ALPHABET[group & 0x3f] : '=');
+    }
+
+    return encoded;
+}
+
+/**
+ * @brief Checks that text is well formed UTF-8, without overlong forms,
+ *        surrogates or code points past U+10FFFF.
+ */
+static bool IsValidUtf8(std::string_view text) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(text.data());
+    size_t length = text.size();
+    size_t i = 0;
+
+    while (i < length) {
+        // Runs of ASCII are skipped eight bytes at a time.
+        if (length - i >= 8) {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            if ((word & 0x8080808080808080ull) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+
+        uint8_t lead = bytes[i];
+        if (lead < 0x80) {
+            i++;
+            continue;
+        }
+
+        size_t sequence;
+        uint32_t codePoint;
+        if ((lead & 0xe0) == 0xc0) {
+            sequence = 2;
+            codePoint = lead & 0x1f;
+        } else if ((lead & 0xf0) == 0xe0) {
+            sequence = 3;
+            codePoint = lead & 0x0f;
+        } else if ((lead & 0xf8) == 0xf0) {
+            sequence = 4;
+            codePoint = lead & 0x07;
+        } else {
+            return false;
+        }
+
+        if (length - i < sequence) {
+            return false;
+        }
+
+        for (size_t j = 1; j < sequence; j++) {
+            if ((bytes[i + j] & 0xc0) != 0x80) {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (bytes[i + j] & 0x3f);
+        }
+
+        if ((sequence == 2 && codePoint < 0x80) ||
+            (sequence == 3 && codePoint < 0x800) ||
+            (sequence == 4 && codePoint < 0x10000) ||
+            codePoint > 0x10ffff ||
+            (codePoint >= 0xd800 && codePoint <= 0xdfff)) {
+            return false;
+        }
+
+        i += sequence;
+    }
+
+    return true;
+}
+
+static bool IsValidCloseCode(uint16_t code) {
+    return (code >= 1000 && code <= 1003) ||
+           (code >= 1007 && code <= 1011) ||
+           (code >= 3000 && code <= 4999);
+}
+
+/**
+ * @param maxMessageSize Largest data message accepted, counting every
+ *                       fragment.
+ * @param budget Memory budget the message being assembled is charged to.
+ *               May be null.
+ */
+WebSocketCodec::WebSocketCodec(size_t maxMessageSize, MemoryBudget *budget)
+    : max_message_size_(maxMessageSize), in_frame_(false), final_(false),
+      frame_opcode_(Opcode::Continuation), payload_remaining_(0), mask_{},
+      mask_offset_(0), message_opcode_(Opcode::Continuation),
+      budget_(budget), charged_(0) {
+}
+
+WebSocketCodec::~WebSocketCodec() {
+    if (budget_) {
+        budget_->Refund(MemoryBudget::Use::RequestBodies, charged_);
+    }
+}
+
+/**
+ * @brief Brings what is charged for the message being assembled in line with
+ *        the memory it holds.
+ */
+void WebSocketCodec::ChargeMessage() {
+    if (!budget_) {
+        return;
+    }
+
+    size_t held = message_.capacity();
+    if (held > charged_) {
+        budget_->Charge(MemoryBudget::Use::RequestBodies, held - charged_);
+    } else {
+        budget_->Refund(MemoryBudget::Use::RequestBodies, charged_ - held);
+    }
+    charged_ = held;
+}
+
+/**
+ * @brief Takes frames from the input until a message or control frame is
+ *        complete.
+ *
+ * @return false if the input ran out first, what it held has been taken.
+ * @throws WebSocketError if the client broke the protocol or sent a message
+ *         over the size limit.
+ */
+bool WebSocketCodec::Next(ReadBuffer *input, Message *message) {
+    while (true) {
+        if (!in_frame_ && !ReadFrameHeader(input)) {
+            return false;
+        }
+
+        bool control = (static_cast<uint8_t>(frame_opcode_) &
+                        CONTROL_OPCODE) != 0;
+        std::string &payload = control ? control_ : message_;
+
+        size_t amount = std::min<uint64_t>(input->Size(), payload_remaining_);
+        if (amount > 0) {
+            size_t start = payload.size();
+            payload.resize(start + amount);
+            Unmask(input->View().data(), amount, mask_, mask_offset_,
+                   &payload[start]);
+
+            input->Consume(amount);
+            payload_remaining_ -= amount;
+            mask_offset_ += amount;
+
+            if (!control) {
+                ChargeMessage();
+            }
+        }
+
+        if (payload_remaining_ > 0) {
+            return false;
+        }
+
+        in_frame_ = false;
+
+        if (control) {
+            if (frame_opcode_ == Opcode::Close) {
+                if (control_.size() == 1 ||
+                    (control_.size() >= 2 &&
+                     !IsValidCloseCode(CloseCode(control_)))) {
+                    throw WebSocketError(CLOSE_PROTOCOL_ERROR,
+                                         "Invalid close frame");
+                }
+                if (control_.size() > 2 &&
+                    !IsValidUtf8(std::string_view(control_).substr(2))) {
+                    throw WebSocketError(CLOSE_INVALID_DATA,
+                                         "Close reason is not UTF-8");
+                }
+            }
+
+            message->opcode = frame_opcode_;
+            message->payload = std::move(control_);
+            control_.clear();
+            return true;
+        }
+
+        // Further fragments follow, control frames may come between them.
+        if (!final_) {
+            continue;
+        }
+
+        if (message_opcode_ == Opcode::Text && !IsValidUtf8(message_)) {
+            throw WebSocketError(CLOSE_INVALID_DATA,
+                                 "Text message is not UTF-8");
+        }
+
+        message->opcode = message_opcode_;
+        message->payload = std::move(message_);
+        message_.clear();
+        message_opcode_ = Opcode::Continuation;
+        ChargeMessage();
+        return true;
+    }
+}
+
+/**
+ * @brief Frames a message as a single unmasked frame, as a server sends
+ *        them.
+ */
+void WebSocketCodec::EncodeFrame(Opcode opcode,
+                                 std::string_view payload,
+                                 std::string *frames) {
+    frames->push_back(static_cast<char>(FLAG_FINAL |
+                                        static_cast<uint8_t>(opcode)));
+
+    uint64_t length = payload.size();
+    if (length < LENGTH_16_BIT) {
+        frames->push_back(static_cast<char>(length));
+    } else if (length <= 0xffff) {
+        frames->push_back(static_cast<char>(LENGTH_16_BIT));
+        frames->push_back(static_cast<char>(length >> 8));
+        frames->push_back(static_cast<char>(length));
+    } else {
+        frames->push_back(static_cast<char>(LENGTH_64_BIT));
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frames->push_back(static_cast<char>(length >> shift));
+        }
+    }
+
+    frames->append(payload);
+}
+
+/**
+ * @brief Frames a close frame carrying the status code, or no code for the
+ *        statuses that may not be sent.
+ */
+void WebSocketCodec::EncodeClose(uint16_t code, std::string *frames) {
+    if (code == CLOSE_NO_STATUS || code == CLOSE_ABNORMAL) {
+        EncodeFrame(Opcode::Close, "", frames);
+        return;
+    }
+
+    char payload[2] = { static_cast<char>(code >> 8), static_cast<char>(code) };
+    EncodeFrame(Opcode::Close, std::string_view(payload, sizeof(payload)),
+                frames);
+}
+
+/**
+ * @brief Status code of a received close frame, 1005 if it has none.
+ */
+uint16_t WebSocketCodec::CloseCode(std::string_view payload) {
+    if (payload.size() < 2) {
+        return CLOSE_NO_STATUS;
+    }
+
+    return static_cast<uint16_t>((static_cast<uint8_t>(payload[0]) << 8) |
+                                 static_cast<uint8_t>(payload[1]));
+}
+
+/**
+ * @brief The Sec-WebSocket-Accept value answering a client's key.
+ */
+std::string WebSocketCodec::AcceptKey(std::string_view key) {
+    std::string keyed(key);
+    keyed += ACCEPT_KEY_GUID;
+
+    std::array<uint8_t, 20> digest = Sha1(keyed);
+    return EncodeBase64(digest.data(), digest.size());
+}
+
+/**
+ * @brief Copies a masked payload, unmasking it on the way.
+ *
+ * The mask repeats every four bytes, so it is widened to a vector register
+ * and the payload is unmasked a register at a time, with the remainder done
+ * eight bytes and then one byte at a time.
+ *
+ * @param offset Position of the source in its frame's payload, for payloads
+ *               that arrive in pieces.
+ */
+void WebSocketCodec::Unmask(const char *source,
+                            size_t length,
+                            const uint8_t mask[4],
+                            size_t offset,
+                            char *destination) {
+    alignas(16) uint8_t key[16];
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = mask[(offset + i) % MASK_LENGTH];
+    }
+
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    __m256i wideKey = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i *>(key)));
+    for (; length - i >= 32; i += 32) {
+        __m256i data = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(source + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i),
+                            _mm256_xor_si256(data, wideKey));
+    }
+#endif
+
+#if defined(__SSE2__)
+    __m128i vectorKey = _mm_load_si128(reinterpret_cast<const __m128i *>(key));
+    for (; length - i >= 16; i += 16) {
+        __m128i data = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(source + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i),
+                         _mm_xor_si128(data, vectorKey));
+    }
+#elif defined(__ARM_NEON)
+    uint8x16_t vectorKey = vld1q_u8(key);
+    for (; length - i >= 16; i += 16) {
+        uint8x16_t data =
+            vld1q_u8(reinterpret_cast<const uint8_t *>(source + i));
+        vst1q_u8(reinterpret_cast<uint8_t *>(destination + i),
+                 veorq_u8(data, vectorKey));
+    }
+#endif
+
+    uint64_t wordKey;
+    memcpy(&wordKey, key, sizeof(wordKey));
+    for (; length - i >= 8; i += 8) {
+        uint64_t word;
+        memcpy(&word, source + i, sizeof(word));
+        word ^= wordKey;
+        memcpy(destination + i, &word, sizeof(word));
+    }
+
+    for (; i < length; i++) {
+        destination[i] = static_cast<char>(source[i] ^ key[i % sizeof(key)]);
+    }
+}
+
+/**
+ * @brief Reads the header of the next frame once all of it has arrived.
+ *
+ * @return false if the header is incomplete, nothing is taken then.
+ */
+bool WebSocketCodec::ReadFrameHeader(ReadBuffer *input) {
+    std::string_view view = input->View();
+    if (view.size() < 2) {
+        return false;
+    }
+
+    auto first = static_cast<uint8_t>(view[0]);
+    auto second = static_cast<uint8_t>(view[1]);
+    uint64_t length = second & ~FLAG_MASKED;
+
+    if (first & RESERVED_BITS) {
+        throw WebSocketError(CLOSE_PROTOCOL_ERROR,
+                             "Reserved bits set with no extension");
+    }
+
+    if (!(second & FLAG_MASKED)) {
+        throw WebSocketError(CLOSE_PROTOCOL_ERROR,
+                             "Unmasked frame from the client");
+    }
+
+    size_t lengthBytes = length == LENGTH_16_BIT ? 2 :
+                         length == LENGTH_64_BIT ? 8 : 0;
+    size_t headerLength = 2 + lengthBytes + MASK_LENGTH;
+    if (view.size() < headerLength) {
+        return false;
+    }
+
+    if (lengthBytes > 0) {
+        length = 0;
+        for (size_t i = 0; i < lengthBytes; i++) {
+            length = (length << 8) | static_cast<uint8_t>(view[2 + i]);
+        }
+    }
+
+    auto opcode = static_cast<Opcode>(first & OPCODE_MASK);
+    bool final = (first & FLAG_FINAL) != 0;
+
+    switch (opcode) {
+        case Opcode::Continuation:
+            if (message_opcode_ == Opcode::Continuation) {
+                throw WebSocketError(CLOSE_PROTOCOL_ERROR,
+                                     "Continuation frame with no message");
+            }
+            break;
+
+        case Opcode::Text:
+        case Opcode::Binary:
+            if (message_opcode_ != Opcode::Continuation) {
+                throw WebSocketError(CLOSE_PROTOCOL_ERROR,
+                                     "Message started before the last one "
+                                     "ended");
+            }
+            break;
+
+        case Opcode::Close:
+        case Opcode::Ping:
+        case Opcode::Pong:
+            if (!final || length > MAX_CONTROL_PAYLOAD) {
+                throw WebSocketError(CLOSE_PROTOCOL_ERROR,
+                                     "Fragmented or oversized control frame");
+            }
+            break;
+
+        default:
+            throw WebSocketError(CLOSE_PROTOCOL_ERROR, "Unknown opcode");
+    }
+
+    if (!(first & CONTROL_OPCODE)) {
+        if (length > max_message_size_ - message_.size()) {
+            throw WebSocketError(CLOSE_TOO_BIG, "Message too large");
+        }
+
+        if (opcode != Opcode::Continuation) {
+            message_opcode_ = opcode;
+            message_.reserve(length);
+            ChargeMessage();
+        }
+    }
+
+    memcpy(mask_, view.data() + headerLength - MASK_LENGTH, MASK_LENGTH);
+    mask_offset_ = 0;
+    frame_opcode_ = opcode;
+    final_ = final;
+    payload_remaining_ = length;
+    in_frame_ = true;
+
+    input->Consume(headerLength);
+    return true;
+}
+
+}   // namespace webloom::core
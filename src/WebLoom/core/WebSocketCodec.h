@@ -0,0 +1,111 @@
+//  WebLoom Framework
+//  Copyright (C) 2024 WebLoom Framework contributors
+//  Released under LGPL 3.0 license (see LICENSE)
+#ifndef CORE_WEBSOCKETCODEC_H_
+#define CORE_WEBSOCKETCODEC_H_
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "core/MemoryBudget.h"
+#include "core/ReadBuffer.h"
+
+namespace webloom::core {
+
+/**
+ * @brief An error that ends a WebSocket connection, with the status code to
+ *        close it with.
+ */
+class WebSocketError : public std::runtime_error {
+ public:
+    WebSocketError(uint16_t code, const char *reason)
+        : std::runtime_error(reason), code_(code) {}
+
+    uint16_t Code() const { return code_; }
+
+ private:
+    uint16_t code_;
+};
+
+/**
+ * @brief Server side framing of one WebSocket connection (RFC 6455).
+ *
+ * Frames are taken from the connection's input as they arrive, a payload
+ * being unmasked straight from the input into the message it belongs to,
+ * so that a fragmented or partly received message is copied only once.
+ * Control frames may arrive between the fragments of a message and are
+ * handed out on their own. No extensions are negotiated. The message being
+ * assembled is charged to the memory budget, if there is one.
+ */
+class WebSocketCodec {
+ public:
+    enum class Opcode : uint8_t {
+        Continuation = 0x0,
+        Text = 0x1,
+        Binary = 0x2,
+        Close = 0x8,
+        Ping = 0x9,
+        Pong = 0xa
+    };
+
+    // A complete data message, or a control frame.
+    struct Message {
+        Opcode opcode;
+        std::string payload;
+    };
+
+    explicit WebSocketCodec(size_t maxMessageSize,
+                            MemoryBudget *budget = nullptr);
+
+    ~WebSocketCodec();
+
+    WebSocketCodec(const WebSocketCodec &) = delete;
+    WebSocketCodec &operator=(const WebSocketCodec &) = delete;
+
+    bool Next(ReadBuffer *input, Message *message);
+
+    static void EncodeFrame(Opcode opcode,
+                            std::string_view payload,
+                            std::string *frames);
+
+    static void EncodeClose(uint16_t code, std::string *frames);
+
+    static uint16_t CloseCode(std::string_view payload);
+
+    static std::string AcceptKey(std::string_view key);
+
+    static void Unmask(const char *source,
+                       size_t length,
+                       const uint8_t mask[4],
+                       size_t offset,
+                       char *destination);
+
+ private:
+    size_t max_message_size_;
+
+    // Frame whose payload is being received.
+    bool in_frame_;
+    bool final_;
+    Opcode frame_opcode_;
+    uint64_t payload_remaining_;
+    uint8_t mask_[4];
+    size_t mask_offset_;
+
+    // Data message being assembled from its fragments.
+    Opcode message_opcode_;
+    std::string message_;
+
+    MemoryBudget *budget_;
+    size_t charged_;
+
+    std::string control_;
+
+    bool ReadFrameHeader(ReadBuffer *input);
+
+    void ChargeMessage();
+};
+
+}   // namespace webloom::core
+
+#endif  // CORE_WEBSOCKETCODEC_H_